@@ -1,12 +1,12 @@
-#version 330 core
+#version 420 core
 out vec4 FragColor;
 
 struct Material {
   sampler2D diffuse;
   sampler2D specular;
-  float shininess;
 };
 
+// std140 packs each float into the padding of the vec3 before it
 struct DirectionalLight {
   vec3 direction;
   vec3 ambient;
@@ -16,27 +16,25 @@ struct DirectionalLight {
 
 struct PointLight {
   vec3 position;
-
   float constant;
-  float linear;
-  float quadratic;
-  
   vec3 ambient;
+  float linear;
   vec3 diffuse;
+  float quadratic;
   vec3 specular;
 };
 
 struct SpotLight {
   vec3 position;
-  vec3 direction;
-  float cutOff;
-  float outerCutOff;
   float constant;
+  vec3 direction;
   float linear;
-  float quadratic;
   vec3 ambient;
+  float quadratic;
   vec3 diffuse;
+  float cutOff;
   vec3 specular;
+  float outerCutOff;
 };
 
 #define NR_POINT_LIGHTS 4
@@ -45,10 +43,26 @@ in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3 viewPos;
-uniform DirectionalLight directionalLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+layout (std140, binding = 0) uniform Camera
+{
+  mat4 projection;
+  mat4 view;
+  vec3 viewPos;
+};
+
+layout (std140, binding = 1) uniform Lights
+{
+  DirectionalLight directionalLight;
+  PointLight pointLights[NR_POINT_LIGHTS];
+  SpotLight spotLight;
+};
+
+layout (std140, binding = 2) uniform Object
+{
+  mat4 model;
+  float shininess;
+};
+
 uniform Material material;
 
 vec3 calculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDirection);
@@ -77,7 +91,7 @@ vec3 calculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir
   vec3 lightDirection = normalize(-light.direction);
   float diff = max(dot(normal, lightDirection), 0.0);
   vec3 reflectDirection = reflect(-lightDirection, normal);
-  float spec = pow(max(dot(viewDirection, reflectDirection), 0.0), material.shininess);
+  float spec = pow(max(dot(viewDirection, reflectDirection), 0.0), shininess);
   vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
   vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
   vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
@@ -89,7 +103,7 @@ vec3 calculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewD
   vec3 lightDirection = normalize(light.position - fragPos);
   float diff = max(dot(normal, lightDirection), 0.0);
   vec3 reflectDirection = reflect(-lightDirection, normal);
-  float spec = pow(max(dot(viewDirection, reflectDirection), 0.0), material.shininess);
+  float spec = pow(max(dot(viewDirection, reflectDirection), 0.0), shininess);
   float lightDistance = length(light.position - fragPos);
   float attenuation = 1.0 / (light.constant + light.linear * lightDistance + light.quadratic * (lightDistance * lightDistance));
   vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
@@ -106,7 +120,7 @@ vec3 calculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir
   vec3 lightDirection = normalize(light.position - fragPos);
   float diff = max(dot(normal, lightDirection), 0.0);
   vec3 reflectDirection = reflect(-lightDirection, normal);
-  float spec = pow(max(dot(viewDirection, reflectDirection), 0.0), material.shininess);
+  float spec = pow(max(dot(viewDirection, reflectDirection), 0.0), shininess);
   float lightDistance = length(light.position - fragPos);
   float attenuation = 1.0 / (light.constant + light.linear * lightDistance + light.quadratic * (lightDistance * lightDistance));
   float theta = dot(lightDirection, normalize(-light.direction));
@@ -1,4 +1,4 @@
-#version 330 core
+#version 420 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
@@ -7,9 +7,18 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140, binding = 0) uniform Camera
+{
+  mat4 projection;
+  mat4 view;
+  vec3 viewPos;
+};
+
+layout (std140, binding = 2) uniform Object
+{
+  mat4 model;
+  float shininess;
+};
 
 void main()
 {
@@ -1,11 +1,20 @@
-#version 330 core
+#version 420 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140, binding = 0) uniform Camera
+{
+  mat4 projection;
+  mat4 view;
+  vec3 viewPos;
+};
+
+layout (std140, binding = 2) uniform Object
+{
+  mat4 model;
+  float shininess;
+};
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+  gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
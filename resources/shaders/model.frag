@@ -0,0 +1,78 @@
+#version 430 core
+out vec4 FragColor;
+
+struct Material {
+  sampler2D texture_diffuse1;
+  sampler2D texture_specular1;
+  float shininess;
+};
+
+struct Packs {
+  sampler2DArray diffuse;
+  sampler2DArray specular;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+flat in uint MeshId;
+
+uniform vec3 lightDirection;
+uniform Material material;
+uniform bool packed;
+uniform Packs packs;
+
+// one entry per mesh of the model, regions are indexed by texture type
+struct MeshData {
+  vec4 positionOffset;
+  vec4 positionScale;
+  vec4 regionRects[4];
+  ivec4 regionLayers;
+};
+
+layout (std430, binding = 1) readonly buffer Meshes
+{
+  MeshData meshes[];
+};
+
+layout (std140, binding = 0) uniform Camera
+{
+  mat4 projection;
+  mat4 view;
+  vec3 viewPos;
+};
+
+// wraps inside the region, the gradients of the unwrapped coordinates keep
+// the mip selection smooth across the wrap
+vec4 samplePack(sampler2DArray pack, int type)
+{
+  vec4 rect = meshes[MeshId].regionRects[type];
+  int layer = meshes[MeshId].regionLayers[type];
+  if (layer < 0)
+    return vec4(0.0);
+
+  vec2 uv = rect.xy + fract(TexCoords) * rect.zw;
+  vec2 dx = dFdx(TexCoords) * rect.zw;
+  vec2 dy = dFdy(TexCoords) * rect.zw;
+  return textureGrad(pack, vec3(uv, layer), dx, dy);
+}
+
+void main()
+{
+  vec3 normal = normalize(Normal);
+  vec3 toLight = normalize(-lightDirection);
+  vec3 viewDirection = normalize(viewPos - FragPos);
+  vec3 reflectDirection = reflect(-toLight, normal);
+
+  vec3 albedo = packed ? vec3(samplePack(packs.diffuse, 0))
+                       : vec3(texture(material.texture_diffuse1, TexCoords));
+  vec3 specularColor = packed ? vec3(samplePack(packs.specular, 1))
+                              : vec3(texture(material.texture_specular1, TexCoords));
+  float diff = max(dot(normal, toLight), 0.0);
+  float spec = pow(max(dot(viewDirection, reflectDirection), 0.0), material.shininess);
+
+  vec3 ambient = 0.1 * albedo;
+  vec3 diffuse = diff * albedo;
+  vec3 specular = spec * specularColor;
+  FragColor = vec4(ambient + diffuse + specular, 1.0);
+}
\ No newline at end of file
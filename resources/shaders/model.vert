@@ -0,0 +1,74 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aNormal;
+layout (location = 4) in vec2 aTexCoords;
+layout (location = 5) in uvec4 aBoneIds;
+layout (location = 6) in vec4 aWeights;
+layout (location = 7) in mat4 aModel;
+layout (location = 11) in uint aMeshId;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+flat out uint MeshId;
+
+layout (std140, binding = 0) uniform Camera
+{
+  mat4 projection;
+  mat4 view;
+  vec3 viewPos;
+};
+
+layout (std430, binding = 0) readonly buffer Bones
+{
+  mat4 bones[];
+};
+
+// one entry per mesh of the model, regions are indexed by texture type
+struct MeshData {
+  vec4 positionOffset;
+  vec4 positionScale;
+  vec4 regionRects[4];
+  ivec4 regionLayers;
+};
+
+layout (std430, binding = 1) readonly buffer Meshes
+{
+  MeshData meshes[];
+};
+
+vec3 octDecode(vec2 e)
+{
+  vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-v.z, 0.0);
+  v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+  return normalize(v);
+}
+
+// weights are unorm8, they only sum to one again after rescaling
+mat4 skinMatrix()
+{
+  vec4 weights = aWeights / max(dot(aWeights, vec4(1.0)), 1e-6);
+  return weights.x * bones[aBoneIds.x] + weights.y * bones[aBoneIds.y] +
+         weights.z * bones[aBoneIds.z] + weights.w * bones[aBoneIds.w];
+}
+
+void main()
+{
+  MeshData mesh = meshes[aMeshId];
+  vec3 position = mesh.positionOffset.xyz + aPos * mesh.positionScale.xyz;
+  vec3 normal = octDecode(aNormal);
+  if (mesh.positionOffset.w > 0.5)
+  {
+    mat4 skin = skinMatrix();
+    position = vec3(skin * vec4(position, 1.0));
+    normal = mat3(skin) * normal;
+  }
+
+  FragPos = vec3(aModel * vec4(position, 1.0));
+  Normal = mat3(transpose(inverse(aModel))) * normal;
+  TexCoords = aTexCoords;
+  MeshId = aMeshId;
+
+  gl_Position = projection * view * vec4(FragPos, 1.0);
+}
\ No newline at end of file
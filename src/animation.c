@@ -0,0 +1,34 @@
+#include "animation.h"
+
+#include <math.h>
+
+#include <cglm/cglm.h>
+
+void animation_sample(animation_clip_t const *clip, size_t bones_size, float time, bool loop, mat4 *palette)
+{
+  if (clip->frames_size == 0)
+  {
+    return;
+  }
+
+  if (loop && clip->duration > 0.f)
+  {
+    time = fmodf(time, clip->duration);
+    time = time < 0.f ? time + clip->duration : time;
+  }
+
+  float frame = glm_clamp(time * clip->frame_rate, 0.f, (float)(clip->frames_size - 1));
+  size_t first = (size_t)frame;
+  size_t second = first + 1 < clip->frames_size ? first + 1 : first;
+  float t = frame - (float)first;
+
+  mat4 const *a = &clip->palettes[first * bones_size];
+  mat4 const *b = &clip->palettes[second * bones_size];
+  for (size_t i = 0; i < bones_size; i++)
+  {
+    for (size_t c = 0; c < 4; c++)
+    {
+      glm_vec4_lerp((float *)a[i][c], (float *)b[i][c], t, palette[i][c]);
+    }
+  }
+}
@@ -0,0 +1,33 @@
+#if !defined(_ANIMATION_H_)
+#define _ANIMATION_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cglm/types.h>
+
+// clips are baked at this many palettes per second on import
+#define ANIMATION_FRAME_RATE 30.f
+
+// a bone is the node that moves it and the inverse of its bind pose in the
+// space of the meshes it skins
+typedef struct animation_bone
+{
+  uint32_t node;
+  mat4 offset;
+} animation_bone_t;
+
+// palettes[frame * bones_size + bone], the last frame lands on duration
+typedef struct animation_clip
+{
+  char const *name;
+  float duration, frame_rate;
+  size_t frames_size;
+  mat4 const *palettes;
+} animation_clip_t;
+
+// blends the two frames around time, a looping clip wraps it around duration
+void animation_sample(animation_clip_t const *clip, size_t bones_size, float time, bool loop, mat4 *palette);
+
+#endif // _ANIMATION_H_
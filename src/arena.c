@@ -0,0 +1,145 @@
+#include "arena.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct arena_chunk
+{
+  arena_chunk_t *next;
+  size_t capacity, offset;
+  alignas(max_align_t) unsigned char data[];
+};
+
+static arena_chunk_t *_new_chunk(arena_t *arena, size_t capacity)
+{
+  arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + capacity);
+  assert(chunk != NULL);
+  chunk->capacity = capacity;
+  chunk->offset = 0;
+  arena->chunks_size++;
+  arena->reserved += capacity;
+  return chunk;
+}
+
+static void *_bump(arena_chunk_t *chunk, size_t size, size_t alignment)
+{
+  uintptr_t start = (uintptr_t)chunk->data;
+  uintptr_t address = (start + chunk->offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  if (address + size > start + chunk->capacity)
+  {
+    return NULL;
+  }
+
+  chunk->offset = address + size - start;
+  return (void *)address;
+}
+
+void arena_init(size_t chunk_size, arena_t *arena)
+{
+  memset(arena, 0, sizeof(arena_t));
+  arena->chunk_size = chunk_size;
+  pthread_mutex_init(&arena->mutex, NULL);
+}
+
+void arena_deinit(arena_t *arena)
+{
+  if (arena == NULL)
+  {
+    return;
+  }
+
+  arena_release(arena);
+  pthread_mutex_destroy(&arena->mutex);
+  memset(arena, 0, sizeof(arena_t));
+}
+
+void arena_release(arena_t *arena)
+{
+  arena_chunk_t *chunk = arena->chunks;
+  while (chunk != NULL)
+  {
+    arena_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
+  arena->chunks = NULL;
+  arena->chunks_size = 0;
+  arena->allocations = 0;
+  arena->used = 0;
+  arena->reserved = 0;
+}
+
+// only the first chunk is bumped, a chunk made for one big allocation goes
+// behind it so the space left in the first one is not lost
+void *arena_alloc(arena_t *arena, size_t size, size_t alignment)
+{
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+  pthread_mutex_lock(&arena->mutex);
+  size_t used = 0;
+  void *pointer = NULL;
+  arena_chunk_t *head = arena->chunks;
+  if (head != NULL)
+  {
+    size_t offset = head->offset;
+    pointer = _bump(head, size, alignment);
+    used = head->offset - offset;
+  }
+
+  if (pointer == NULL)
+  {
+    size_t capacity = size + alignment > arena->chunk_size ? size + alignment : arena->chunk_size;
+    arena_chunk_t *chunk = _new_chunk(arena, capacity);
+    pointer = _bump(chunk, size, alignment);
+    used = chunk->offset;
+    if (head != NULL && capacity > arena->chunk_size)
+    {
+      chunk->next = head->next;
+      head->next = chunk;
+    }
+    else
+    {
+      chunk->next = head;
+      arena->chunks = chunk;
+    }
+  }
+
+  arena->allocations++;
+  arena->used += used;
+  if (arena->used > arena->high_water)
+  {
+    arena->high_water = arena->used;
+  }
+  pthread_mutex_unlock(&arena->mutex);
+  return pointer;
+}
+
+void *arena_calloc(arena_t *arena, size_t count, size_t size)
+{
+  assert(size == 0 || count <= SIZE_MAX / size);
+  void *pointer = arena_alloc(arena, count * size, alignof(max_align_t));
+  memset(pointer, 0, count * size);
+  return pointer;
+}
+
+void *arena_copy(arena_t *arena, void const *data, size_t size)
+{
+  void *pointer = arena_alloc(arena, size, alignof(max_align_t));
+  if (size > 0)
+  {
+    memcpy(pointer, data, size);
+  }
+  return pointer;
+}
+
+char *arena_strdup(arena_t *arena, char const *string)
+{
+  size_t size = strlen(string) + 1;
+  char *copy = arena_alloc(arena, size, 1);
+  memcpy(copy, string, size);
+  return copy;
+}
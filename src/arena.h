@@ -0,0 +1,35 @@
+#if !defined(_ARENA_H_)
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#include <pthread.h>
+
+#define ARENA_CHUNK_SIZE_DEFAULT ((size_t)4 << 20)
+
+typedef struct arena_chunk arena_chunk_t;
+
+// a chunked bump allocator, memory is only given back all at once by
+// arena_release. allocations bigger than a chunk get a chunk of their own.
+// used counts the bytes handed out since the last release, reserved the bytes
+// held in chunks and high_water the most used ever held
+typedef struct arena
+{
+  arena_chunk_t *chunks;
+  size_t chunk_size;
+  size_t chunks_size, allocations;
+  size_t used, reserved, high_water;
+  pthread_mutex_t mutex;
+} arena_t;
+
+void arena_init(size_t chunk_size, arena_t *arena);
+void arena_deinit(arena_t *arena);
+void arena_release(arena_t *arena);
+
+// safe to call from several threads at once
+void *arena_alloc(arena_t *arena, size_t size, size_t alignment);
+void *arena_calloc(arena_t *arena, size_t count, size_t size);
+void *arena_copy(arena_t *arena, void const *data, size_t size);
+char *arena_strdup(arena_t *arena, char const *string);
+
+#endif // _ARENA_H_
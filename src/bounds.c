@@ -0,0 +1,176 @@
+#include "bounds.h"
+
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include <cglm/cglm.h>
+
+#include "mesh.h"
+
+void bounds_empty(bounds_t *bounds)
+{
+  *bounds = (bounds_t){
+      .min = {FLT_MAX, FLT_MAX, FLT_MAX},
+      .max = {-FLT_MAX, -FLT_MAX, -FLT_MAX},
+      .radius = -1.f,
+  };
+}
+
+bool bounds_is_empty(bounds_t const *bounds)
+{
+  return bounds->radius < 0.f;
+}
+
+// the position is followed by the normal inside vertex_t, so loading four
+// floats from it stays inside the vertex and the last lane is ignored
+static void _min_max(vertex_t const *vertices, size_t vertices_size, vec3 min, vec3 max)
+{
+#if defined(__SSE__)
+  __m128 min0 = _mm_set1_ps(FLT_MAX), max0 = _mm_set1_ps(-FLT_MAX);
+  __m128 min1 = min0, max1 = max0;
+  size_t i = 0;
+  for (; i + 1 < vertices_size; i += 2)
+  {
+    __m128 a = _mm_loadu_ps(vertices[i].position);
+    __m128 b = _mm_loadu_ps(vertices[i + 1].position);
+    min0 = _mm_min_ps(min0, a), max0 = _mm_max_ps(max0, a);
+    min1 = _mm_min_ps(min1, b), max1 = _mm_max_ps(max1, b);
+  }
+
+  if (i < vertices_size)
+  {
+    __m128 a = _mm_loadu_ps(vertices[i].position);
+    min0 = _mm_min_ps(min0, a), max0 = _mm_max_ps(max0, a);
+  }
+
+  float lanes_min[4], lanes_max[4];
+  _mm_storeu_ps(lanes_min, _mm_min_ps(min0, min1));
+  _mm_storeu_ps(lanes_max, _mm_max_ps(max0, max1));
+  glm_vec3_copy(lanes_min, min);
+  glm_vec3_copy(lanes_max, max);
+#else
+  glm_vec3_copy((vec3){FLT_MAX, FLT_MAX, FLT_MAX}, min);
+  glm_vec3_copy((vec3){-FLT_MAX, -FLT_MAX, -FLT_MAX}, max);
+  for (size_t i = 0; i < vertices_size; i++)
+  {
+    glm_vec3_minv(min, (float *)vertices[i].position, min);
+    glm_vec3_maxv(max, (float *)vertices[i].position, max);
+  }
+#endif
+}
+
+// Ritter growth from a sphere spanning the longest box axis, kept only when it
+// ends up tighter than the sphere around the box center
+static void _tight_sphere(vertex_t const *vertices, size_t vertices_size, bounds_t *bounds)
+{
+  glm_vec3_center(bounds->min, bounds->max, bounds->center);
+  float box_radius2 = 0.f;
+  for (size_t i = 0; i < vertices_size; i++)
+  {
+    box_radius2 = glm_max(box_radius2, glm_vec3_distance2(bounds->center, (float *)vertices[i].position));
+  }
+
+  vec3 extent, center;
+  glm_vec3_sub(bounds->max, bounds->min, extent);
+  glm_vec3_copy(bounds->center, center);
+  float radius = glm_vec3_max(extent) * .5f;
+  for (size_t i = 0; i < vertices_size; i++)
+  {
+    float const *position = vertices[i].position;
+    float distance2 = glm_vec3_distance2(center, (float *)position);
+    if (distance2 > radius * radius)
+    {
+      float distance = sqrtf(distance2);
+      float grown = (radius + distance) * .5f;
+      vec3 direction;
+      glm_vec3_sub((float *)position, center, direction);
+      glm_vec3_muladds(direction, (grown - radius) / distance, center);
+      radius = grown;
+    }
+  }
+
+  bounds->radius = sqrtf(box_radius2);
+  if (radius < bounds->radius)
+  {
+    glm_vec3_copy(center, bounds->center);
+    bounds->radius = radius;
+  }
+}
+
+void bounds_from_vertices(vertex_t const *vertices, size_t vertices_size, bounds_t *bounds)
+{
+  bounds_empty(bounds);
+  if (vertices_size == 0)
+  {
+    return;
+  }
+
+  _min_max(vertices, vertices_size, bounds->min, bounds->max);
+  _tight_sphere(vertices, vertices_size, bounds);
+}
+
+void bounds_transform(bounds_t const *bounds, mat4 transform, bounds_t *dest)
+{
+  if (bounds_is_empty(bounds))
+  {
+    bounds_empty(dest);
+    return;
+  }
+
+  bounds_t result;
+  for (size_t i = 0; i < 3; i++)
+  {
+    result.min[i] = result.max[i] = transform[3][i];
+    for (size_t j = 0; j < 3; j++)
+    {
+      float a = transform[j][i] * bounds->min[j], b = transform[j][i] * bounds->max[j];
+      result.min[i] += fminf(a, b);
+      result.max[i] += fmaxf(a, b);
+    }
+  }
+
+  float scale = glm_max(glm_vec3_norm(transform[0]), glm_max(glm_vec3_norm(transform[1]), glm_vec3_norm(transform[2])));
+  glm_mat4_mulv3(transform, (float *)bounds->center, 1.f, result.center);
+  result.radius = bounds->radius * scale;
+  *dest = result;
+}
+
+void bounds_merge(bounds_t *dest, bounds_t const *bounds)
+{
+  if (bounds_is_empty(bounds))
+  {
+    return;
+  }
+
+  if (bounds_is_empty(dest))
+  {
+    *dest = *bounds;
+    return;
+  }
+
+  glm_vec3_minv(dest->min, (float *)bounds->min, dest->min);
+  glm_vec3_maxv(dest->max, (float *)bounds->max, dest->max);
+
+  float distance = glm_vec3_distance(dest->center, (float *)bounds->center);
+  if (distance + bounds->radius <= dest->radius)
+  {
+    return;
+  }
+
+  if (distance + dest->radius <= bounds->radius)
+  {
+    glm_vec3_copy((float *)bounds->center, dest->center);
+    dest->radius = bounds->radius;
+    return;
+  }
+
+  float radius = (distance + dest->radius + bounds->radius) * .5f;
+  vec3 direction;
+  glm_vec3_sub((float *)bounds->center, dest->center, direction);
+  glm_vec3_muladds(direction, (radius - dest->radius) / distance, dest->center);
+  dest->radius = radius;
+}
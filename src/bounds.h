@@ -0,0 +1,25 @@
+#if !defined(_BOUNDS_H_)
+#define _BOUNDS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <cglm/types.h>
+
+struct vertex;
+
+// an empty box has min > max and a negative radius
+typedef struct bounds
+{
+  vec3 min, max;
+  vec3 center;
+  float radius;
+} bounds_t;
+
+void bounds_empty(bounds_t *bounds);
+bool bounds_is_empty(bounds_t const *bounds);
+void bounds_from_vertices(struct vertex const *vertices, size_t vertices_size, bounds_t *bounds);
+void bounds_transform(bounds_t const *bounds, mat4 transform, bounds_t *dest);
+void bounds_merge(bounds_t *dest, bounds_t const *bounds);
+
+#endif // _BOUNDS_H_
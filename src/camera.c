@@ -1,5 +1,8 @@
 #include "camera.h"
 
+#include <float.h>
+#include <math.h>
+
 #include <cglm/cglm.h>
 
 void cam_init(
@@ -98,3 +101,23 @@ void cam_process_mouse(camera_t *camera, float xoff, float yoff)
   camera->front[2] = sinf(glm_rad(camera->yaw)) * cosf(glm_rad(camera->pitch));
   glm_normalize(camera->front);
 }
+
+void cam_get_frustum_planes(camera_t *camera, mat4 projection, vec4 planes[6])
+{
+  mat4 view, view_projection;
+  cam_get_view_matrix(camera, view);
+  glm_mat4_mul(projection, view, view_projection);
+  glm_frustum_planes(view_projection, planes);
+}
+
+// sphere radius on screen as a fraction of half the viewport height
+float cam_projected_radius(camera_t *camera, vec3 center, float radius)
+{
+  float distance2 = glm_vec3_distance2(camera->pos, center);
+  if (distance2 <= radius * radius)
+  {
+    return FLT_MAX;
+  }
+
+  return radius / (sqrtf(distance2 - radius * radius) * tanf(glm_rad(camera->zoom) * .5f));
+}
@@ -55,5 +55,7 @@ void cam_get_view_matrix(camera_t *camera, mat4 view_matrix);
 void cam_process_scroll(camera_t *camera, float offset);
 void cam_process_key(camera_t *camera, enum camera_mov_e direction, float frame_time);
 void cam_process_mouse(camera_t *camera, float xoff, float yoff);
+void cam_get_frustum_planes(camera_t *camera, mat4 projection, vec4 planes[6]);
+float cam_projected_radius(camera_t *camera, vec3 center, float radius);
 
 #endif // CAMERA_H
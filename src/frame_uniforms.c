@@ -0,0 +1,74 @@
+#include "frame_uniforms.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+// std140 offsets, the matrices may be aligned further in c but not spaced
+_Static_assert(offsetof(frame_camera_t, view) == 64, "camera block layout");
+_Static_assert(offsetof(frame_camera_t, view_pos) == 128, "camera block layout");
+_Static_assert(sizeof(frame_directional_light_t) == 64, "lights block layout");
+_Static_assert(sizeof(frame_point_light_t) == 64, "lights block layout");
+_Static_assert(sizeof(frame_spot_light_t) == 80, "lights block layout");
+_Static_assert(offsetof(frame_lights_t, spot) == 64 + 64 * FRAME_POINT_LIGHTS, "lights block layout");
+_Static_assert(offsetof(frame_object_t, shininess) == 64, "object block layout");
+
+// past the end of the last member, c may pad the matrices further
+#define CAMERA_BLOCK_SIZE (offsetof(frame_camera_t, pad) + sizeof(float))
+#define OBJECT_BLOCK_SIZE (offsetof(frame_object_t, pad) + 3 * sizeof(float))
+
+static struct
+{
+  upload_ring_t ring;
+  bool full;
+} frame;
+
+static void _bind(GLuint binding, void const *data, size_t size)
+{
+  if (!upload_ring_bind(&frame.ring, GL_UNIFORM_BUFFER, binding, data, size) && !frame.full)
+  {
+    fprintf(stderr, "Upload ring is full, %zu bytes per frame\n", frame.ring.frame_size);
+    frame.full = true;
+  }
+}
+
+bool frame_uniforms_init(size_t frame_size)
+{
+  frame.full = false;
+  return upload_ring_init(frame_size, &frame.ring);
+}
+
+void frame_uniforms_deinit(void)
+{
+  upload_ring_deinit(&frame.ring);
+}
+
+upload_ring_t *frame_uniforms_ring(void)
+{
+  return &frame.ring;
+}
+
+void frame_uniforms_begin(void)
+{
+  upload_ring_begin_frame(&frame.ring);
+  frame.full = false;
+}
+
+void frame_uniforms_end(void)
+{
+  upload_ring_end_frame(&frame.ring);
+}
+
+void frame_uniforms_set_camera(frame_camera_t const *camera)
+{
+  _bind(FRAME_CAMERA_BINDING, camera, CAMERA_BLOCK_SIZE);
+}
+
+void frame_uniforms_set_lights(frame_lights_t const *lights)
+{
+  _bind(FRAME_LIGHTS_BINDING, lights, sizeof(frame_lights_t));
+}
+
+void frame_uniforms_set_object(frame_object_t const *object)
+{
+  _bind(FRAME_OBJECT_BINDING, object, OBJECT_BLOCK_SIZE);
+}
@@ -0,0 +1,93 @@
+#if !defined(_FRAME_UNIFORMS_H_)
+#define _FRAME_UNIFORMS_H_
+
+#include <stdbool.h>
+
+#include <glad/gl.h>
+#include <cglm/types.h>
+
+#include "upload_ring.h"
+
+// uniform block bindings shared by every program, the shaders declare them
+// with layout (std140, binding = n)
+#define FRAME_CAMERA_BINDING 0
+#define FRAME_LIGHTS_BINDING 1
+#define FRAME_OBJECT_BINDING 2
+#define FRAME_POINT_LIGHTS 4
+
+// the structs mirror the std140 layout of the blocks, a vec3 is followed by
+// a float that fills the rest of its 16 bytes
+typedef struct frame_camera
+{
+  mat4 projection;
+  mat4 view;
+  vec3 view_pos;
+  float pad;
+} frame_camera_t;
+
+typedef struct frame_directional_light
+{
+  vec3 direction;
+  float pad0;
+  vec3 ambient;
+  float pad1;
+  vec3 diffuse;
+  float pad2;
+  vec3 specular;
+  float pad3;
+} frame_directional_light_t;
+
+typedef struct frame_point_light
+{
+  vec3 position;
+  float constant;
+  vec3 ambient;
+  float linear;
+  vec3 diffuse;
+  float quadratic;
+  vec3 specular;
+  float pad;
+} frame_point_light_t;
+
+typedef struct frame_spot_light
+{
+  vec3 position;
+  float constant;
+  vec3 direction;
+  float linear;
+  vec3 ambient;
+  float quadratic;
+  vec3 diffuse;
+  float cut_off;
+  vec3 specular;
+  float outer_cut_off;
+} frame_spot_light_t;
+
+typedef struct frame_lights
+{
+  frame_directional_light_t directional;
+  frame_point_light_t points[FRAME_POINT_LIGHTS];
+  frame_spot_light_t spot;
+} frame_lights_t;
+
+// per draw data of the simple shaders
+typedef struct frame_object
+{
+  mat4 model;
+  float shininess;
+  float pad[3];
+} frame_object_t;
+
+bool frame_uniforms_init(size_t frame_size);
+void frame_uniforms_deinit(void);
+upload_ring_t *frame_uniforms_ring(void);
+
+// every block is written into the upload ring and bound by offset, so a
+// frame can set the same block any number of times between begin and end
+void frame_uniforms_begin(void);
+void frame_uniforms_end(void);
+void frame_uniforms_set_camera(frame_camera_t const *camera);
+void frame_uniforms_set_lights(frame_lights_t const *lights);
+void frame_uniforms_set_object(frame_object_t const *object);
+
+#endif // _FRAME_UNIFORMS_H_
@@ -1,7 +1,14 @@
 #include "fs.h"
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 char *fs_read_as_text(char const *filename)
 {
@@ -27,3 +34,193 @@ char *fs_read_as_text(char const *filename)
 
   return buffer;
 }
+
+char *fs_directory(char const *path)
+{
+  char const *separator = strrchr(path, '/');
+  char const *backslash = strrchr(path, '\\');
+  if (backslash != NULL && (separator == NULL || backslash > separator))
+  {
+    separator = backslash;
+  }
+
+  if (separator == NULL)
+  {
+    char *directory = strdup(".");
+    assert(directory != NULL);
+    return directory;
+  }
+
+  size_t size = separator == path ? 1 : (size_t)(separator - path);
+  char *directory = malloc(size + 1);
+  assert(directory != NULL);
+  memcpy(directory, path, size);
+  directory[size] = 0;
+  return directory;
+}
+
+char *fs_join_path(char const *directory, char const *path)
+{
+  bool absolute = path[0] == '/' || path[0] == '\\' || (path[0] != 0 && path[1] == ':');
+  if (absolute || directory == NULL || directory[0] == 0)
+  {
+    char *joined = strdup(path);
+    assert(joined != NULL);
+    fs_normalize_path(joined);
+    return joined;
+  }
+
+  size_t size = strlen(directory) + strlen(path) + 2;
+  char *joined = malloc(size);
+  assert(joined != NULL);
+  snprintf(joined, size, "%s/%s", directory, path);
+  fs_normalize_path(joined);
+  return joined;
+}
+
+// rewrites separators to '/' and folds empty, "." and "dir/.." components in place
+void fs_normalize_path(char *path)
+{
+  for (char *c = path; *c; c++)
+  {
+    if (*c == '\\')
+    {
+      *c = '/';
+    }
+  }
+
+  char *root = path + (path[0] == '/');
+  char *read = root;
+  char *write = root;
+
+  while (*read)
+  {
+    char *end = strchr(read, '/');
+    size_t length = end != NULL ? (size_t)(end - read) : strlen(read);
+    bool is_dot = length == 1 && read[0] == '.';
+    bool is_parent = length == 2 && read[0] == '.' && read[1] == '.';
+
+    char *last = write;
+    while (last > root && *(last - 1) != '/')
+    {
+      last--;
+    }
+    bool can_pop = write > root && !(write - last == 2 && last[0] == '.' && last[1] == '.');
+
+    if (is_parent && can_pop)
+    {
+      write = last > root ? last - 1 : last;
+    }
+    else if (length > 0 && !is_dot && (!is_parent || root == path))
+    {
+      if (write > root)
+      {
+        *write++ = '/';
+      }
+      memmove(write, read, length);
+      write += length;
+    }
+
+    read += length + (end != NULL);
+  }
+
+  if (write == path)
+  {
+    *write++ = '.';
+  }
+  *write = 0;
+}
+
+char const *fs_relative_path(char const *directory, char const *path)
+{
+  size_t size = strlen(directory);
+  if (strcmp(directory, ".") == 0 || strncmp(directory, path, size) != 0 || path[size] != '/')
+  {
+    return path;
+  }
+
+  return path + size + 1;
+}
+
+bool fs_map(char const *filename, fs_mapping_t *mapping)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    perror("Cannot map file");
+    return false;
+  }
+
+  mapping->data = data;
+  mapping->size = info.st_size;
+  return true;
+}
+
+void fs_unmap(fs_mapping_t *mapping)
+{
+  if (mapping == NULL || mapping->data == NULL)
+  {
+    return;
+  }
+
+  munmap((void *)mapping->data, mapping->size);
+  mapping->data = NULL;
+  mapping->size = 0;
+}
+
+// FNV-1a folded over 64-bit words, the tail is mixed byte by byte. the low
+// bits of a word only reach the low bits of the hash, so the murmur3 finalizer
+// spreads every byte over the bits tables take their slot from
+uint64_t fs_hash(void const *data, size_t size, uint64_t seed)
+{
+  uint64_t const prime = 0x100000001b3ull;
+  unsigned char const *bytes = data;
+  uint64_t hash = seed ^ 0xcbf29ce484222325ull;
+
+  size_t words = size / sizeof(uint64_t);
+  for (size_t i = 0; i < words; i++)
+  {
+    uint64_t word;
+    memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(word));
+    hash = (hash ^ word) * prime;
+  }
+
+  for (size_t i = words * sizeof(uint64_t); i < size; i++)
+  {
+    hash = (hash ^ bytes[i]) * prime;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+bool fs_hash_file(char const *filename, uint64_t *hash)
+{
+  fs_mapping_t mapping;
+  if (!fs_map(filename, &mapping))
+  {
+    return false;
+  }
+
+  *hash = fs_hash(mapping.data, mapping.size, mapping.size);
+  fs_unmap(&mapping);
+  return true;
+}
@@ -1,6 +1,25 @@
 #if !defined(FS_H)
 #define FS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct fs_mapping
+{
+  void const *data;
+  size_t size;
+} fs_mapping_t;
+
 char *fs_read_as_text(char const *filename);
+char *fs_directory(char const *path);
+char *fs_join_path(char const *directory, char const *path);
+void fs_normalize_path(char *path);
+char const *fs_relative_path(char const *directory, char const *path);
+
+bool fs_map(char const *filename, fs_mapping_t *mapping);
+void fs_unmap(fs_mapping_t *mapping);
+uint64_t fs_hash(void const *data, size_t size, uint64_t seed);
+bool fs_hash_file(char const *filename, uint64_t *hash);
 
 #endif // FS_H
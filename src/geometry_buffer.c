@@ -0,0 +1,297 @@
+#include "geometry_buffer.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cglm/types.h>
+
+#include "mesh.h"
+#include "vertex_format.h"
+
+#define VERTEX_BINDING 0
+#define INSTANCE_BINDING 1
+#define MESH_ID_BINDING 2
+
+// free holds the unused ranges sorted by offset, never two adjacent ones
+typedef struct pool
+{
+  GLuint buffer;
+  size_t capacity, used;
+  geometry_range_t *free;
+  size_t free_size, free_capacity;
+} pool_t;
+
+static struct
+{
+  bool initialized;
+  pool_t vertices, indices;
+  GLuint vaos[VERTEX_FORMATS_SIZE];
+} geometry;
+
+static GLuint _create_buffer(size_t capacity)
+{
+  GLuint buffer;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return buffer;
+}
+
+static void _insert_free(pool_t *pool, size_t index, geometry_range_t range)
+{
+  if (pool->free_size == pool->free_capacity)
+  {
+    pool->free_capacity = pool->free_capacity ? pool->free_capacity << 1 : 16;
+    geometry_range_t *free = realloc(pool->free, pool->free_capacity * sizeof(geometry_range_t));
+    assert(free != NULL);
+    pool->free = free;
+  }
+
+  memmove(&pool->free[index + 1], &pool->free[index], (pool->free_size - index) * sizeof(geometry_range_t));
+  pool->free[index] = range;
+  pool->free_size++;
+}
+
+static void _remove_free(pool_t *pool, size_t index)
+{
+  memmove(&pool->free[index], &pool->free[index + 1], (pool->free_size - index - 1) * sizeof(geometry_range_t));
+  pool->free_size--;
+}
+
+// gives range back and merges it with the free ranges right before and after
+static void _release(pool_t *pool, geometry_range_t range)
+{
+  size_t index = 0;
+  while (index < pool->free_size && pool->free[index].offset < range.offset)
+  {
+    index++;
+  }
+
+  if (index > 0 && pool->free[index - 1].offset + pool->free[index - 1].size == range.offset)
+  {
+    index--;
+    range.offset = pool->free[index].offset;
+    range.size += pool->free[index].size;
+    _remove_free(pool, index);
+  }
+
+  if (index < pool->free_size && range.offset + range.size == pool->free[index].offset)
+  {
+    range.size += pool->free[index].size;
+    _remove_free(pool, index);
+  }
+
+  _insert_free(pool, index, range);
+}
+
+static void _init_pool(pool_t *pool, size_t capacity)
+{
+  memset(pool, 0, sizeof(pool_t));
+  pool->capacity = capacity;
+  pool->buffer = _create_buffer(capacity);
+  _insert_free(pool, 0, (geometry_range_t){.offset = 0, .size = capacity});
+}
+
+static void _point_vaos(void)
+{
+  for (size_t i = 0; i < VERTEX_FORMATS_SIZE; i++)
+  {
+    glVertexArrayVertexBuffer(geometry.vaos[i], VERTEX_BINDING, geometry.vertices.buffer, 0, vertex_format_layout(i)->stride);
+    glVertexArrayElementBuffer(geometry.vaos[i], geometry.indices.buffer);
+  }
+}
+
+// old contents keep their offsets in the bigger buffer
+static void _grow(pool_t *pool, size_t size)
+{
+  size_t capacity = pool->capacity << 1;
+  while (capacity < pool->capacity + size)
+  {
+    capacity <<= 1;
+  }
+
+  GLuint buffer = _create_buffer(capacity);
+  glBindBuffer(GL_COPY_READ_BUFFER, pool->buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pool->capacity);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glDeleteBuffers(1, &pool->buffer);
+
+  _release(pool, (geometry_range_t){.offset = pool->capacity, .size = capacity - pool->capacity});
+  pool->buffer = buffer;
+  pool->capacity = capacity;
+  _point_vaos();
+}
+
+// first fit, alignment need not be a power of two since vertex strides are not.
+// the space skipped to align stays free
+static geometry_range_t _allocate(pool_t *pool, size_t size, size_t alignment)
+{
+  for (;;)
+  {
+    for (size_t i = 0; i < pool->free_size; i++)
+    {
+      geometry_range_t range = pool->free[i];
+      size_t start = (range.offset + alignment - 1) / alignment * alignment;
+      if (start + size > range.offset + range.size)
+      {
+        continue;
+      }
+
+      _remove_free(pool, i);
+      size_t end = range.offset + range.size;
+      if (end > start + size)
+      {
+        _insert_free(pool, i, (geometry_range_t){.offset = start + size, .size = end - start - size});
+      }
+      if (start > range.offset)
+      {
+        _insert_free(pool, i, (geometry_range_t){.offset = range.offset, .size = start - range.offset});
+      }
+
+      pool->used += size;
+      return (geometry_range_t){.offset = start, .size = size};
+    }
+
+    _grow(pool, size + alignment);
+  }
+}
+
+// the vertex attributes of every format read binding 0, the instance matrix
+// binding 1 and the mesh index binding 2, both advancing once per instance
+static void _setup_vao(GLuint vao, uint32_t format)
+{
+  vertex_layout_t const *layout = vertex_format_layout(format);
+  for (size_t i = 0; i < layout->attributes_size; i++)
+  {
+    vertex_attribute_t const *attribute = &layout->attributes[i];
+    glEnableVertexArrayAttrib(vao, attribute->location);
+    if (attribute->integer)
+    {
+      glVertexArrayAttribIFormat(vao, attribute->location, attribute->size, attribute->type, attribute->offset);
+    }
+    else
+    {
+      glVertexArrayAttribFormat(vao, attribute->location, attribute->size, attribute->type, attribute->normalized, attribute->offset);
+    }
+    glVertexArrayAttribBinding(vao, attribute->location, VERTEX_BINDING);
+  }
+
+  for (GLuint i = 0; i < 4; i++)
+  {
+    glEnableVertexArrayAttrib(vao, MESH_INSTANCE_LOCATION + i);
+    glVertexArrayAttribFormat(vao, MESH_INSTANCE_LOCATION + i, 4, GL_FLOAT, GL_FALSE, i * sizeof(vec4));
+    glVertexArrayAttribBinding(vao, MESH_INSTANCE_LOCATION + i, INSTANCE_BINDING);
+  }
+  glVertexArrayBindingDivisor(vao, INSTANCE_BINDING, 1);
+
+  glEnableVertexArrayAttrib(vao, MESH_ID_LOCATION);
+  glVertexArrayAttribIFormat(vao, MESH_ID_LOCATION, 1, GL_UNSIGNED_INT, 0);
+  glVertexArrayAttribBinding(vao, MESH_ID_LOCATION, MESH_ID_BINDING);
+  glVertexArrayBindingDivisor(vao, MESH_ID_BINDING, 1);
+}
+
+static void _init(void)
+{
+  if (geometry.initialized)
+  {
+    return;
+  }
+
+  _init_pool(&geometry.vertices, GEOMETRY_BUFFER_VERTEX_CAPACITY);
+  _init_pool(&geometry.indices, GEOMETRY_BUFFER_INDEX_CAPACITY);
+  glCreateVertexArrays(VERTEX_FORMATS_SIZE, geometry.vaos);
+  for (size_t i = 0; i < VERTEX_FORMATS_SIZE; i++)
+  {
+    _setup_vao(geometry.vaos[i], i);
+  }
+  _point_vaos();
+  geometry.initialized = true;
+}
+
+static geometry_range_t _upload(pool_t *pool, void const *data, size_t size, size_t alignment)
+{
+  if (size == 0)
+  {
+    return (geometry_range_t){0};
+  }
+
+  _init();
+  geometry_range_t range = _allocate(pool, size, alignment);
+  glNamedBufferSubData(pool->buffer, range.offset, size, data);
+  return range;
+}
+
+geometry_range_t geometry_buffer_upload_vertices(void const *data, size_t size, size_t stride)
+{
+  return _upload(&geometry.vertices, data, size, stride);
+}
+
+geometry_range_t geometry_buffer_upload_indices(void const *data, size_t size, size_t index_size)
+{
+  return _upload(&geometry.indices, data, size, index_size);
+}
+
+void geometry_buffer_free_vertices(geometry_range_t range)
+{
+  if (range.size > 0 && geometry.initialized)
+  {
+    geometry.vertices.used -= range.size;
+    _release(&geometry.vertices, range);
+  }
+}
+
+void geometry_buffer_free_indices(geometry_range_t range)
+{
+  if (range.size > 0 && geometry.initialized)
+  {
+    geometry.indices.used -= range.size;
+    _release(&geometry.indices, range);
+  }
+}
+
+void geometry_buffer_bind(uint32_t format)
+{
+  _init();
+  glBindVertexArray(geometry.vaos[format % VERTEX_FORMATS_SIZE]);
+}
+
+void geometry_buffer_set_instances(GLuint matrices, GLuint meshes)
+{
+  _init();
+  for (size_t i = 0; i < VERTEX_FORMATS_SIZE; i++)
+  {
+    glVertexArrayVertexBuffer(geometry.vaos[i], INSTANCE_BINDING, matrices, 0, sizeof(mat4));
+    glVertexArrayVertexBuffer(geometry.vaos[i], MESH_ID_BINDING, meshes, 0, sizeof(uint32_t));
+  }
+}
+
+void geometry_buffer_get_stats(geometry_buffer_stats_t *stats)
+{
+  *stats = (geometry_buffer_stats_t){
+      .vertex_used = geometry.vertices.used,
+      .vertex_capacity = geometry.vertices.capacity,
+      .index_used = geometry.indices.used,
+      .index_capacity = geometry.indices.capacity,
+      .free_ranges = geometry.vertices.free_size + geometry.indices.free_size,
+  };
+}
+
+void geometry_buffer_deinit(void)
+{
+  if (!geometry.initialized)
+  {
+    return;
+  }
+
+  glDeleteVertexArrays(VERTEX_FORMATS_SIZE, geometry.vaos);
+  glDeleteBuffers(1, &geometry.vertices.buffer);
+  glDeleteBuffers(1, &geometry.indices.buffer);
+  free(geometry.vertices.free);
+  free(geometry.indices.free);
+  memset(&geometry, 0, sizeof(geometry));
+}
@@ -0,0 +1,43 @@
+#if !defined(_GEOMETRY_BUFFER_H_)
+#define _GEOMETRY_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/gl.h>
+
+#define GEOMETRY_BUFFER_VERTEX_CAPACITY ((size_t)32 << 20)
+#define GEOMETRY_BUFFER_INDEX_CAPACITY ((size_t)16 << 20)
+
+// a range of bytes of the vertex or the index buffer, empty when size is 0
+typedef struct geometry_range
+{
+  size_t offset, size;
+} geometry_range_t;
+
+typedef struct geometry_buffer_stats
+{
+  size_t vertex_used, vertex_capacity;
+  size_t index_used, index_capacity;
+  size_t free_ranges;
+} geometry_buffer_stats_t;
+
+// GL thread only. every mesh lives in one vertex and one index buffer shared
+// by all of them, ranges are first fit out of a free list and the buffers grow
+// by copying when nothing fits, so offsets stay valid. a vertex range starts
+// at a multiple of its stride and an index range at a multiple of the index
+// size, which makes them base vertex and first index of indirect commands
+geometry_range_t geometry_buffer_upload_vertices(void const *data, size_t size, size_t stride);
+geometry_range_t geometry_buffer_upload_indices(void const *data, size_t size, size_t index_size);
+void geometry_buffer_free_vertices(geometry_range_t range);
+void geometry_buffer_free_indices(geometry_range_t range);
+
+// one vertex array per vertex format reads the shared buffers, instances come
+// from the buffers set by geometry_buffer_set_instances
+void geometry_buffer_bind(uint32_t format);
+void geometry_buffer_set_instances(GLuint matrices, GLuint meshes);
+
+void geometry_buffer_get_stats(geometry_buffer_stats_t *stats);
+void geometry_buffer_deinit(void);
+
+#endif // _GEOMETRY_BUFFER_H_
@@ -0,0 +1,280 @@
+#include "gpu_cull.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cglm/cglm.h>
+
+#include "shader.h"
+
+// storage bindings of the cull pass, clear of the ones models draw with
+#define MATRICES_BINDING 2
+#define MESH_IDS_BINDING 3
+#define MESHES_BINDING 4
+#define SEGMENTS_BINDING 5
+#define BATCHES_BINDING 6
+#define COMMANDS_BINDING 7
+#define COUNTS_BINDING 8
+#define PYRAMID_UNIT 15
+#define PYRAMID_GROUP_SIZE 8
+
+_Static_assert(sizeof(gpu_cull_mesh_t) == 80, "cull mesh layout");
+_Static_assert(sizeof(gpu_cull_segment_t) == 16, "cull segment layout");
+_Static_assert(sizeof(gpu_cull_batch_t) == 16, "cull batch layout");
+
+// the pyramid holds the farthest depth of every texel footprint, level 0 is
+// a copy of depth. dispatched tells capture whether anyone needs it
+static struct
+{
+  bool ready, dispatched, captured;
+  shader_t cull, pyramid;
+  struct
+  {
+    shader_int_t instances_size, hiz, hiz_valid;
+    shader_vec4_t planes[6];
+    shader_vec3_t eye;
+    shader_float_t tan_half_fov, lod_screen_error;
+    shader_mat4_t hiz_view_projection;
+  } cull_uniforms;
+  struct
+  {
+    shader_int_t level, depth;
+  } pyramid_uniforms;
+  GLuint framebuffer, depth, levels_texture;
+  int width, height, levels;
+  mat4 view_projection;
+} culler;
+
+bool gpu_cull_init(void)
+{
+  memset(&culler, 0, sizeof(culler));
+  if (!shader_init_compute("resources/shaders/cull.comp", &culler.cull))
+  {
+    return false;
+  }
+
+  if (!shader_init_compute("resources/shaders/depth_pyramid.comp", &culler.pyramid))
+  {
+    shader_deinit(&culler.cull);
+    return false;
+  }
+
+  culler.cull_uniforms.instances_size = shader_resolve_int(&culler.cull, "instancesSize");
+  culler.cull_uniforms.hiz = shader_resolve_int(&culler.cull, "hiz");
+  culler.cull_uniforms.hiz_valid = shader_resolve_int(&culler.cull, "hizValid");
+  for (size_t i = 0; i < 6; i++)
+  {
+    char property_name[16];
+    snprintf(property_name, sizeof(property_name), "planes[%zu]", i);
+    culler.cull_uniforms.planes[i] = shader_resolve_vec4(&culler.cull, property_name);
+  }
+  culler.cull_uniforms.eye = shader_resolve_vec3(&culler.cull, "eye");
+  culler.cull_uniforms.tan_half_fov = shader_resolve_float(&culler.cull, "tanHalfFov");
+  culler.cull_uniforms.lod_screen_error = shader_resolve_float(&culler.cull, "lodScreenError");
+  culler.cull_uniforms.hiz_view_projection = shader_resolve_mat4(&culler.cull, "hizViewProjection");
+  culler.pyramid_uniforms.level = shader_resolve_int(&culler.pyramid, "level");
+  culler.pyramid_uniforms.depth = shader_resolve_int(&culler.pyramid, "depth");
+
+  glGenFramebuffers(1, &culler.framebuffer);
+  culler.ready = true;
+  return true;
+}
+
+void gpu_cull_deinit(void)
+{
+  if (!culler.ready)
+  {
+    return;
+  }
+
+  glDeleteTextures(1, &culler.depth);
+  glDeleteTextures(1, &culler.levels_texture);
+  glDeleteFramebuffers(1, &culler.framebuffer);
+  shader_deinit(&culler.pyramid);
+  shader_deinit(&culler.cull);
+  memset(&culler, 0, sizeof(culler));
+}
+
+bool gpu_cull_ready(void)
+{
+  return culler.ready;
+}
+
+static GLuint _create_buffer(GLenum target, size_t size, void const *data, GLenum usage)
+{
+  GLuint buffer;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(target, buffer);
+  glBufferData(target, size, data, usage);
+  glBindBuffer(target, 0);
+  return buffer;
+}
+
+void gpu_cull_set_init(
+    gpu_cull_mesh_t const *meshes,
+    size_t meshes_size,
+    gpu_cull_segment_t const *segments,
+    size_t segments_size,
+    gpu_cull_batch_t const *batches,
+    size_t batches_size,
+    size_t instances_size,
+    gpu_cull_set_t *set)
+{
+  memset(set, 0, sizeof(gpu_cull_set_t));
+  set->instances_size = instances_size;
+  set->batches_size = batches_size;
+  for (size_t i = 0; i < batches_size; i++)
+  {
+    set->commands_capacity += batches[i].capacity;
+  }
+
+  set->meshes = _create_buffer(GL_SHADER_STORAGE_BUFFER, meshes_size * sizeof(gpu_cull_mesh_t), meshes, GL_STATIC_DRAW);
+  set->segments = _create_buffer(GL_SHADER_STORAGE_BUFFER, segments_size * sizeof(gpu_cull_segment_t), segments, GL_STATIC_DRAW);
+  set->batches = _create_buffer(GL_SHADER_STORAGE_BUFFER, batches_size * sizeof(gpu_cull_batch_t), batches, GL_STATIC_DRAW);
+  set->commands = _create_buffer(GL_SHADER_STORAGE_BUFFER, set->commands_capacity * sizeof(mesh_draw_command_t), NULL, GL_DYNAMIC_COPY);
+  set->counts = _create_buffer(GL_SHADER_STORAGE_BUFFER, batches_size * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+}
+
+void gpu_cull_set_deinit(gpu_cull_set_t *set)
+{
+  if (set == NULL)
+  {
+    return;
+  }
+
+  glDeleteBuffers(1, &set->meshes);
+  glDeleteBuffers(1, &set->segments);
+  glDeleteBuffers(1, &set->batches);
+  glDeleteBuffers(1, &set->commands);
+  glDeleteBuffers(1, &set->counts);
+  memset(set, 0, sizeof(gpu_cull_set_t));
+}
+
+void gpu_cull_dispatch(
+    gpu_cull_set_t *set,
+    GLuint matrices,
+    GLuint mesh_ids,
+    camera_t *camera,
+    mat4 projection,
+    float lod_screen_error)
+{
+  if (!culler.ready)
+  {
+    return;
+  }
+
+  GLuint zero = 0;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, set->counts);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  if (set->instances_size == 0)
+  {
+    return;
+  }
+
+  vec4 planes[6];
+  cam_get_frustum_planes(camera, projection, planes);
+
+  shader_use(&culler.cull);
+  shader_put_int(culler.cull_uniforms.instances_size, (int)set->instances_size);
+  for (size_t i = 0; i < 6; i++)
+  {
+    shader_put_vec4(culler.cull_uniforms.planes[i], planes[i]);
+  }
+  shader_put_vec3(culler.cull_uniforms.eye, camera->pos);
+  shader_put_float(culler.cull_uniforms.tan_half_fov, tanf(glm_rad(camera->zoom) * .5f));
+  shader_put_float(culler.cull_uniforms.lod_screen_error, lod_screen_error);
+  shader_put_bool(culler.cull_uniforms.hiz_valid, culler.captured);
+  shader_put_mat4(culler.cull_uniforms.hiz_view_projection, culler.view_projection);
+  shader_put_int(culler.cull_uniforms.hiz, PYRAMID_UNIT);
+  glActiveTexture(GL_TEXTURE0 + PYRAMID_UNIT);
+  glBindTexture(GL_TEXTURE_2D, culler.levels_texture);
+  glActiveTexture(GL_TEXTURE0);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATRICES_BINDING, matrices);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_IDS_BINDING, mesh_ids);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESHES_BINDING, set->meshes);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SEGMENTS_BINDING, set->segments);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCHES_BINDING, set->batches);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, set->commands);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTS_BINDING, set->counts);
+  glDispatchCompute((set->instances_size + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+  culler.dispatched = true;
+}
+
+static void _resize(int width, int height)
+{
+  if (culler.width == width && culler.height == height)
+  {
+    return;
+  }
+
+  glDeleteTextures(1, &culler.depth);
+  glDeleteTextures(1, &culler.levels_texture);
+  culler.width = width;
+  culler.height = height;
+  culler.levels = (int)floorf(log2f((float)(width > height ? width : height))) + 1;
+  culler.captured = false;
+
+  glGenTextures(1, &culler.depth);
+  glBindTexture(GL_TEXTURE_2D, culler.depth);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  glGenTextures(1, &culler.levels_texture);
+  glBindTexture(GL_TEXTURE_2D, culler.levels_texture);
+  glTexStorage2D(GL_TEXTURE_2D, culler.levels, GL_R32F, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, culler.framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, culler.depth, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void gpu_cull_capture_depth(int width, int height, mat4 view_projection)
+{
+  if (!culler.ready || !culler.dispatched || width <= 0 || height <= 0)
+  {
+    return;
+  }
+
+  culler.dispatched = false;
+  _resize(width, height);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, culler.framebuffer);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // every level reads the one before it, level 0 reads the depth copy
+  shader_use(&culler.pyramid);
+  shader_put_int(culler.pyramid_uniforms.depth, PYRAMID_UNIT);
+  glActiveTexture(GL_TEXTURE0 + PYRAMID_UNIT);
+  glBindTexture(GL_TEXTURE_2D, culler.depth);
+  glActiveTexture(GL_TEXTURE0);
+  for (int level = 0; level < culler.levels; level++)
+  {
+    int level_width = width >> level > 0 ? width >> level : 1;
+    int level_height = height >> level > 0 ? height >> level : 1;
+    shader_put_int(culler.pyramid_uniforms.level, level);
+    if (level > 0)
+    {
+      glBindImageTexture(0, culler.levels_texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    }
+    glBindImageTexture(1, culler.levels_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute(
+        (level_width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (level_height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+  glm_mat4_copy(view_projection, culler.view_projection);
+  culler.captured = true;
+}
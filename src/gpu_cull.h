@@ -0,0 +1,85 @@
+#if !defined(_GPU_CULL_H_)
+#define _GPU_CULL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/gl.h>
+#include <cglm/types.h>
+
+#include "camera.h"
+#include "mesh.h"
+
+#define GPU_CULL_GROUP_SIZE 64
+
+// std430 entry per mesh, sphere is the model space bounding sphere. level l
+// draws lod_segments_size[l] segments from lod_segments[l] of the segment
+// table. a mesh that is not culled, a skinned one, is only given its level
+typedef struct gpu_cull_mesh
+{
+  vec4 sphere;
+  float lod_errors[MESH_LOD_MAX];
+  uint32_t lod_segments[MESH_LOD_MAX];
+  uint32_t lod_segments_size[MESH_LOD_MAX];
+  uint32_t lods_size, batch, culled, pad;
+} gpu_cull_mesh_t;
+
+// a segment with its mesh offsets already applied
+typedef struct gpu_cull_segment
+{
+  GLuint count, first_index;
+  GLint base_vertex;
+  GLuint pad;
+} gpu_cull_segment_t;
+
+// the commands of a batch go to [first_command, first_command + capacity)
+typedef struct gpu_cull_batch
+{
+  GLuint first_command, capacity, pad[2];
+} gpu_cull_batch_t;
+
+// the buffers of one model, counts holds how many commands every batch got
+typedef struct gpu_cull_set
+{
+  GLuint meshes, segments, batches, commands, counts;
+  size_t instances_size, batches_size, commands_capacity;
+} gpu_cull_set_t;
+
+// compiles the cull and depth pyramid passes, false when they cannot run and
+// models have to cull on the cpu
+bool gpu_cull_init(void);
+void gpu_cull_deinit(void);
+bool gpu_cull_ready(void);
+
+void gpu_cull_set_init(
+    gpu_cull_mesh_t const *meshes,
+    size_t meshes_size,
+    gpu_cull_segment_t const *segments,
+    size_t segments_size,
+    gpu_cull_batch_t const *batches,
+    size_t batches_size,
+    size_t instances_size,
+    gpu_cull_set_t *set);
+void gpu_cull_set_deinit(gpu_cull_set_t *set);
+
+// one invocation per instance tests its sphere against the frustum and the
+// depth pyramid of the last captured frame, picks a level and appends one
+// command per segment of it to its batch. matrices and mesh_ids are indexed
+// by instance. commands and counts are ready for
+// glMultiDrawElementsIndirectCount once it returns
+void gpu_cull_dispatch(
+    gpu_cull_set_t *set,
+    GLuint matrices,
+    GLuint mesh_ids,
+    camera_t *camera,
+    mat4 projection,
+    float lod_screen_error);
+
+// copies the depth of the default framebuffer, which has to be 24 bit depth
+// with 8 bit stencil as glfw creates it, and reduces it to a pyramid of the
+// farthest depth. only does anything when some set was dispatched since the
+// last capture. view_projection is what the frame was drawn with
+void gpu_cull_capture_depth(int width, int height, mat4 view_projection);
+
+#endif // _GPU_CULL_H_
@@ -1,5 +1,6 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
@@ -9,11 +10,15 @@
 #include <GLFW/glfw3.h>
 #undef GLFW_INCLUDE_NONE
 
-#include <stb_image.h>
 #include <cglm/cglm.h>
 
 #include "shader.h"
 #include "camera.h"
+#include "frame_uniforms.h"
+#include "gpu_cull.h"
+#include "geometry_buffer.h"
+#include "skinning_bench.h"
+#include "texture_loader.h"
 
 #define ARRAYSIZE(arr) (sizeof(arr) / sizeof(*arr))
 
@@ -22,7 +27,6 @@ static void _framebuffer_size_cb(GLFWwindow *window, int width, int height);
 static void _key_cb(GLFWwindow *window, int key, int scancode, int action, int mods);
 static void _mouse_cb(GLFWwindow *window, double xpos, double ypos);
 static void _scroll_cb(GLFWwindow *window, double xoff, double yoff);
-static bool _create_texture(char const *filename, GLuint *texture);
 
 #define DEFAULT_SCR_W 1280
 #define DEFAULT_SCR_H 720
@@ -93,17 +97,7 @@ static vec3 POINT_LIGHT_POSITIONS[] = {
     {-4.f, 2.f, -12.f},
     {0.f, 0.f, -3.f}};
 
-#define SET_POINT_LIGHT(shader, index, array)                                             \
-  do                                                                                      \
-  {                                                                                       \
-    shader_set_vec3(shader, "pointLights[" #index "].position", array[index]);            \
-    shader_set_vec3(shader, "pointLights[" #index "].ambient", (vec3){.05f, .05f, .05f}); \
-    shader_set_vec3(shader, "pointLights[" #index "].diffuse", (vec3){.8f, .8f, .8f});    \
-    shader_set_vec3(shader, "pointLights[" #index "].specular", (vec3){1.f, 1.f, 1.f});   \
-    shader_set_float(shader, "pointLights[" #index "].constant", 1.f);                    \
-    shader_set_float(shader, "pointLights[" #index "].linear", .09f);                     \
-    shader_set_float(shader, "pointLights[" #index "].quadratic", .032f);                 \
-  } while (0)
+_Static_assert(ARRAYSIZE(POINT_LIGHT_POSITIONS) == FRAME_POINT_LIGHTS, "one block entry per point light");
 
 static float frame_time = 0.f;
 static float last_frame_time = 0.f;
@@ -116,6 +110,9 @@ static vec3 light_pos = {-.2f, -1.f, -.3f};
 
 int main(int argc, char const *argv[])
 {
+  // --bench-skinning <model> [characters] [frames] runs in a hidden window and exits
+  bool bench_skinning = argc >= 3 && strcmp(argv[1], "--bench-skinning") == 0;
+
   glfwSetErrorCallback(_error_cb);
 
   if (!glfwInit())
@@ -130,6 +127,7 @@ int main(int argc, char const *argv[])
 #ifdef __APPLE__
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
 #endif
+  glfwWindowHint(GLFW_VISIBLE, bench_skinning ? GLFW_FALSE : GLFW_TRUE);
 
   GLFWwindow *window = glfwCreateWindow(screen_width, screen_height, "Learning OpenGL", NULL, NULL);
   if (window == NULL)
@@ -153,6 +151,32 @@ int main(int argc, char const *argv[])
   glfwSwapInterval(GLFW_TRUE);
 
   glEnable(GL_DEPTH_TEST);
+  if (!frame_uniforms_init(UPLOAD_RING_FRAME_SIZE_DEFAULT))
+  {
+    fputs("Cannot create frame uniforms\n", stderr);
+    return 1;
+  }
+
+  // models asking for gpu culling cull on the cpu without it
+  if (!gpu_cull_init())
+  {
+    fputs("Cannot load cull shaders, culling on the CPU\n", stderr);
+  }
+
+  if (bench_skinning)
+  {
+    texture_loader_init();
+    int status = skinning_bench(
+        argv[2],
+        argc >= 4 ? strtoul(argv[3], NULL, 10) : 100,
+        argc >= 5 ? strtoul(argv[4], NULL, 10) : 100);
+    gpu_cull_deinit();
+    geometry_buffer_deinit();
+    texture_loader_deinit();
+    frame_uniforms_deinit();
+    glfwTerminate();
+    return status;
+  }
 
   cam_init(
       (vec3){0.f, 0.f, 3.f},
@@ -204,72 +228,73 @@ int main(int argc, char const *argv[])
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
   glEnableVertexAttribArray(0);
 
-  GLuint diffuse_map;
-  if (!_create_texture("resources/textures/container2.png", &diffuse_map))
-  {
-    fputs("Cannot create texture container\n", stderr);
-    return 1;
-  }
-
-  GLuint specular_map;
-  if (!_create_texture("resources/textures/container2_specular.png", &specular_map))
-  {
-    fputs("Cannot create texture container specular\n", stderr);
-    return 1;
-  }
+  texture_loader_init();
+  GLuint diffuse_map = texture_loader_load("resources/textures/container2.png", TEXTURE_USAGE_COLOR);
+  GLuint specular_map = texture_loader_load("resources/textures/container2_specular.png", TEXTURE_USAGE_DATA);
 
   shader_use(&cube_shader);
   shader_set_int(&cube_shader, "material.diffuse", 0);
   shader_set_int(&cube_shader, "material.specular", 1);
 
+  // only the spot light follows the camera, the rest is written once
+  frame_lights_t lights = {
+      .directional = {
+          .direction = {-.2f, -1.f, -.3f},
+          .ambient = {.05f, .05f, .05f},
+          .diffuse = {.4f, .4f, .4f},
+          .specular = {.5f, .5f, .5f},
+      },
+      .spot = {
+          .ambient = {0.f, 0.f, 0.f},
+          .diffuse = {1.f, 1.f, 1.f},
+          .specular = {1.f, 1.f, 1.f},
+          .constant = 1.f,
+          .linear = .09f,
+          .quadratic = .032f,
+          .cut_off = cosf(glm_rad(12.5f)),
+          .outer_cut_off = cosf(glm_rad(15.f)),
+      },
+  };
+  for (size_t i = 0; i < ARRAYSIZE(POINT_LIGHT_POSITIONS); i++)
+  {
+    lights.points[i] = (frame_point_light_t){
+        .ambient = {.05f, .05f, .05f},
+        .diffuse = {.8f, .8f, .8f},
+        .specular = {1.f, 1.f, 1.f},
+        .constant = 1.f,
+        .linear = .09f,
+        .quadratic = .032f,
+    };
+    glm_vec3_copy(POINT_LIGHT_POSITIONS[i], lights.points[i].position);
+  }
+
   while (!glfwWindowShouldClose(window))
   {
     float current_time = glfwGetTime();
     frame_time = current_time - last_frame_time;
     last_frame_time = current_time;
 
+    texture_loader_update(TEXTURE_UPLOAD_BUDGET_MS);
+
+    frame_uniforms_begin();
+
     glClearColor(.1f, .1f, .1f, 1.f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     /* light_pos[0] = 1.f + sinf(current_time) * 2.f;
     light_pos[2] = 1.f + cosf(current_time) * 2.f; */
 
-    shader_use(&cube_shader);
+    frame_camera_t frame_camera;
+    glm_perspective(glm_rad(camera.zoom), ((float)screen_width) / ((float)screen_height), .1f, 100.f, frame_camera.projection);
+    cam_get_view_matrix(&camera, frame_camera.view);
+    glm_vec3_copy(camera.pos, frame_camera.view_pos);
+    frame_uniforms_set_camera(&frame_camera);
 
-    shader_set_vec3(&cube_shader, "viewPos", camera.pos);
-    shader_set_float(&cube_shader, "material.shininess", 64.f);
-
-    shader_set_vec3(&cube_shader, "directionalLight.direction", (vec3){-.2f, -1.f, -.3f});
-    shader_set_vec3(&cube_shader, "directionalLight.ambient", (vec3){.05f, .05f, .05f});
-    shader_set_vec3(&cube_shader, "directionalLight.diffuse", (vec3){.4f, .4f, .4f});
-    shader_set_vec3(&cube_shader, "directionalLight.specular", (vec3){.5f, .5f, .5f});
-
-    SET_POINT_LIGHT(&cube_shader, 0, POINT_LIGHT_POSITIONS);
-    SET_POINT_LIGHT(&cube_shader, 1, POINT_LIGHT_POSITIONS);
-    SET_POINT_LIGHT(&cube_shader, 2, POINT_LIGHT_POSITIONS);
-    SET_POINT_LIGHT(&cube_shader, 3, POINT_LIGHT_POSITIONS);
-
-    shader_set_vec3(&cube_shader, "spotLight.position", camera.pos);
-    shader_set_vec3(&cube_shader, "spotLight.direction", camera.front);
-    shader_set_vec3(&cube_shader, "spotLight.ambient", (vec3){0.f, 0.f, 0.f});
-    shader_set_vec3(&cube_shader, "spotLight.diffuse", (vec3){1.f, 1.f, 1.f});
-    shader_set_vec3(&cube_shader, "spotLight.specular", (vec3){1.f, 1.f, 1.f});
-    shader_set_float(&cube_shader, "spotLight.constant", 1.0f);
-    shader_set_float(&cube_shader, "spotLight.linear", 0.09f);
-    shader_set_float(&cube_shader, "spotLight.quadratic", 0.032f);
-    shader_set_float(&cube_shader, "spotLight.cutOff", cosf(glm_rad(12.5f)));
-    shader_set_float(&cube_shader, "spotLight.outerCutOff", cosf(glm_rad(15.f)));
-
-    mat4 projection;
-    glm_perspective(glm_rad(camera.zoom), ((float)screen_width) / ((float)screen_height), .1f, 100.f, projection);
-    shader_set_mat4(&cube_shader, "projection", projection);
-
-    mat4 view;
-    cam_get_view_matrix(&camera, view);
-    shader_set_mat4(&cube_shader, "view", view);
-
-    mat4 cube_model = GLM_MAT4_IDENTITY_INIT;
-    shader_set_mat4(&cube_shader, "model", cube_model);
+    glm_vec3_copy(camera.pos, lights.spot.position);
+    glm_vec3_copy(camera.front, lights.spot.direction);
+    frame_uniforms_set_lights(&lights);
+
+    shader_use(&cube_shader);
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, diffuse_map);
@@ -279,33 +304,42 @@ int main(int argc, char const *argv[])
     glBindVertexArray(cube_vao);
     for (int i = 0; i < ARRAYSIZE(CUBE_POSITIONS); i++)
     {
-      mat4 cube_model = GLM_MAT4_IDENTITY_INIT;
-      glm_translate(cube_model, CUBE_POSITIONS[i]);
+      frame_object_t cube = {.model = GLM_MAT4_IDENTITY_INIT, .shininess = 64.f};
+      glm_translate(cube.model, CUBE_POSITIONS[i]);
       float angle = 20.f * i;
-      glm_rotate(cube_model, glm_rad(angle), (vec3){1.f, .3f, .5f});
+      glm_rotate(cube.model, glm_rad(angle), (vec3){1.f, .3f, .5f});
 
-      shader_set_mat4(&cube_shader, "model", cube_model);
+      frame_uniforms_set_object(&cube);
       glDrawArrays(GL_TRIANGLES, 0, 36);
     }
 
     shader_use(&light_cube_shader);
-    shader_set_mat4(&light_cube_shader, "projection", projection);
-    shader_set_mat4(&light_cube_shader, "view", view);
 
     glBindVertexArray(light_cube_vao);
     for (int i = 0; i < ARRAYSIZE(POINT_LIGHT_POSITIONS); i++)
     {
-      mat4 light_cube_model = GLM_MAT4_IDENTITY_INIT;
-      glm_translate(light_cube_model, POINT_LIGHT_POSITIONS[i]);
-      glm_scale(light_cube_model, (vec3){.2f, .2f, .2f});
-      shader_set_mat4(&light_cube_shader, "model", light_cube_model);
+      frame_object_t light_cube = {.model = GLM_MAT4_IDENTITY_INIT};
+      glm_translate(light_cube.model, POINT_LIGHT_POSITIONS[i]);
+      glm_scale(light_cube.model, (vec3){.2f, .2f, .2f});
+      frame_uniforms_set_object(&light_cube);
       glDrawArrays(GL_TRIANGLES, 0, 36);
     }
 
+    // the next frame tests occlusion against what this one drew
+    mat4 view_projection;
+    glm_mat4_mul(frame_camera.projection, frame_camera.view, view_projection);
+    gpu_cull_capture_depth(screen_width, screen_height, view_projection);
+
+    frame_uniforms_end();
     glfwSwapBuffers(window);
     glfwPollEvents();
   }
 
+  gpu_cull_deinit();
+  frame_uniforms_deinit();
+  geometry_buffer_deinit();
+  texture_loader_deinit();
+
   return 0;
 }
 
@@ -421,44 +455,3 @@ static void _scroll_cb(GLFWwindow *window, double xoff, double yoff)
 
   cam_process_scroll(&camera, yoff);
 }
-
-static bool _create_texture(char const *filename, GLuint *texture)
-{
-  GLuint new_texture;
-  glGenTextures(1, &new_texture);
-  glBindTexture(GL_TEXTURE_2D, new_texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  int width, height, channels;
-  unsigned char *data = stbi_load(filename, &width, &height, &channels, 0);
-  if (data == NULL)
-  {
-    fprintf(stderr, "Error loading image texture");
-    glDeleteTextures(1, &new_texture);
-    return false;
-  }
-
-  GLenum color_format;
-  if (channels == 1)
-  {
-    color_format = GL_RED;
-  }
-  else if (channels == 3)
-  {
-    color_format = GL_RGB;
-  }
-  else if (channels == 4)
-  {
-    color_format = GL_RGBA;
-  }
-
-  glTexImage2D(GL_TEXTURE_2D, 0, color_format, width, height, 0, color_format, GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-  stbi_image_free(data);
-
-  *texture = new_texture;
-  return true;
-}
@@ -1,43 +1,187 @@
 #include "mesh.h"
 
+#include <assert.h>
+#include <float.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-static void _setup_mesh(mesh_t *mesh)
+#include <cglm/cglm.h>
+
+#include "texture_residency.h"
+#include "vertex_format.h"
+
+static void _push_segment(mesh_t *mesh, size_t *capacity, mesh_segment_t segment)
+{
+  if (mesh->segments_size == *capacity)
+  {
+    *capacity = *capacity ? *capacity << 1 : MESH_LOD_MAX;
+    mesh_segment_t *segments = realloc(mesh->segments, *capacity * sizeof(mesh_segment_t));
+    assert(segments != NULL);
+    mesh->segments = segments;
+  }
+
+  mesh->segments[mesh->segments_size++] = segment;
+}
+
+// cuts a level into runs whose vertex span fits 16 bits, never inside a meshlet
+// since every meshlet is drawn with the base vertex of a single run
+static bool _split_lod(mesh_t *mesh, mesh_lod_t *lod, bool by_meshlet, size_t *capacity)
+{
+  lod->first_segment = mesh->segments_size;
+
+  size_t start = lod->first_index, end = lod->first_index + lod->indices_size, meshlet = 0;
+  GLuint min = UINT32_MAX, max = 0;
+  for (size_t i = start; i < end;)
+  {
+    size_t unit_size = by_meshlet ? mesh->meshlets[meshlet++].indices_size : 3;
+    GLuint unit_min = UINT32_MAX, unit_max = 0;
+    for (size_t j = i; j < i + unit_size && j < end; j++)
+    {
+      unit_min = mesh->indices[j] < unit_min ? mesh->indices[j] : unit_min;
+      unit_max = mesh->indices[j] > unit_max ? mesh->indices[j] : unit_max;
+    }
+
+    if (unit_max - unit_min > UINT16_MAX)
+    {
+      return false;
+    }
+
+    GLuint run_min = unit_min < min ? unit_min : min, run_max = unit_max > max ? unit_max : max;
+    if (run_max - run_min > UINT16_MAX)
+    {
+      _push_segment(mesh, capacity, (mesh_segment_t){.first_index = start, .indices_size = i - start, .base_vertex = min});
+      start = i;
+      run_min = unit_min, run_max = unit_max;
+    }
+
+    min = run_min, max = run_max;
+    i += unit_size;
+  }
+
+  if (end > start)
+  {
+    _push_segment(mesh, capacity, (mesh_segment_t){.first_index = start, .indices_size = end - start, .base_vertex = min});
+  }
+
+  lod->segments_size = mesh->segments_size - lod->first_segment;
+  return true;
+}
+
+// 16 bit indices whenever every level splits into runs that fit, 32 bit otherwise
+static void _build_segments(mesh_t *mesh)
+{
+  size_t capacity = 0;
+  mesh->index_type = GL_UNSIGNED_SHORT;
+  for (size_t i = 0; i < mesh->lods_size; i++)
+  {
+    if (!_split_lod(mesh, &mesh->lods[i], i == 0 && mesh->meshlets_size > 0, &capacity))
+    {
+      mesh->index_type = GL_UNSIGNED_INT;
+      break;
+    }
+  }
+
+  if (mesh->index_type == GL_UNSIGNED_INT)
+  {
+    mesh->segments_size = 0;
+    for (size_t i = 0; i < mesh->lods_size; i++)
+    {
+      mesh_lod_t *lod = &mesh->lods[i];
+      lod->first_segment = mesh->segments_size;
+      lod->segments_size = 1;
+      _push_segment(mesh, &capacity, (mesh_segment_t){.first_index = lod->first_index, .indices_size = lod->indices_size});
+    }
+  }
+}
+
+static void _upload_indices(mesh_t *mesh)
 {
-  glGenVertexArrays(1, &mesh->vao);
-  glGenBuffers(1, &mesh->vbo);
-  glGenBuffers(1, &mesh->ebo);
+  if (mesh->index_type == GL_UNSIGNED_INT)
+  {
+    mesh->index_range = geometry_buffer_upload_indices(mesh->indices, mesh->indices_size * sizeof(GLuint), sizeof(GLuint));
+    mesh->first_index = mesh->index_range.offset / sizeof(GLuint);
+    return;
+  }
 
-  glBindVertexArray(mesh->vao);
-  glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+  GLushort *indices = calloc(mesh->indices_size, sizeof(GLushort));
+  assert(mesh->indices_size == 0 || indices != NULL);
+  for (size_t i = 0; i < mesh->segments_size; i++)
+  {
+    mesh_segment_t const *segment = &mesh->segments[i];
+    for (size_t j = segment->first_index; j < segment->first_index + segment->indices_size; j++)
+    {
+      indices[j] = mesh->indices[j] - segment->base_vertex;
+    }
+  }
 
-  glBufferData(GL_ARRAY_BUFFER, mesh->vertices_size * sizeof(vertex_t), mesh->vertices, GL_STATIC_DRAW);
+  mesh->index_range = geometry_buffer_upload_indices(indices, mesh->indices_size * sizeof(GLushort), sizeof(GLushort));
+  mesh->first_index = mesh->index_range.offset / sizeof(GLushort);
+  free(indices);
+}
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->indices_size * sizeof(GLuint), mesh->indices, GL_STATIC_DRAW);
+static void _setup_mesh(mesh_t *mesh)
+{
+  mesh->format = vertex_format_select(mesh->vertices, mesh->vertices_size);
+  vertex_layout_t const *layout = vertex_format_layout(mesh->format);
+  if (bounds_is_empty(&mesh->bounds))
+  {
+    glm_vec3_zero(mesh->position_offset);
+    glm_vec3_zero(mesh->position_scale);
+  }
+  else
+  {
+    glm_vec3_copy(mesh->bounds.min, mesh->position_offset);
+    glm_vec3_sub(mesh->bounds.max, mesh->bounds.min, mesh->position_scale);
+  }
 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)0);
+  void *packed = malloc(mesh->vertices_size * layout->stride);
+  assert(mesh->vertices_size == 0 || packed != NULL);
+  vertex_format_pack(
+      packed, mesh->format, mesh->vertices, mesh->vertices_size, mesh->position_offset, mesh->position_scale);
 
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, normal));
+  mesh->vertex_range = geometry_buffer_upload_vertices(packed, mesh->vertices_size * layout->stride, layout->stride);
+  mesh->base_vertex = mesh->vertex_range.offset / layout->stride;
+  free(packed);
 
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, tangent));
+  _upload_indices(mesh);
+}
 
-  glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, bitangent));
+// uv units per model space unit, from the areas of the full detail triangles
+static void _compute_uv_density(mesh_t *mesh)
+{
+  float area = 0.f, uv_area = 0.f;
+  GLuint const *indices = &mesh->indices[mesh->lods[0].first_index];
+  for (size_t i = 0; i + 2 < mesh->lods[0].indices_size; i += 3)
+  {
+    vertex_t const *a = &mesh->vertices[indices[i]], *b = &mesh->vertices[indices[i + 1]], *c = &mesh->vertices[indices[i + 2]];
+    vec3 ab, ac, normal;
+    glm_vec3_sub((float *)b->position, (float *)a->position, ab);
+    glm_vec3_sub((float *)c->position, (float *)a->position, ac);
+    glm_vec3_cross(ab, ac, normal);
+    area += glm_vec3_norm(normal);
 
-  glEnableVertexAttribArray(4);
-  glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, tex_coords));
+    vec2 uv_ab, uv_ac;
+    glm_vec2_sub((float *)b->tex_coords, (float *)a->tex_coords, uv_ab);
+    glm_vec2_sub((float *)c->tex_coords, (float *)a->tex_coords, uv_ac);
+    uv_area += fabsf(glm_vec2_cross(uv_ab, uv_ac));
+  }
 
-  glEnableVertexAttribArray(5);
-  glVertexAttribPointer(5, 3, GL_INT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, bone_ids));
+  mesh->uv_density = area > 0.f ? sqrtf(uv_area / area) : 0.f;
+}
 
-  glEnableVertexAttribArray(6);
-  glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, weights));
+// the textures mesh_bind_textures has a sampler for
+static size_t _bound_textures(mesh_t const *mesh)
+{
+  size_t counts[TEXTURE_TYPES_SIZE] = {0}, bound = 0;
+  for (size_t i = 0; i < mesh->textures_size; i++)
+  {
+    enum texture_type type = mesh->textures[i].type;
+    bound += type < TEXTURE_TYPES_SIZE && counts[type]++ < MESH_TEXTURE_SLOTS;
+  }
 
-  glBindVertexArray(0);
+  return bound;
 }
 
 void mesh_init(
@@ -45,6 +189,11 @@ void mesh_init(
     size_t vertices_size,
     GLuint *indices,
     size_t indices_size,
+    mesh_lod_t const *lods,
+    size_t lods_size,
+    meshlet_t *meshlets,
+    size_t meshlets_size,
+    bounds_t const *bounds,
     texture_t *textures,
     size_t textures_size,
     mesh_t *mesh)
@@ -55,7 +204,39 @@ void mesh_init(
   mesh->indices_size = indices_size;
   mesh->textures = textures;
   mesh->textures_size = textures_size;
+  size_t bound = _bound_textures(mesh);
+  if (bound > MESH_PACK_UNIT)
+  {
+    fprintf(stderr, "Mesh has %zu textures to bind, the %zu past unit %d are dropped\n", bound, bound - MESH_PACK_UNIT, MESH_PACK_UNIT - 1);
+  }
+  mesh->meshlets = meshlets;
+  mesh->meshlets_size = meshlets_size;
+  mesh->segments = NULL;
+  mesh->segments_size = 0;
+  mesh->packed = false;
+
+  if (lods != NULL && lods_size > 0)
+  {
+    mesh->lods_size = lods_size < MESH_LOD_MAX ? lods_size : MESH_LOD_MAX;
+    memcpy(mesh->lods, lods, mesh->lods_size * sizeof(mesh_lod_t));
+  }
+  else
+  {
+    mesh->lods_size = 1;
+    mesh->lods[0] = (mesh_lod_t){.first_index = 0, .indices_size = indices_size, .error = 0.f};
+  }
+
+  if (bounds != NULL)
+  {
+    mesh->bounds = *bounds;
+  }
+  else
+  {
+    bounds_from_vertices(vertices, vertices_size, &mesh->bounds);
+  }
 
+  _compute_uv_density(mesh);
+  _build_segments(mesh);
   _setup_mesh(mesh);
 }
 
@@ -66,55 +247,190 @@ void mesh_deinit(mesh_t *mesh)
     return;
   }
 
-  glDeleteBuffers(1, &mesh->ebo);
-  glDeleteBuffers(1, &mesh->vbo);
-  glDeleteVertexArrays(1, &mesh->vao);
+  geometry_buffer_free_vertices(mesh->vertex_range);
+  geometry_buffer_free_indices(mesh->index_range);
+  mesh->vertex_range = mesh->index_range = (geometry_range_t){0};
+  free(mesh->segments);
+  mesh->segments = NULL;
+  mesh->segments_size = 0;
 }
 
-void mesh_draw(mesh_t *mesh, shader_t *shader)
+// packed positions are dequantized in the vertex shader, skinned ones are then
+// moved by the bone buffer of the model
+void mesh_get_gpu_data(mesh_t const *mesh, mesh_gpu_data_t *data)
 {
-  GLuint diffuse_index = 0;
-  GLuint specular_index = 0;
-  GLuint normal_index = 0;
-  GLuint height_index = 0;
+  memset(data, 0, sizeof(mesh_gpu_data_t));
+  glm_vec3_copy((float *)mesh->position_offset, data->position_offset);
+  data->position_offset[3] = (mesh->format & VERTEX_FORMAT_SKINNED) != 0 ? 1.f : 0.f;
+  glm_vec3_copy((float *)mesh->position_scale, data->position_scale);
+  for (size_t i = 0; i < TEXTURE_TYPES_SIZE; i++)
+  {
+    glm_vec4_copy((float *)mesh->regions[i].rect, data->region_rects[i]);
+    data->region_layers[i] = mesh->regions[i].layer;
+  }
+}
 
-  for (size_t i = 0; i < mesh->textures_size; i++)
+mesh_draw_command_t mesh_segment_command(mesh_t const *mesh, mesh_segment_t const *segment, GLuint instances_size, GLuint first_instance)
+{
+  return (mesh_draw_command_t){
+      .count = segment->indices_size,
+      .instance_count = instances_size,
+      .first_index = mesh->first_index + segment->first_index,
+      .base_vertex = mesh->base_vertex + segment->base_vertex,
+      .base_instance = first_instance,
+  };
+}
+
+// sampler handles, resolved again when another program draws.
+// samplers holds material.texture_<type><n> for n up to MESH_TEXTURE_SLOTS,
+// packs the array sampler of every type
+static struct
+{
+  shader_t const *shader;
+  GLuint program;
+  shader_int_t samplers[TEXTURE_TYPES_SIZE][MESH_TEXTURE_SLOTS];
+  shader_int_t packed, packs[TEXTURE_TYPES_SIZE];
+} uniforms;
+
+static void _resolve_uniforms(shader_t const *shader)
+{
+  if (uniforms.shader == shader && uniforms.program == shader->program_id)
   {
-    glActiveTexture(GL_TEXTURE0 + i);
+    return;
+  }
 
-    char const *name;
-    switch (mesh->textures[i].type)
+  uniforms.shader = shader;
+  uniforms.program = shader->program_id;
+  for (size_t i = 0; i < TEXTURE_TYPES_SIZE; i++)
+  {
+    char property_name[100];
+    for (size_t j = 0; j < MESH_TEXTURE_SLOTS; j++)
     {
-    case TEXTURE_DIFFUSE:
-      diffuse_index++;
-      name = "texture_diffuse";
-      break;
-    case TEXTURE_SPECULAR:
-      specular_index++;
-      name = "texture_specular";
-      break;
-    case TEXTURE_NORMAL:
-      normal_index++;
-      name = "texture_normal";
-      break;
-    case TEXTURE_HEIGHT:
-      height_index++;
-      name = "texture_height";
-      break;
-    default:
-      name = "unknown";
-      break;
+      snprintf(property_name, sizeof(property_name), "material.texture_%s%zu", mesh_texture_type_name(i), j + 1);
+      uniforms.samplers[i][j] = shader_resolve_int(shader, property_name);
     }
 
-    char property_name[100];
-    snprintf(property_name, sizeof(property_name), "material.%s%zu", name, i);
-    shader_set_float(shader, property_name, (float)i);
+    snprintf(property_name, sizeof(property_name), "packs.%s", mesh_texture_type_name(i));
+    uniforms.packs[i] = shader_resolve_int(shader, property_name);
+  }
+  uniforms.packed = shader_resolve_int(shader, "packed");
+}
+
+// the nth texture of a type binds to material.texture_<type><n>, counting from 1.
+// textures past MESH_TEXTURE_SLOTS of their type have no sampler and stay unbound,
+// units stop below MESH_PACK_UNIT so that no sampler2D shares one with the packs
+void mesh_bind_textures(mesh_t const *mesh, shader_t *shader)
+{
+  if (mesh->packed)
+  {
+    return;
+  }
+
+  _resolve_uniforms(shader);
+
+  size_t counts[TEXTURE_TYPES_SIZE] = {0};
+  GLint unit = 0;
+  for (size_t i = 0; i < mesh->textures_size && unit < MESH_PACK_UNIT; i++)
+  {
+    enum texture_type type = mesh->textures[i].type;
+    size_t index = type < TEXTURE_TYPES_SIZE ? counts[type]++ : MESH_TEXTURE_SLOTS;
+    if (index >= MESH_TEXTURE_SLOTS)
+    {
+      continue;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    shader_put_int(uniforms.samplers[type][index], unit);
     glBindTexture(GL_TEXTURE_2D, mesh->textures[i].id);
+    unit++;
+  }
+
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void mesh_draw_indirect(mesh_t const *mesh, size_t first_command, size_t commands_size)
+{
+  if (commands_size == 0)
+  {
+    return;
+  }
+
+  geometry_buffer_bind(mesh->format);
+  glMultiDrawElementsIndirect(
+      GL_TRIANGLES, mesh->index_type, (void *)(first_command * sizeof(mesh_draw_command_t)), commands_size, 0);
+}
+
+void mesh_draw_indirect_count(mesh_t const *mesh, size_t first_command, size_t batch, size_t max_commands)
+{
+  if (max_commands == 0)
+  {
+    return;
+  }
+
+  geometry_buffer_bind(mesh->format);
+  glMultiDrawElementsIndirectCount(
+      GL_TRIANGLES, mesh->index_type, (void *)(first_command * sizeof(mesh_draw_command_t)), (GLintptr)(batch * sizeof(GLuint)), max_commands, 0);
+}
+
+size_t mesh_index_size(mesh_t const *mesh)
+{
+  return mesh->index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+// coarsest level whose error stays below screen_error once projected,
+// projected_radius is the bounding sphere radius over half the viewport height
+size_t mesh_select_lod(mesh_t const *mesh, float projected_radius, float screen_error)
+{
+  size_t lod = 0;
+  while (lod + 1 < mesh->lods_size && mesh->lods[lod + 1].error * projected_radius <= screen_error)
+  {
+    lod++;
   }
 
-  glBindVertexArray(mesh->vao);
-  glDrawElements(GL_TRIANGLES, mesh->indices_size, GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+  return lod;
+}
+
+// the whole uv range spans 1 / uv_density model units, which the projected
+// radius turns into pixels
+void mesh_stream_textures(mesh_t const *mesh, float projected_radius, float viewport_height)
+{
+  float screen_size = FLT_MAX;
+  if (mesh->uv_density > 0.f && mesh->bounds.radius > 0.f && projected_radius < FLT_MAX)
+  {
+    screen_size = projected_radius * viewport_height * .5f / (mesh->bounds.radius * mesh->uv_density);
+  }
+
+  for (size_t i = 0; i < mesh->textures_size; i++)
+  {
+    texture_residency_touch(mesh->textures[i].id, screen_size);
+  }
+}
+
+char const *mesh_texture_type_name(enum texture_type type)
+{
+  static char const *const names[TEXTURE_TYPES_SIZE] = {
+      [TEXTURE_DIFFUSE] = "diffuse",
+      [TEXTURE_SPECULAR] = "specular",
+      [TEXTURE_NORMAL] = "normal",
+      [TEXTURE_HEIGHT] = "height",
+  };
+  return type < TEXTURE_TYPES_SIZE ? names[type] : "unknown";
+}
+
+// array samplers always need their own units, a sampler2D on the same unit fails the draw
+void mesh_bind_packs(texture_pack_t const *packs, shader_t *shader)
+{
+  _resolve_uniforms(shader);
+  shader_put_bool(uniforms.packed, packs != NULL);
+  for (size_t i = 0; i < TEXTURE_TYPES_SIZE; i++)
+  {
+    shader_put_int(uniforms.packs[i], MESH_PACK_UNIT + i);
+    if (packs != NULL)
+    {
+      glActiveTexture(GL_TEXTURE0 + MESH_PACK_UNIT + i);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, packs[i].texture);
+    }
+  }
 
   glActiveTexture(GL_TEXTURE0);
 }
@@ -1,14 +1,29 @@
 #if !defined(_MESH_H_)
 #define _MESH_H_
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <glad/gl.h>
 #include <cglm/types.h>
 
+#include "bounds.h"
+#include "geometry_buffer.h"
 #include "shader.h"
+#include "texture_cache.h"
+#include "texture_pack.h"
 
 #define MAX_BONE_INFLUENCE 4
+#define MESH_INSTANCE_LOCATION 7
+#define MESH_ID_LOCATION 11
+// storage buffer of mesh_gpu_data_t the model shaders index by mesh id
+#define MESH_DATA_BINDING 1
+#define MESH_LOD_MAX 4
+// texture arrays bind to consecutive units from here, one per texture type
+#define MESH_PACK_UNIT 8
+// textures of one type past this many have no sampler and are not bound
+#define MESH_TEXTURE_SLOTS 4
 
 typedef struct vertex
 {
@@ -23,23 +38,90 @@ enum texture_type
   TEXTURE_DIFFUSE,
   TEXTURE_SPECULAR,
   TEXTURE_NORMAL,
-  TEXTURE_HEIGHT
+  TEXTURE_HEIGHT,
+  TEXTURE_TYPES_SIZE
 };
 
 typedef struct texture
 {
   GLuint id;
   enum texture_type type;
-  char *path;
+  texture_handle_t handle;
 } texture_t;
 
+// every level is a range of the shared index buffer, level 0 is full detail and
+// error is the simplification error relative to the bounding sphere radius.
+// segments are filled by mesh_init
+typedef struct mesh_lod
+{
+  size_t first_index, indices_size;
+  float error;
+  size_t first_segment, segments_size;
+} mesh_lod_t;
+
+// a run of the index buffer drawn with one base vertex, so that every index
+// of the run fits the mesh index type
+typedef struct mesh_segment
+{
+  size_t first_index, indices_size;
+  GLint base_vertex;
+} mesh_segment_t;
+
+// a cluster of the full detail triangles, culled as a whole by its bounding
+// sphere and the cone that holds the normals of all its triangles
+typedef struct meshlet
+{
+  vec3 center;
+  float radius;
+  vec3 cone_axis;
+  float cone_cutoff;
+  uint32_t first_index, indices_size;
+} meshlet_t;
+
+// std430 layout of one entry of the mesh data buffer, the w of position_offset
+// is 1 for skinned meshes. regions only matter when the model is packed
+typedef struct mesh_gpu_data
+{
+  vec4 position_offset, position_scale;
+  vec4 region_rects[TEXTURE_TYPES_SIZE];
+  GLint region_layers[TEXTURE_TYPES_SIZE];
+} mesh_gpu_data_t;
+
+// layout of DrawElementsIndirectCommand
+typedef struct mesh_draw_command
+{
+  GLuint count, instance_count, first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+} mesh_draw_command_t;
+
+// vertices and indices are NULL once the model dropped its cpu copies,
+// positions is only set when it kept the positions alone.
+// the gpu copies are ranges of the geometry buffer, base_vertex and first_index
+// are where they start counted in vertices and indices of the mesh
 typedef struct mesh
 {
   vertex_t *vertices;
+  vec3 *positions;
   GLuint *indices;
   texture_t *textures;
   size_t vertices_size, indices_size, textures_size;
-  GLuint vao, vbo, ebo;
+  mesh_lod_t lods[MESH_LOD_MAX];
+  size_t lods_size;
+  meshlet_t *meshlets;
+  size_t meshlets_size;
+  bounds_t bounds;
+  float uv_density;
+  bool packed;
+  texture_pack_region_t regions[TEXTURE_TYPES_SIZE];
+  uint32_t format;
+  vec3 position_offset, position_scale;
+  GLenum index_type;
+  mesh_segment_t *segments;
+  size_t segments_size;
+  geometry_range_t vertex_range, index_range;
+  GLint base_vertex;
+  GLuint first_index;
 } mesh_t;
 
 void mesh_init(
@@ -47,10 +129,36 @@ void mesh_init(
     size_t vertices_size,
     GLuint *indices,
     size_t indices_size,
+    mesh_lod_t const *lods,
+    size_t lods_size,
+    meshlet_t *meshlets,
+    size_t meshlets_size,
+    bounds_t const *bounds,
     texture_t *textures,
     size_t textures_size,
     mesh_t *mesh);
 void mesh_deinit(mesh_t *mesh);
-void mesh_draw(mesh_t *mesh, shader_t *shader);
+void mesh_get_gpu_data(mesh_t const *mesh, mesh_gpu_data_t *data);
+
+// commands of one segment of a level, in the shared buffers
+mesh_draw_command_t mesh_segment_command(mesh_t const *mesh, mesh_segment_t const *segment, GLuint instances_size, GLuint first_instance);
+
+// binds the textures of an unpacked mesh, a packed one has nothing of its own
+void mesh_bind_textures(mesh_t const *mesh, shader_t *shader);
+
+// draws commands from the bound GL_DRAW_INDIRECT_BUFFER, every one of them for
+// a mesh of the same format and index type as mesh
+void mesh_draw_indirect(mesh_t const *mesh, size_t first_command, size_t commands_size);
+
+// the same with the number of commands read from the bound GL_PARAMETER_BUFFER
+// at batch, never more than max_commands
+void mesh_draw_indirect_count(mesh_t const *mesh, size_t first_command, size_t batch, size_t max_commands);
+size_t mesh_index_size(mesh_t const *mesh);
+size_t mesh_select_lod(mesh_t const *mesh, float projected_radius, float screen_error);
+void mesh_stream_textures(mesh_t const *mesh, float projected_radius, float viewport_height);
+char const *mesh_texture_type_name(enum texture_type type);
+
+// binds one texture array per type, NULL only points the array samplers at their units
+void mesh_bind_packs(texture_pack_t const *packs, shader_t *shader);
 
 #endif // _MESH_H_
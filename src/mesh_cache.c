@@ -0,0 +1,426 @@
+#include "mesh_cache.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "model.h"
+
+#define SECTION_ALIGNMENT 16
+
+static uint64_t _align(uint64_t offset)
+{
+  return (offset + SECTION_ALIGNMENT - 1) & ~(uint64_t)(SECTION_ALIGNMENT - 1);
+}
+
+static void const *_section(fs_mapping_t const *mapping, mesh_cache_section_t const *section, size_t stride)
+{
+  if (section->offset % SECTION_ALIGNMENT != 0 ||
+      section->offset > mapping->size ||
+      section->count > (mapping->size - section->offset) / stride)
+  {
+    return NULL;
+  }
+
+  return (unsigned char const *)mapping->data + section->offset;
+}
+
+bool mesh_cache_open(
+    char const *cache_path,
+    uint64_t source_hash,
+    uint32_t import_flags,
+    uint64_t pipeline_hash,
+    mesh_cache_t *cache)
+{
+  memset(cache, 0, sizeof(mesh_cache_t));
+
+  fs_mapping_t mapping;
+  if (!fs_map(cache_path, &mapping))
+  {
+    return false;
+  }
+
+  mesh_cache_header_t const *header = mapping.data;
+  if (mapping.size < sizeof(mesh_cache_header_t) ||
+      header->magic != MESH_CACHE_MAGIC ||
+      header->version != MESH_CACHE_VERSION ||
+      header->source_hash != source_hash ||
+      header->import_flags != import_flags ||
+      header->pipeline_hash != pipeline_hash ||
+      header->vertex_stride != sizeof(vertex_t))
+  {
+    fs_unmap(&mapping);
+    return false;
+  }
+
+  cache->mapping = mapping;
+  cache->header = header;
+  cache->nodes = _section(&mapping, &header->nodes, sizeof(mesh_cache_node_t));
+  cache->instances = _section(&mapping, &header->instances, sizeof(mesh_cache_instance_t));
+  cache->meshes = _section(&mapping, &header->meshes, sizeof(mesh_cache_mesh_t));
+  cache->textures = _section(&mapping, &header->textures, sizeof(mesh_cache_texture_t));
+  cache->strings = _section(&mapping, &header->strings, sizeof(char));
+  cache->vertices = _section(&mapping, &header->vertices, sizeof(vertex_t));
+  cache->indices = _section(&mapping, &header->indices, sizeof(GLuint));
+  cache->meshlets = _section(&mapping, &header->meshlets, sizeof(meshlet_t));
+  cache->embedded = _section(&mapping, &header->embedded, sizeof(unsigned char));
+  cache->bones = _section(&mapping, &header->bones, sizeof(mesh_cache_bone_t));
+  cache->clips = _section(&mapping, &header->clips, sizeof(mesh_cache_clip_t));
+  cache->palettes = _section(&mapping, &header->palettes, sizeof(mat4));
+
+  bool valid = cache->nodes != NULL && cache->instances != NULL && cache->meshes != NULL && cache->textures != NULL &&
+               cache->strings != NULL && cache->vertices != NULL && cache->indices != NULL && cache->meshlets != NULL &&
+               cache->embedded != NULL && cache->bones != NULL && cache->clips != NULL && cache->palettes != NULL;
+
+  for (uint64_t i = 0; valid && i < header->nodes.count; i++)
+  {
+    valid = cache->nodes[i].parent >= SCENE_GRAPH_NO_PARENT && cache->nodes[i].parent < (int32_t)i;
+  }
+
+  for (uint64_t i = 0; valid && i < header->meshes.count; i++)
+  {
+    mesh_cache_mesh_t const *mesh = &cache->meshes[i];
+    valid = mesh->first_vertex + mesh->vertices_size <= header->vertices.count &&
+            mesh->first_index + mesh->indices_size <= header->indices.count &&
+            (uint64_t)mesh->first_texture + mesh->textures_size <= header->textures.count &&
+            mesh->lods_size > 0 && mesh->lods_size <= MESH_LOD_MAX &&
+            mesh->first_meshlet + mesh->meshlets_size <= header->meshlets.count;
+
+    for (uint32_t j = 0; valid && j < mesh->lods_size; j++)
+    {
+      valid = mesh->lods[j].first_index + mesh->lods[j].indices_size <= mesh->indices_size;
+    }
+
+    for (uint64_t j = 0; valid && j < mesh->meshlets_size; j++)
+    {
+      meshlet_t const *meshlet = &cache->meshlets[mesh->first_meshlet + j];
+      valid = (uint64_t)meshlet->first_index + meshlet->indices_size <= mesh->lods[0].indices_size;
+    }
+  }
+
+  for (uint64_t i = 0; valid && i < header->instances.count; i++)
+  {
+    valid = cache->instances[i].mesh < header->meshes.count && cache->instances[i].node < header->nodes.count;
+  }
+
+  for (uint64_t i = 0; valid && i < header->textures.count; i++)
+  {
+    mesh_cache_texture_t const *texture = &cache->textures[i];
+    valid = texture->path_offset < header->strings.count &&
+            texture->data_offset <= header->embedded.count && texture->data_size <= header->embedded.count - texture->data_offset;
+  }
+
+  for (uint64_t i = 0; valid && i < header->bones.count; i++)
+  {
+    valid = cache->bones[i].node < header->nodes.count;
+  }
+
+  for (uint64_t i = 0; valid && i < header->clips.count; i++)
+  {
+    mesh_cache_clip_t const *clip = &cache->clips[i];
+    valid = clip->name_offset < header->strings.count && clip->frames_size > 0 &&
+            clip->first_palette <= header->palettes.count &&
+            clip->frames_size <= (header->palettes.count - clip->first_palette) / (header->bones.count ? header->bones.count : 1);
+  }
+
+  // the skinning back ends index palettes with these
+  for (uint64_t i = 0; valid && i < header->vertices.count; i++)
+  {
+    for (size_t j = 0; valid && j < MAX_BONE_INFLUENCE; j++)
+    {
+      int bone = cache->vertices[i].bone_ids[j];
+      valid = cache->vertices[i].weights[j] <= 0.f || (bone >= 0 && (uint64_t)bone < header->bones.count);
+    }
+  }
+
+  if (!valid || (header->strings.count > 0 && cache->strings[header->strings.count - 1] != 0))
+  {
+    fprintf(stderr, "Corrupted mesh cache %s\n", cache_path);
+    mesh_cache_close(cache);
+    return false;
+  }
+
+  return true;
+}
+
+void mesh_cache_close(mesh_cache_t *cache)
+{
+  if (cache == NULL)
+  {
+    return;
+  }
+
+  fs_unmap(&cache->mapping);
+  memset(cache, 0, sizeof(mesh_cache_t));
+}
+
+static void _place_section(mesh_cache_section_t *section, uint64_t count, size_t stride, uint64_t *offset)
+{
+  section->offset = _align(*offset);
+  section->count = count;
+  *offset = section->offset + count * stride;
+}
+
+static bool _write_section(FILE *file, mesh_cache_section_t const *section, uint64_t *offset)
+{
+  static unsigned char const zeros[SECTION_ALIGNMENT] = {0};
+  size_t padding = section->offset - *offset;
+  *offset = section->offset;
+  return fwrite(zeros, 1, padding, file) == padding;
+}
+
+static bool _write_array(FILE *file, void const *data, size_t stride, size_t count, uint64_t *offset)
+{
+  *offset += stride * count;
+  return fwrite(data, stride, count, file) == count;
+}
+
+// texture paths are stored relative to the model so the cache survives moving both
+static char const *_texture_path(char const *directory, texture_t const *texture)
+{
+  return fs_relative_path(directory, texture_cache_path(texture->handle));
+}
+
+// an embedded texture used by several meshes is stored once
+static uint64_t _embedded_offset(
+    mesh_cache_texture_t const *textures, texture_source_t const *sources, size_t index, uint64_t *embedded_size)
+{
+  for (size_t i = 0; i < index; i++)
+  {
+    if (textures[i].data_size > 0 && sources[i].data == sources[index].data)
+    {
+      return textures[i].data_offset;
+    }
+  }
+
+  uint64_t offset = *embedded_size;
+  *embedded_size += sources[index].size;
+  return offset;
+}
+
+bool mesh_cache_write(
+    char const *cache_path,
+    uint64_t source_hash,
+    uint32_t import_flags,
+    uint64_t pipeline_hash,
+    char const *directory,
+    struct model const *model)
+{
+  mesh_t const *meshes = model->meshes;
+  size_t meshes_size = model->meshes_size;
+  scene_graph_t const *graph = &model->graph;
+
+  mesh_cache_node_t *nodes = calloc(graph->nodes_size, sizeof(mesh_cache_node_t));
+  mesh_cache_mesh_t *records = calloc(meshes_size, sizeof(mesh_cache_mesh_t));
+  assert((graph->nodes_size == 0 || nodes != NULL) && (meshes_size == 0 || records != NULL));
+
+  for (size_t i = 0; i < graph->nodes_size; i++)
+  {
+    nodes[i].parent = graph->parents[i];
+    memcpy(nodes[i].transform, graph->locals[i], sizeof(nodes[i].transform));
+  }
+
+  uint64_t vertices_size = 0, indices_size = 0, textures_size = 0, strings_size = 0, meshlets_size = 0;
+  for (size_t i = 0; i < meshes_size; i++)
+  {
+    mesh_t const *mesh = &meshes[i];
+    records[i] = (mesh_cache_mesh_t){
+        .first_vertex = vertices_size,
+        .vertices_size = mesh->vertices_size,
+        .first_index = indices_size,
+        .indices_size = mesh->indices_size,
+        .first_texture = textures_size,
+        .textures_size = mesh->textures_size,
+        .lods_size = mesh->lods_size,
+        .first_meshlet = meshlets_size,
+        .meshlets_size = mesh->meshlets_size,
+        .bounds = mesh->bounds,
+    };
+    for (size_t j = 0; j < mesh->lods_size; j++)
+    {
+      records[i].lods[j] = (mesh_cache_lod_t){
+          .first_index = mesh->lods[j].first_index,
+          .indices_size = mesh->lods[j].indices_size,
+          .error = mesh->lods[j].error,
+      };
+    }
+    vertices_size += mesh->vertices_size;
+    indices_size += mesh->indices_size;
+    textures_size += mesh->textures_size;
+    meshlets_size += mesh->meshlets_size;
+
+    for (size_t j = 0; j < mesh->textures_size; j++)
+    {
+      strings_size += strlen(_texture_path(directory, &mesh->textures[j])) + 1;
+    }
+  }
+
+  uint64_t palettes_size = 0;
+  for (size_t i = 0; i < model->clips_size; i++)
+  {
+    strings_size += strlen(model->clips[i].name) + 1;
+    palettes_size += model->clips[i].frames_size * model->bones_size;
+  }
+
+  mesh_cache_texture_t *textures = calloc(textures_size, sizeof(mesh_cache_texture_t));
+  texture_source_t *sources = calloc(textures_size, sizeof(texture_source_t));
+  char *strings = malloc(strings_size);
+  assert((textures_size == 0 || (textures != NULL && sources != NULL)) && (strings_size == 0 || strings != NULL));
+
+  size_t texture_index = 0, path_offset = 0;
+  uint64_t embedded_size = 0;
+  for (size_t i = 0; i < meshes_size; i++)
+  {
+    for (size_t j = 0; j < meshes[i].textures_size; j++)
+    {
+      texture_t const *texture = &meshes[i].textures[j];
+      char const *path = _texture_path(directory, texture);
+      size_t path_size = strlen(path) + 1;
+      mesh_cache_texture_t *record = &textures[texture_index];
+      *record = (mesh_cache_texture_t){.type = texture->type, .path_offset = path_offset};
+      memcpy(&strings[path_offset], path, path_size);
+      path_offset += path_size;
+
+      texture_source_t *source = &sources[texture_index++];
+      if (texture_cache_source(texture->handle, source) && source->data != NULL)
+      {
+        record->width = source->width;
+        record->height = source->height;
+        record->data_offset = _embedded_offset(textures, sources, texture_index - 1, &embedded_size);
+        record->data_size = source->size;
+      }
+    }
+  }
+
+  mesh_cache_bone_t *bones = calloc(model->bones_size, sizeof(mesh_cache_bone_t));
+  mesh_cache_clip_t *clips = calloc(model->clips_size, sizeof(mesh_cache_clip_t));
+  assert((model->bones_size == 0 || bones != NULL) && (model->clips_size == 0 || clips != NULL));
+  for (size_t i = 0; i < model->bones_size; i++)
+  {
+    bones[i].node = model->bones[i].node;
+    memcpy(bones[i].offset, model->bones[i].offset, sizeof(bones[i].offset));
+  }
+
+  uint64_t first_palette = 0;
+  for (size_t i = 0; i < model->clips_size; i++)
+  {
+    animation_clip_t const *clip = &model->clips[i];
+    size_t name_size = strlen(clip->name) + 1;
+    clips[i] = (mesh_cache_clip_t){
+        .name_offset = path_offset,
+        .duration = clip->duration,
+        .frame_rate = clip->frame_rate,
+        .first_palette = first_palette,
+        .frames_size = clip->frames_size,
+    };
+    memcpy(&strings[path_offset], clip->name, name_size);
+    path_offset += name_size;
+    first_palette += clip->frames_size * model->bones_size;
+  }
+
+  mesh_cache_header_t header = {
+      .magic = MESH_CACHE_MAGIC,
+      .version = MESH_CACHE_VERSION,
+      .source_hash = source_hash,
+      .import_flags = import_flags,
+      .pipeline_hash = pipeline_hash,
+      .vertex_stride = sizeof(vertex_t),
+      .bounds = model->bounds,
+  };
+
+  uint64_t offset = sizeof(mesh_cache_header_t);
+  _place_section(&header.nodes, graph->nodes_size, sizeof(mesh_cache_node_t), &offset);
+  _place_section(&header.instances, model->instances_size, sizeof(mesh_cache_instance_t), &offset);
+  _place_section(&header.meshes, meshes_size, sizeof(mesh_cache_mesh_t), &offset);
+  _place_section(&header.textures, textures_size, sizeof(mesh_cache_texture_t), &offset);
+  _place_section(&header.strings, strings_size, sizeof(char), &offset);
+  _place_section(&header.vertices, vertices_size, sizeof(vertex_t), &offset);
+  _place_section(&header.indices, indices_size, sizeof(GLuint), &offset);
+  _place_section(&header.meshlets, meshlets_size, sizeof(meshlet_t), &offset);
+  _place_section(&header.embedded, embedded_size, sizeof(unsigned char), &offset);
+  _place_section(&header.bones, model->bones_size, sizeof(mesh_cache_bone_t), &offset);
+  _place_section(&header.clips, model->clips_size, sizeof(mesh_cache_clip_t), &offset);
+  _place_section(&header.palettes, palettes_size, sizeof(mat4), &offset);
+
+  size_t tmp_path_size = strlen(cache_path) + sizeof(".tmp");
+  char *tmp_path = malloc(tmp_path_size);
+  assert(tmp_path != NULL);
+  snprintf(tmp_path, tmp_path_size, "%s.tmp", cache_path);
+
+  bool ok = false;
+  FILE *file = fopen(tmp_path, "wb");
+  if (file)
+  {
+    offset = 0;
+    ok = _write_array(file, &header, sizeof(header), 1, &offset);
+    ok = ok && _write_section(file, &header.nodes, &offset) &&
+         _write_array(file, nodes, sizeof(mesh_cache_node_t), graph->nodes_size, &offset);
+    ok = ok && _write_section(file, &header.instances, &offset) &&
+         _write_array(file, model->instances, sizeof(mesh_cache_instance_t), model->instances_size, &offset);
+    ok = ok && _write_section(file, &header.meshes, &offset) &&
+         _write_array(file, records, sizeof(mesh_cache_mesh_t), meshes_size, &offset);
+    ok = ok && _write_section(file, &header.textures, &offset) &&
+         _write_array(file, textures, sizeof(mesh_cache_texture_t), textures_size, &offset);
+    ok = ok && _write_section(file, &header.strings, &offset) &&
+         _write_array(file, strings, sizeof(char), strings_size, &offset);
+
+    ok = ok && _write_section(file, &header.vertices, &offset);
+    for (size_t i = 0; ok && i < meshes_size; i++)
+    {
+      ok = _write_array(file, meshes[i].vertices, sizeof(vertex_t), meshes[i].vertices_size, &offset);
+    }
+
+    ok = ok && _write_section(file, &header.indices, &offset);
+    for (size_t i = 0; ok && i < meshes_size; i++)
+    {
+      ok = _write_array(file, meshes[i].indices, sizeof(GLuint), meshes[i].indices_size, &offset);
+    }
+
+    ok = ok && _write_section(file, &header.meshlets, &offset);
+    for (size_t i = 0; ok && i < meshes_size; i++)
+    {
+      ok = _write_array(file, meshes[i].meshlets, sizeof(meshlet_t), meshes[i].meshlets_size, &offset);
+    }
+
+    // shared embedded textures point at the bytes of their first use
+    ok = ok && _write_section(file, &header.embedded, &offset);
+    for (size_t i = 0; ok && i < textures_size; i++)
+    {
+      if (textures[i].data_size > 0 && textures[i].data_offset == offset - header.embedded.offset)
+      {
+        ok = _write_array(file, sources[i].data, sizeof(unsigned char), sources[i].size, &offset);
+      }
+    }
+
+    ok = ok && _write_section(file, &header.bones, &offset) &&
+         _write_array(file, bones, sizeof(mesh_cache_bone_t), model->bones_size, &offset);
+    ok = ok && _write_section(file, &header.clips, &offset) &&
+         _write_array(file, clips, sizeof(mesh_cache_clip_t), model->clips_size, &offset);
+
+    ok = ok && _write_section(file, &header.palettes, &offset);
+    for (size_t i = 0; ok && i < model->clips_size; i++)
+    {
+      ok = _write_array(file, model->clips[i].palettes, sizeof(mat4), model->clips[i].frames_size * model->bones_size, &offset);
+    }
+
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(tmp_path, cache_path) == 0;
+  }
+
+  if (!ok)
+  {
+    perror("Cannot write mesh cache");
+    remove(tmp_path);
+  }
+
+  free(tmp_path);
+  free(clips);
+  free(bones);
+  free(strings);
+  free(sources);
+  free(textures);
+  free(records);
+  free(nodes);
+  return ok;
+}
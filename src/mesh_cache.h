@@ -0,0 +1,121 @@
+#if !defined(_MESH_CACHE_H_)
+#define _MESH_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bounds.h"
+#include "fs.h"
+#include "mesh.h"
+
+struct model;
+
+#define MESH_CACHE_MAGIC 0x4348534du // "MSHC"
+#define MESH_CACHE_VERSION 10
+#define MESH_CACHE_EXTENSION ".meshcache"
+
+typedef struct mesh_cache_section
+{
+  uint64_t offset, count;
+} mesh_cache_section_t;
+
+typedef struct mesh_cache_header
+{
+  uint32_t magic, version;
+  uint64_t source_hash;
+  uint32_t import_flags, vertex_stride;
+  uint64_t pipeline_hash;
+  mesh_cache_section_t nodes, instances, meshes, textures, strings, vertices, indices, meshlets, embedded;
+  mesh_cache_section_t bones, clips, palettes;
+  bounds_t bounds;
+} mesh_cache_header_t;
+
+// a texture embedded in the model keeps its bytes in the embedded section,
+// data_size is 0 for one read from its path
+typedef struct mesh_cache_texture
+{
+  uint32_t type, path_offset;
+  uint32_t width, height;
+  uint64_t data_offset, data_size;
+} mesh_cache_texture_t;
+
+typedef struct mesh_cache_node
+{
+  int32_t parent;
+  float transform[16];
+} mesh_cache_node_t;
+
+// lod ranges are relative to the first index of their mesh
+typedef struct mesh_cache_lod
+{
+  uint64_t first_index, indices_size;
+  float error;
+  uint32_t reserved;
+} mesh_cache_lod_t;
+
+typedef struct mesh_cache_mesh
+{
+  uint64_t first_vertex, vertices_size;
+  uint64_t first_index, indices_size;
+  uint32_t first_texture, textures_size;
+  uint32_t lods_size, reserved;
+  mesh_cache_lod_t lods[MESH_LOD_MAX];
+  uint64_t first_meshlet, meshlets_size;
+  bounds_t bounds;
+} mesh_cache_mesh_t;
+
+typedef struct mesh_cache_bone
+{
+  uint32_t node, reserved;
+  float offset[16];
+} mesh_cache_bone_t;
+
+// a clip owns frames_size palettes of every bone from first_palette on,
+// its name sits in the strings section
+typedef struct mesh_cache_clip
+{
+  uint32_t name_offset, reserved;
+  float duration, frame_rate;
+  uint64_t first_palette, frames_size;
+} mesh_cache_clip_t;
+
+typedef struct mesh_cache_instance
+{
+  uint32_t mesh, node;
+} mesh_cache_instance_t;
+
+typedef struct mesh_cache
+{
+  fs_mapping_t mapping;
+  mesh_cache_header_t const *header;
+  mesh_cache_node_t const *nodes;
+  mesh_cache_instance_t const *instances;
+  mesh_cache_mesh_t const *meshes;
+  mesh_cache_texture_t const *textures;
+  char const *strings;
+  vertex_t const *vertices;
+  GLuint const *indices;
+  meshlet_t const *meshlets;
+  unsigned char const *embedded;
+  mesh_cache_bone_t const *bones;
+  mesh_cache_clip_t const *clips;
+  mat4 const *palettes;
+} mesh_cache_t;
+
+bool mesh_cache_open(
+    char const *cache_path,
+    uint64_t source_hash,
+    uint32_t import_flags,
+    uint64_t pipeline_hash,
+    mesh_cache_t *cache);
+void mesh_cache_close(mesh_cache_t *cache);
+bool mesh_cache_write(
+    char const *cache_path,
+    uint64_t source_hash,
+    uint32_t import_flags,
+    uint64_t pipeline_hash,
+    char const *directory,
+    struct model const *model);
+
+#endif // _MESH_CACHE_H_
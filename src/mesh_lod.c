@@ -0,0 +1,317 @@
+#include "mesh_lod.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cglm/cglm.h>
+
+typedef struct quadric
+{
+  double a00, a01, a02, a11, a12, a22;
+  double b0, b1, b2, c, weight;
+} quadric_t;
+
+typedef struct collapse
+{
+  GLuint from, to;
+  double error;
+} collapse_t;
+
+static void _quadric_add(quadric_t *dest, quadric_t const *src)
+{
+  dest->a00 += src->a00, dest->a01 += src->a01, dest->a02 += src->a02;
+  dest->a11 += src->a11, dest->a12 += src->a12, dest->a22 += src->a22;
+  dest->b0 += src->b0, dest->b1 += src->b1, dest->b2 += src->b2;
+  dest->c += src->c, dest->weight += src->weight;
+}
+
+// squared distance to the accumulated planes, averaged by their area
+static double _quadric_error(quadric_t const *q, float const *p)
+{
+  double x = p[0], y = p[1], z = p[2];
+  double error = q->a00 * x * x + q->a11 * y * y + q->a22 * z * z +
+                 2. * (q->a01 * x * y + q->a02 * x * z + q->a12 * y * z) +
+                 2. * (q->b0 * x + q->b1 * y + q->b2 * z) + q->c;
+  return q->weight > 0. ? fabs(error) / q->weight : 0.;
+}
+
+static void _triangle_normal(float const *a, float const *b, float const *c, vec3 normal)
+{
+  vec3 ab, ac;
+  glm_vec3_sub((float *)b, (float *)a, ab);
+  glm_vec3_sub((float *)c, (float *)a, ac);
+  glm_vec3_cross(ab, ac, normal);
+}
+
+static void _compute_quadrics(quadric_t *quadrics, GLuint const *indices, size_t indices_size, vertex_t const *vertices)
+{
+  for (size_t i = 0; i < indices_size; i += 3)
+  {
+    float const *a = vertices[indices[i]].position;
+    vec3 n;
+    _triangle_normal(a, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position, n);
+    float area = glm_vec3_norm(n);
+    if (area <= 0.f)
+    {
+      continue;
+    }
+
+    glm_vec3_scale(n, 1.f / area, n);
+    double d = -(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]);
+    quadric_t q = {
+        .a00 = area * n[0] * n[0], .a01 = area * n[0] * n[1], .a02 = area * n[0] * n[2],
+        .a11 = area * n[1] * n[1], .a12 = area * n[1] * n[2], .a22 = area * n[2] * n[2],
+        .b0 = area * n[0] * d, .b1 = area * n[1] * d, .b2 = area * n[2] * d,
+        .c = area * d * d, .weight = area,
+    };
+
+    for (size_t j = 0; j < 3; j++)
+    {
+      _quadric_add(&quadrics[indices[i + j]], &q);
+    }
+  }
+}
+
+static int _compare_edges(void const *a, void const *b)
+{
+  uint64_t left = *(uint64_t const *)a, right = *(uint64_t const *)b;
+  return (left > right) - (left < right);
+}
+
+// an edge that is not shared by exactly two triangles is a border, a uv seam or non manifold
+static void _lock_borders(bool *locked, GLuint const *indices, size_t indices_size)
+{
+  uint64_t *edges = malloc(indices_size * sizeof(uint64_t));
+  assert(indices_size == 0 || edges != NULL);
+
+  for (size_t i = 0; i < indices_size; i++)
+  {
+    GLuint a = indices[i], b = indices[i % 3 == 2 ? i - 2 : i + 1];
+    edges[i] = a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+  }
+
+  qsort(edges, indices_size, sizeof(uint64_t), _compare_edges);
+  for (size_t i = 0; i < indices_size;)
+  {
+    size_t run = 1;
+    while (i + run < indices_size && edges[i + run] == edges[i])
+    {
+      run++;
+    }
+
+    if (run != 2)
+    {
+      locked[edges[i] >> 32] = true;
+      locked[edges[i] & UINT32_MAX] = true;
+    }
+    i += run;
+  }
+
+  free(edges);
+}
+
+static float _mesh_radius(GLuint const *indices, size_t indices_size, vertex_t const *vertices)
+{
+  vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX}, max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (size_t i = 0; i < indices_size; i++)
+  {
+    glm_vec3_minv(min, (float *)vertices[indices[i]].position, min);
+    glm_vec3_maxv(max, (float *)vertices[indices[i]].position, max);
+  }
+
+  vec3 center;
+  glm_vec3_center(min, max, center);
+  float radius = 0.f;
+  for (size_t i = 0; i < indices_size; i++)
+  {
+    radius = glm_max(radius, glm_vec3_distance(center, (float *)vertices[indices[i]].position));
+  }
+
+  return radius;
+}
+
+static int _compare_collapses(void const *a, void const *b)
+{
+  double left = ((collapse_t const *)a)->error, right = ((collapse_t const *)b)->error;
+  return (left > right) - (left < right);
+}
+
+// moving from onto to must not turn any remaining triangle around from upside down
+static bool _flips(
+    GLuint from,
+    GLuint to,
+    GLuint const *indices,
+    GLuint const *remap,
+    size_t const *first,
+    GLuint const *adjacency,
+    vertex_t const *vertices)
+{
+  for (size_t i = first[from]; i < first[from + 1]; i++)
+  {
+    GLuint const *triangle = &indices[adjacency[i] * 3];
+    GLuint corners[3] = {remap[triangle[0]], remap[triangle[1]], remap[triangle[2]]};
+    if (corners[0] == to || corners[1] == to || corners[2] == to ||
+        corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2])
+    {
+      continue;
+    }
+
+    vec3 before, after;
+    _triangle_normal(vertices[corners[0]].position, vertices[corners[1]].position, vertices[corners[2]].position, before);
+    for (size_t j = 0; j < 3; j++)
+    {
+      corners[j] = corners[j] == from ? to : corners[j];
+    }
+    _triangle_normal(vertices[corners[0]].position, vertices[corners[1]].position, vertices[corners[2]].position, after);
+
+    if (glm_vec3_dot(before, after) <= 0.f)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void _build_adjacency(size_t *first, GLuint *adjacency, GLuint const *indices, size_t indices_size, size_t vertices_size)
+{
+  memset(first, 0, (vertices_size + 1) * sizeof(size_t));
+  for (size_t i = 0; i < indices_size; i++)
+  {
+    first[indices[i] + 1]++;
+  }
+
+  for (size_t i = 0; i < vertices_size; i++)
+  {
+    first[i + 1] += first[i];
+  }
+
+  for (size_t i = 0; i < indices_size; i++)
+  {
+    adjacency[first[indices[i]]++] = i / 3;
+  }
+
+  // filling advanced every start to the next one
+  memmove(&first[1], first, vertices_size * sizeof(size_t));
+  first[0] = 0;
+}
+
+size_t mesh_lod_simplify(
+    GLuint *dest,
+    GLuint const *indices,
+    size_t indices_size,
+    vertex_t const *vertices,
+    size_t vertices_size,
+    size_t target_indices,
+    float target_error,
+    float *result_error)
+{
+  memcpy(dest, indices, indices_size * sizeof(GLuint));
+  *result_error = 0.f;
+
+  float radius = _mesh_radius(indices, indices_size, vertices);
+  double error_limit = (double)target_error * radius * target_error * radius;
+
+  quadric_t *quadrics = calloc(vertices_size, sizeof(quadric_t));
+  bool *locked = calloc(vertices_size, sizeof(bool));
+  bool *touched = malloc(vertices_size * sizeof(bool));
+  GLuint *remap = malloc(vertices_size * sizeof(GLuint));
+  size_t *first = malloc((vertices_size + 1) * sizeof(size_t));
+  GLuint *adjacency = malloc(indices_size * sizeof(GLuint));
+  collapse_t *collapses = malloc(indices_size * sizeof(collapse_t));
+  assert(vertices_size == 0 || (quadrics != NULL && locked != NULL && touched != NULL && remap != NULL));
+  assert(first != NULL && (indices_size == 0 || (adjacency != NULL && collapses != NULL)));
+
+  _compute_quadrics(quadrics, indices, indices_size, vertices);
+  _lock_borders(locked, indices, indices_size);
+
+  double max_error = 0.;
+  while (indices_size > target_indices)
+  {
+    _build_adjacency(first, adjacency, dest, indices_size, vertices_size);
+
+    // every interior edge is seen twice, keep the copy going from the lower index
+    size_t collapses_size = 0;
+    for (size_t i = 0; i < indices_size; i++)
+    {
+      GLuint a = dest[i], b = dest[i % 3 == 2 ? i - 2 : i + 1];
+      if (a > b || (locked[a] && locked[b]))
+      {
+        continue;
+      }
+
+      quadric_t q = quadrics[a];
+      _quadric_add(&q, &quadrics[b]);
+      double onto_b = locked[a] ? DBL_MAX : _quadric_error(&q, vertices[b].position);
+      double onto_a = locked[b] ? DBL_MAX : _quadric_error(&q, vertices[a].position);
+      collapses[collapses_size++] = onto_b <= onto_a ? (collapse_t){.from = a, .to = b, .error = onto_b}
+                                                     : (collapse_t){.from = b, .to = a, .error = onto_a};
+    }
+
+    qsort(collapses, collapses_size, sizeof(collapse_t), _compare_collapses);
+
+    for (size_t i = 0; i < vertices_size; i++)
+    {
+      remap[i] = i;
+      touched[i] = false;
+    }
+
+    // each collapse removes about two triangles, stop the pass once the target is in reach
+    size_t limit = (indices_size - target_indices) / 6 + 1, applied = 0;
+    for (size_t i = 0; i < collapses_size && applied < limit; i++)
+    {
+      collapse_t const *collapse = &collapses[i];
+      if (collapse->error > error_limit)
+      {
+        break;
+      }
+
+      if (touched[collapse->from] || touched[collapse->to] ||
+          _flips(collapse->from, collapse->to, dest, remap, first, adjacency, vertices))
+      {
+        continue;
+      }
+
+      remap[collapse->from] = collapse->to;
+      _quadric_add(&quadrics[collapse->to], &quadrics[collapse->from]);
+      touched[collapse->from] = touched[collapse->to] = true;
+      max_error = collapse->error > max_error ? collapse->error : max_error;
+      applied++;
+    }
+
+    if (applied == 0)
+    {
+      break;
+    }
+
+    size_t written = 0;
+    for (size_t i = 0; i < indices_size; i += 3)
+    {
+      GLuint a = remap[dest[i]], b = remap[dest[i + 1]], c = remap[dest[i + 2]];
+      if (a != b && b != c && a != c)
+      {
+        dest[written++] = a;
+        dest[written++] = b;
+        dest[written++] = c;
+      }
+    }
+    indices_size = written;
+  }
+
+  *result_error = radius > 0.f ? (float)sqrt(max_error) / radius : 0.f;
+
+  free(collapses);
+  free(adjacency);
+  free(first);
+  free(remap);
+  free(touched);
+  free(locked);
+  free(quadrics);
+
+  return indices_size;
+}
@@ -0,0 +1,21 @@
+#if !defined(_MESH_LOD_H_)
+#define _MESH_LOD_H_
+
+#include <stddef.h>
+
+#include "mesh.h"
+
+// quadric error edge collapse onto existing vertices, border and seam vertices
+// stay locked so the result never opens holes. writes the simplified triangles
+// into dest and returns their index count, errors are relative to the mesh radius
+size_t mesh_lod_simplify(
+    GLuint *dest,
+    GLuint const *indices,
+    size_t indices_size,
+    vertex_t const *vertices,
+    size_t vertices_size,
+    size_t target_indices,
+    float target_error,
+    float *result_error);
+
+#endif // _MESH_LOD_H_
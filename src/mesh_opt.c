@@ -0,0 +1,389 @@
+#include "mesh_opt.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cglm/cglm.h>
+
+typedef struct cluster_key
+{
+  size_t start, end;
+  float sort;
+} cluster_key_t;
+
+// fifo cache simulation, a vertex is resident while fewer than cache size
+// vertices were inserted after it
+typedef struct cache_sim
+{
+  size_t *times;
+  size_t now;
+} cache_sim_t;
+
+static void _cache_init(cache_sim_t *cache, size_t vertices_size)
+{
+  cache->times = calloc(vertices_size, sizeof(size_t));
+  assert(vertices_size == 0 || cache->times != NULL);
+  cache->now = MESH_OPT_CACHE_SIZE + 1;
+}
+
+static void _cache_reset(cache_sim_t *cache)
+{
+  cache->now += MESH_OPT_CACHE_SIZE + 1;
+}
+
+static size_t _cache_triangle(cache_sim_t *cache, GLuint const *triangle)
+{
+  size_t misses = 0;
+  for (size_t i = 0; i < 3; i++)
+  {
+    GLuint vertex = triangle[i];
+    if (cache->now - cache->times[vertex] > MESH_OPT_CACHE_SIZE)
+    {
+      cache->times[vertex] = cache->now++;
+      misses++;
+    }
+  }
+
+  return misses;
+}
+
+void mesh_opt_analyze(GLuint const *indices, size_t indices_size, size_t vertices_size, mesh_opt_stats_t *stats)
+{
+  cache_sim_t cache;
+  _cache_init(&cache, vertices_size);
+
+  bool *used = calloc(vertices_size, sizeof(bool));
+  assert(vertices_size == 0 || used != NULL);
+
+  stats->misses = 0;
+  stats->triangles = indices_size / 3;
+  stats->vertices = 0;
+  for (size_t i = 0; i + 2 < indices_size; i += 3)
+  {
+    stats->misses += _cache_triangle(&cache, &indices[i]);
+    for (size_t j = 0; j < 3; j++)
+    {
+      stats->vertices += !used[indices[i + j]];
+      used[indices[i + j]] = true;
+    }
+  }
+
+  free(used);
+  free(cache.times);
+}
+
+static GLuint _skip_dead_end(
+    GLuint const *live,
+    GLuint const *dead_ends,
+    size_t *dead_ends_size,
+    size_t *cursor,
+    size_t vertices_size)
+{
+  while (*dead_ends_size > 0)
+  {
+    GLuint vertex = dead_ends[--(*dead_ends_size)];
+    if (live[vertex] > 0)
+    {
+      return vertex;
+    }
+  }
+
+  for (; *cursor < vertices_size; (*cursor)++)
+  {
+    if (live[*cursor] > 0)
+    {
+      return *cursor;
+    }
+  }
+
+  return UINT32_MAX;
+}
+
+size_t mesh_opt_vertex_cache(
+    GLuint *dest,
+    size_t *clusters,
+    GLuint const *indices,
+    size_t indices_size,
+    size_t vertices_size)
+{
+  size_t triangles_size = indices_size / 3;
+  GLuint *live = calloc(vertices_size, sizeof(GLuint));
+  size_t *first = calloc(vertices_size + 1, sizeof(size_t));
+  GLuint *adjacency = malloc(indices_size * sizeof(GLuint));
+  size_t *times = calloc(vertices_size, sizeof(size_t));
+  GLuint *dead_ends = malloc(indices_size * sizeof(GLuint));
+  bool *emitted = calloc(triangles_size, sizeof(bool));
+  assert(vertices_size == 0 || (live != NULL && first != NULL && times != NULL));
+  assert(indices_size == 0 || (adjacency != NULL && dead_ends != NULL && emitted != NULL));
+
+  for (size_t i = 0; i < indices_size; i++)
+  {
+    live[indices[i]]++;
+  }
+
+  for (size_t i = 0; i < vertices_size; i++)
+  {
+    first[i + 1] = first[i] + live[i];
+  }
+
+  size_t *fill = malloc(vertices_size * sizeof(size_t));
+  assert(vertices_size == 0 || fill != NULL);
+  memcpy(fill, first, vertices_size * sizeof(size_t));
+  for (size_t i = 0; i < indices_size; i++)
+  {
+    adjacency[fill[indices[i]]++] = i / 3;
+  }
+  free(fill);
+
+  size_t now = MESH_OPT_CACHE_SIZE + 1;
+  size_t cursor = 0, dead_ends_size = 0, written = 0, clusters_size = 0;
+  GLuint fanning = _skip_dead_end(live, dead_ends, &dead_ends_size, &cursor, vertices_size);
+  bool hard_boundary = true;
+
+  while (fanning != UINT32_MAX)
+  {
+    if (hard_boundary)
+    {
+      clusters[clusters_size++] = written / 3;
+    }
+
+    size_t candidates_start = dead_ends_size;
+    for (size_t i = first[fanning]; i < first[fanning + 1]; i++)
+    {
+      GLuint triangle = adjacency[i];
+      if (emitted[triangle])
+      {
+        continue;
+      }
+
+      for (size_t j = 0; j < 3; j++)
+      {
+        GLuint vertex = indices[triangle * 3 + j];
+        dest[written++] = vertex;
+        dead_ends[dead_ends_size++] = vertex;
+        live[vertex]--;
+        if (now - times[vertex] > MESH_OPT_CACHE_SIZE)
+        {
+          times[vertex] = now++;
+        }
+      }
+      emitted[triangle] = true;
+    }
+
+    // prefer the candidate that stays longest in the cache while still having triangles left
+    GLuint next = UINT32_MAX;
+    size_t best = 0;
+    for (size_t i = candidates_start; i < dead_ends_size; i++)
+    {
+      GLuint vertex = dead_ends[i];
+      if (live[vertex] == 0)
+      {
+        continue;
+      }
+
+      size_t priority = 0;
+      if (now - times[vertex] + 2 * live[vertex] <= MESH_OPT_CACHE_SIZE)
+      {
+        priority = now - times[vertex];
+      }
+
+      if (next == UINT32_MAX || priority > best)
+      {
+        best = priority;
+        next = vertex;
+      }
+    }
+
+    hard_boundary = next == UINT32_MAX;
+    fanning = hard_boundary ? _skip_dead_end(live, dead_ends, &dead_ends_size, &cursor, vertices_size) : next;
+  }
+
+  free(emitted);
+  free(dead_ends);
+  free(times);
+  free(adjacency);
+  free(first);
+  free(live);
+
+  return clusters_size;
+}
+
+static int _compare_clusters(void const *a, void const *b)
+{
+  float left = ((cluster_key_t const *)a)->sort;
+  float right = ((cluster_key_t const *)b)->sort;
+  return (left < right) - (left > right);
+}
+
+static size_t _soft_boundaries(
+    cluster_key_t *keys,
+    GLuint const *indices,
+    size_t const *clusters,
+    size_t clusters_size,
+    size_t triangles_size,
+    size_t vertices_size,
+    float threshold)
+{
+  cache_sim_t cache;
+  _cache_init(&cache, vertices_size);
+
+  size_t keys_size = 0;
+  for (size_t c = 0; c < clusters_size; c++)
+  {
+    size_t start = clusters[c];
+    size_t end = c + 1 < clusters_size ? clusters[c + 1] : triangles_size;
+
+    _cache_reset(&cache);
+    size_t cluster_misses = 0;
+    for (size_t i = start; i < end; i++)
+    {
+      cluster_misses += _cache_triangle(&cache, &indices[i * 3]);
+    }
+    float cluster_threshold = threshold * (float)cluster_misses / (float)(end - start);
+
+    _cache_reset(&cache);
+    size_t piece_start = start, piece_misses = 0;
+    for (size_t i = start; i < end; i++)
+    {
+      piece_misses += _cache_triangle(&cache, &indices[i * 3]);
+      if (i + 1 < end && (float)piece_misses / (float)(i + 1 - piece_start) <= cluster_threshold)
+      {
+        keys[keys_size++] = (cluster_key_t){.start = piece_start, .end = i + 1};
+        piece_start = i + 1;
+        piece_misses = 0;
+        _cache_reset(&cache);
+      }
+    }
+    keys[keys_size++] = (cluster_key_t){.start = piece_start, .end = end};
+  }
+
+  free(cache.times);
+  return keys_size;
+}
+
+void mesh_opt_overdraw(
+    GLuint *dest,
+    GLuint const *indices,
+    size_t indices_size,
+    size_t const *clusters,
+    size_t clusters_size,
+    vertex_t const *vertices,
+    size_t vertices_size,
+    float threshold)
+{
+  size_t triangles_size = indices_size / 3;
+  cluster_key_t *keys = malloc(triangles_size * sizeof(cluster_key_t));
+  assert(triangles_size == 0 || keys != NULL);
+  size_t keys_size = _soft_boundaries(keys, indices, clusters, clusters_size, triangles_size, vertices_size, threshold);
+
+  vec3 mesh_centroid = GLM_VEC3_ZERO_INIT;
+  float mesh_area = 0.f;
+  vec3 *centroids = malloc(keys_size * sizeof(vec3));
+  vec3 *normals = malloc(keys_size * sizeof(vec3));
+  assert(keys_size == 0 || (centroids != NULL && normals != NULL));
+
+  for (size_t k = 0; k < keys_size; k++)
+  {
+    vec3 centroid = GLM_VEC3_ZERO_INIT, normal = GLM_VEC3_ZERO_INIT;
+    float area = 0.f;
+    for (size_t i = keys[k].start; i < keys[k].end; i++)
+    {
+      float const *a = vertices[indices[i * 3]].position;
+      float const *b = vertices[indices[i * 3 + 1]].position;
+      float const *c = vertices[indices[i * 3 + 2]].position;
+
+      vec3 ab, ac, n;
+      glm_vec3_sub((float *)b, (float *)a, ab);
+      glm_vec3_sub((float *)c, (float *)a, ac);
+      glm_vec3_cross(ab, ac, n);
+      float triangle_area = glm_vec3_norm(n);
+
+      for (size_t j = 0; j < 3; j++)
+      {
+        centroid[j] += (a[j] + b[j] + c[j]) * (triangle_area / 3.f);
+      }
+      glm_vec3_add(normal, n, normal);
+      area += triangle_area;
+    }
+
+    glm_vec3_add(mesh_centroid, centroid, mesh_centroid);
+    mesh_area += area;
+    glm_vec3_scale(centroid, area > 0.f ? 1.f / area : 0.f, centroids[k]);
+    glm_vec3_normalize_to(normal, normals[k]);
+  }
+
+  glm_vec3_scale(mesh_centroid, mesh_area > 0.f ? 1.f / mesh_area : 0.f, mesh_centroid);
+  for (size_t k = 0; k < keys_size; k++)
+  {
+    vec3 offset;
+    glm_vec3_sub(centroids[k], mesh_centroid, offset);
+    keys[k].sort = glm_vec3_dot(offset, normals[k]);
+  }
+
+  qsort(keys, keys_size, sizeof(cluster_key_t), _compare_clusters);
+
+  size_t written = 0;
+  for (size_t k = 0; k < keys_size; k++)
+  {
+    size_t count = (keys[k].end - keys[k].start) * 3;
+    memcpy(&dest[written], &indices[keys[k].start * 3], count * sizeof(GLuint));
+    written += count;
+  }
+
+  free(normals);
+  free(centroids);
+  free(keys);
+}
+
+size_t mesh_opt_vertex_fetch(
+    vertex_t *dest,
+    GLuint *indices,
+    size_t indices_size,
+    vertex_t const *vertices,
+    size_t vertices_size)
+{
+  GLuint *remap = malloc(vertices_size * sizeof(GLuint));
+  assert(vertices_size == 0 || remap != NULL);
+  memset(remap, 0xff, vertices_size * sizeof(GLuint));
+
+  size_t next = 0;
+  for (size_t i = 0; i < indices_size; i++)
+  {
+    GLuint vertex = indices[i];
+    if (remap[vertex] == UINT32_MAX)
+    {
+      remap[vertex] = next;
+      dest[next++] = vertices[vertex];
+    }
+    indices[i] = remap[vertex];
+  }
+
+  free(remap);
+  return next;
+}
+
+void mesh_opt_optimize(vertex_t *vertices, size_t *vertices_size, GLuint *indices, size_t indices_size)
+{
+  if (indices_size < 3 || indices_size % 3 != 0)
+  {
+    return;
+  }
+
+  GLuint *tipsified = malloc(indices_size * sizeof(GLuint));
+  size_t *clusters = malloc(indices_size / 3 * sizeof(size_t));
+  vertex_t *fetched = malloc(*vertices_size * sizeof(vertex_t));
+  assert(tipsified != NULL && clusters != NULL && fetched != NULL);
+
+  size_t clusters_size = mesh_opt_vertex_cache(tipsified, clusters, indices, indices_size, *vertices_size);
+  mesh_opt_overdraw(
+      indices, tipsified, indices_size, clusters, clusters_size, vertices, *vertices_size, MESH_OPT_OVERDRAW_THRESHOLD);
+
+  *vertices_size = mesh_opt_vertex_fetch(fetched, indices, indices_size, vertices, *vertices_size);
+  memcpy(vertices, fetched, *vertices_size * sizeof(vertex_t));
+
+  free(fetched);
+  free(clusters);
+  free(tipsified);
+}
@@ -0,0 +1,52 @@
+#if !defined(_MESH_OPT_H_)
+#define _MESH_OPT_H_
+
+#include <stddef.h>
+
+#include "mesh.h"
+
+#define MESH_OPT_CACHE_SIZE 16
+#define MESH_OPT_OVERDRAW_THRESHOLD 1.05f
+
+typedef struct mesh_opt_stats
+{
+  size_t misses, triangles, vertices;
+} mesh_opt_stats_t;
+
+#define mesh_opt_acmr(stats) ((stats)->triangles ? (float)(stats)->misses / (float)(stats)->triangles : 0.f)
+#define mesh_opt_atvr(stats) ((stats)->vertices ? (float)(stats)->misses / (float)(stats)->vertices : 0.f)
+
+void mesh_opt_analyze(GLuint const *indices, size_t indices_size, size_t vertices_size, mesh_opt_stats_t *stats);
+
+// Tipsify, writes the reordered triangles into dest and the start of every
+// hard cluster into clusters, returns the number of clusters
+size_t mesh_opt_vertex_cache(
+    GLuint *dest,
+    size_t *clusters,
+    GLuint const *indices,
+    size_t indices_size,
+    size_t vertices_size);
+
+// splits the hard clusters where the cache stays efficient enough and sorts
+// the pieces so outward facing ones are drawn first
+void mesh_opt_overdraw(
+    GLuint *dest,
+    GLuint const *indices,
+    size_t indices_size,
+    size_t const *clusters,
+    size_t clusters_size,
+    vertex_t const *vertices,
+    size_t vertices_size,
+    float threshold);
+
+// reorders vertices by first use and drops the unused ones, returns the new vertex count
+size_t mesh_opt_vertex_fetch(
+    vertex_t *dest,
+    GLuint *indices,
+    size_t indices_size,
+    vertex_t const *vertices,
+    size_t vertices_size);
+
+void mesh_opt_optimize(vertex_t *vertices, size_t *vertices_size, GLuint *indices, size_t indices_size);
+
+#endif // _MESH_OPT_H_
@@ -0,0 +1,126 @@
+#include "meshlet.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <cglm/cglm.h>
+
+static void _compute_bounds(meshlet_t *meshlet, GLuint const *indices, vertex_t const *vertices)
+{
+  GLuint const *first = &indices[meshlet->first_index];
+  vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX}, max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (size_t i = 0; i < meshlet->indices_size; i++)
+  {
+    glm_vec3_minv(min, (float *)vertices[first[i]].position, min);
+    glm_vec3_maxv(max, (float *)vertices[first[i]].position, max);
+  }
+
+  glm_vec3_center(min, max, meshlet->center);
+  meshlet->radius = 0.f;
+  for (size_t i = 0; i < meshlet->indices_size; i++)
+  {
+    meshlet->radius = glm_max(meshlet->radius, glm_vec3_distance(meshlet->center, (float *)vertices[first[i]].position));
+  }
+
+  size_t triangles_size = meshlet->indices_size / 3;
+  vec3 *normals = malloc(triangles_size * sizeof(vec3));
+  assert(normals != NULL);
+
+  vec3 axis = GLM_VEC3_ZERO_INIT;
+  for (size_t i = 0; i < triangles_size; i++)
+  {
+    vec3 ab, ac;
+    glm_vec3_sub((float *)vertices[first[i * 3 + 1]].position, (float *)vertices[first[i * 3]].position, ab);
+    glm_vec3_sub((float *)vertices[first[i * 3 + 2]].position, (float *)vertices[first[i * 3]].position, ac);
+    glm_vec3_cross(ab, ac, normals[i]);
+    glm_vec3_normalize(normals[i]);
+    glm_vec3_add(axis, normals[i], axis);
+  }
+  glm_vec3_normalize_to(axis, meshlet->cone_axis);
+
+  float min_dot = 1.f;
+  for (size_t i = 0; i < triangles_size; i++)
+  {
+    if (glm_vec3_norm2(normals[i]) > 0.f)
+    {
+      min_dot = glm_min(min_dot, glm_vec3_dot(normals[i], meshlet->cone_axis));
+    }
+  }
+
+  // a cone wider than a hemisphere can never be entirely backfacing
+  meshlet->cone_cutoff = min_dot <= 0.f ? 1.f : sqrtf(1.f - min_dot * min_dot);
+
+  free(normals);
+}
+
+size_t meshlet_build(
+    meshlet_t *dest,
+    GLuint const *indices,
+    size_t indices_size,
+    vertex_t const *vertices,
+    size_t vertices_size)
+{
+  // marks[v] holds the number of the meshlet that last referenced v
+  uint32_t *marks = calloc(vertices_size, sizeof(uint32_t));
+  assert(vertices_size == 0 || marks != NULL);
+
+  size_t meshlets_size = 0, start = 0, unique = 0;
+  for (size_t i = 0; i + 2 < indices_size; i += 3)
+  {
+    size_t fresh = 0;
+    for (size_t j = 0; j < 3; j++)
+    {
+      fresh += marks[indices[i + j]] != meshlets_size + 1;
+    }
+
+    if (unique + fresh > MESHLET_MAX_VERTICES || (i - start) / 3 + 1 > MESHLET_MAX_TRIANGLES)
+    {
+      dest[meshlets_size] = (meshlet_t){.first_index = start, .indices_size = i - start};
+      _compute_bounds(&dest[meshlets_size++], indices, vertices);
+      start = i;
+      unique = 0;
+    }
+
+    for (size_t j = 0; j < 3; j++)
+    {
+      if (marks[indices[i + j]] != meshlets_size + 1)
+      {
+        marks[indices[i + j]] = meshlets_size + 1;
+        unique++;
+      }
+    }
+  }
+
+  if (start < indices_size)
+  {
+    dest[meshlets_size] = (meshlet_t){.first_index = start, .indices_size = indices_size - start};
+    _compute_bounds(&dest[meshlets_size++], indices, vertices);
+  }
+
+  free(marks);
+  return meshlets_size;
+}
+
+bool meshlet_visible(meshlet_t const *meshlet, mat4 world, float scale, vec3 eye, vec4 planes[6])
+{
+  vec3 center;
+  glm_mat4_mulv3(world, (float *)meshlet->center, 1.f, center);
+  float radius = meshlet->radius * scale;
+
+  for (size_t i = 0; i < 6; i++)
+  {
+    if (glm_vec3_dot(planes[i], center) + planes[i][3] < -radius)
+    {
+      return false;
+    }
+  }
+
+  vec3 axis, view;
+  glm_mat4_mulv3(world, (float *)meshlet->cone_axis, 0.f, axis);
+  glm_vec3_normalize(axis);
+  glm_vec3_sub(center, eye, view);
+  return glm_vec3_dot(view, axis) < meshlet->cone_cutoff * glm_vec3_norm(view) + radius;
+}
@@ -0,0 +1,26 @@
+#if !defined(_MESHLET_H_)
+#define _MESHLET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <cglm/types.h>
+
+#include "mesh.h"
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// splits the triangles in order into consecutive meshlets, dest needs room for
+// one meshlet per triangle in the worst case, returns the number of meshlets
+size_t meshlet_build(
+    meshlet_t *dest,
+    GLuint const *indices,
+    size_t indices_size,
+    vertex_t const *vertices,
+    size_t vertices_size);
+
+// world is the instance transform and scale its largest axis scale
+bool meshlet_visible(meshlet_t const *meshlet, mat4 world, float scale, vec3 eye, vec4 planes[6]);
+
+#endif // _MESHLET_H_
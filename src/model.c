@@ -1,16 +1,36 @@
 #include "model.h"
 
 #include <assert.h>
+#include <stdalign.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <unistd.h>
+
+#include <cglm/cglm.h>
+
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#include <stb_image.h>
+#include "arena.h"
+#include "fs.h"
+#include "mesh_lod.h"
+#include "mesh_opt.h"
+#include "meshlet.h"
+#include "model_io.h"
+#include "skinning.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+#include "timer.h"
+#include "vertex_format.h"
+
+#define IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_FlipUVs)
+// a level must drop at least this share of the previous one to be worth keeping
+#define LOD_MIN_REDUCTION .15f
 
 #define COPY_VEC2(dest, src) \
   do                         \
@@ -27,75 +47,84 @@
     dest[2] = src.z;         \
   } while (0)
 
-static struct
+typedef struct mesh_data
 {
+  vertex_t *vertices;
+  GLuint *indices;
   texture_t *textures;
-  size_t count, size;
-} loaded_textures = {0};
+  size_t vertices_size, indices_size, textures_size;
+  mesh_lod_t lods[MESH_LOD_MAX];
+  size_t lods_size;
+  meshlet_t *meshlets;
+  size_t meshlets_size;
+  bounds_t bounds;
+  mesh_opt_stats_t before, after;
+} mesh_data_t;
 
-static void _add_loaded_texture(texture_t const *texture)
+typedef struct import_job
 {
-  if (loaded_textures.textures == NULL)
-  {
-    texture_t *textures = malloc(10 * sizeof(texture_t));
-    assert(textures != NULL);
-    loaded_textures.textures = textures;
-    loaded_textures.size = 10;
-    loaded_textures.count = 0;
-  }
-
-  if (loaded_textures.count >= loaded_textures.size)
-  {
-    size_t new_size = loaded_textures.size + (loaded_textures.size >> 1);
-    texture_t *new_textures_block = realloc(loaded_textures.textures, new_size * sizeof(texture_t));
-    assert(new_textures_block != NULL);
-    loaded_textures.textures = new_textures_block;
-    loaded_textures.size = new_size;
-  }
+  char const *model_path, *directory;
+  struct aiScene const *scene;
+  struct aiMesh const **sources;
+  mesh_data_t *outputs;
+  model_options_t const *options;
+  arena_t *arena, *geometry;
+  uint32_t const *bone_remap;
+  size_t const *first_bones;
+} import_job_t;
 
-  memcpy(&loaded_textures.textures[loaded_textures.count++], texture, sizeof(texture_t));
-}
-
-static bool _texture_from_file(char const *path, GLuint *texture)
+typedef struct bake_job
 {
-  int width, height, components;
-  unsigned char *data = stbi_load(path, &width, &height, &components, 0);
-  assert(data != NULL);
+  model_t const *model;
+  struct aiAnimation const *animation;
+  int32_t const *channel_nodes;
+  double ticks_per_second;
+  mat4 *palettes;
+} bake_job_t;
 
-  GLenum format;
-  switch (components)
+static texture_usage_t _texture_usage(enum texture_type type)
+{
+  switch (type)
   {
-  case 1:
-    format = GL_RED;
-    break;
-  case 3:
-    format = GL_RGB;
-    break;
-  case 4:
-    format = GL_RGBA;
-    break;
+  case TEXTURE_DIFFUSE:
+    return TEXTURE_USAGE_COLOR;
+  case TEXTURE_NORMAL:
+    return TEXTURE_USAGE_NORMAL;
 
   default:
-    return false;
+    return TEXTURE_USAGE_DATA;
   }
+}
 
-  GLuint texture_id;
-  glGenTextures(1, &texture_id);
-  glBindTexture(GL_TEXTURE_2D, texture_id);
-  glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// embedded textures are named after the model and their index in the scene,
+// the cache copies their bytes before the scene is released
+static texture_handle_t _acquire_embedded(import_job_t const *job, struct aiTexture const *texture, texture_usage_t usage)
+{
+  unsigned int index = 0;
+  while (index < job->scene->mNumTextures && job->scene->mTextures[index] != texture)
+  {
+    index++;
+  }
 
-  stbi_image_free(data);
+  size_t path_size = strlen(job->model_path) + sizeof("*4294967295");
+  char *path = malloc(path_size);
+  assert(path != NULL);
+  snprintf(path, path_size, "%s*%u", job->model_path, index);
 
-  *texture = texture_id;
-  return true;
+  texture_source_t source = {
+      .path = path,
+      .data = (unsigned char const *)texture->pcData,
+      .size = texture->mHeight > 0 ? (size_t)texture->mWidth * texture->mHeight * sizeof(struct aiTexel) : texture->mWidth,
+      .width = texture->mHeight > 0 ? texture->mWidth : 0,
+      .height = texture->mHeight,
+  };
+  texture_handle_t handle = texture_cache_acquire_source(&source, usage);
+  free(path);
+  return handle;
 }
 
-static void _load_material_textures(
+static void _collect_material_textures(
+    import_job_t const *job,
     struct aiMaterial const *material,
     enum aiTextureType assimp_type,
     enum texture_type type,
@@ -106,35 +135,48 @@ static void _load_material_textures(
   {
     struct aiString str;
     aiGetMaterialTexture(material, assimp_type, i, &str, NULL, NULL, NULL, NULL, NULL, NULL);
+    textures[i].type = type;
 
-    bool skip = false;
-    for (size_t j = 0; j < loaded_textures.count; i++)
+    struct aiTexture const *embedded = aiGetEmbeddedTexture(job->scene, str.data);
+    if (embedded != NULL)
     {
-      if (strcmp(loaded_textures.textures[j].path, str.data) == 0)
-      {
-        memcpy(&textures[i], &loaded_textures.textures[j], sizeof(texture_t));
-        skip = true;
-        break;
-      }
+      textures[i].handle = _acquire_embedded(job, embedded, _texture_usage(type));
+      continue;
     }
 
-    if (!skip)
-    {
-      texture_t *texture = &textures[i];
-      assert(_texture_from_file(str.data, &texture->id));
-      texture->type = type;
-      texture->path = strdup(str.data);
-      assert(texture->path != NULL);
+    char *path = fs_join_path(job->directory, str.data);
+    textures[i].handle = texture_cache_acquire(path, _texture_usage(type));
+    free(path);
+  }
+}
 
-      _add_loaded_texture(texture);
+// every vertex keeps its strongest bones, bones maps those of the mesh to the model ones
+static void _collect_weights(struct aiMesh const *mesh, uint32_t const *bones, vertex_t *vertices)
+{
+  for (unsigned int i = 0; i < mesh->mNumBones; i++)
+  {
+    struct aiBone const *bone = mesh->mBones[i];
+    for (unsigned int j = 0; j < bone->mNumWeights && bones[i] != UINT32_MAX; j++)
+    {
+      struct aiVertexWeight weight = bone->mWeights[j];
+      if (weight.mVertexId < mesh->mNumVertices)
+      {
+        skinning_add_influence(&vertices[weight.mVertexId], bones[i], weight.mWeight);
+      }
     }
   }
+
+  for (unsigned int i = 0; i < mesh->mNumVertices && mesh->mNumBones > 0; i++)
+  {
+    skinning_normalize(&vertices[i]);
+  }
 }
 
-static void _process_mesh(struct aiMesh *mesh, struct aiScene const *scene, mesh_t *output_mesh)
+// vertices go straight to the geometry arena and textures to the model one,
+// indices are still grown by the lods and only move once the mesh is done
+static void _process_mesh(import_job_t const *job, struct aiMesh const *mesh, uint32_t const *bones, mesh_data_t *output)
 {
-  vertex_t *vertices = calloc(mesh->mNumVertices, sizeof(vertex_t));
-  assert(vertices != NULL);
+  vertex_t *vertices = arena_calloc(job->geometry, mesh->mNumVertices, sizeof(vertex_t));
   for (unsigned int i = 0; i < mesh->mNumVertices; i++)
   {
     vertex_t *vertex = &vertices[i];
@@ -148,10 +190,15 @@ static void _process_mesh(struct aiMesh *mesh, struct aiScene const *scene, mesh
     if (mesh->mTextureCoords[0])
     {
       COPY_VEC2(vertex->tex_coords, mesh->mTextureCoords[0][i]);
+    }
+
+    if (mesh->mTangents != NULL && mesh->mBitangents != NULL)
+    {
       COPY_VEC3(vertex->tangent, mesh->mTangents[i]);
       COPY_VEC3(vertex->bitangent, mesh->mBitangents[i]);
     }
   }
+  _collect_weights(mesh, bones, vertices);
 
   size_t indices_size = 0;
   for (unsigned int i = 0; i < mesh->mNumFaces; i++)
@@ -169,96 +216,1530 @@ static void _process_mesh(struct aiMesh *mesh, struct aiScene const *scene, mesh
     indices_offset += face.mNumIndices;
   }
 
-  struct aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+  struct aiMaterial *material = job->scene->mMaterials[mesh->mMaterialIndex];
 
   unsigned int diffuse_count = aiGetMaterialTextureCount(material, aiTextureType_DIFFUSE);
   unsigned int specular_count = aiGetMaterialTextureCount(material, aiTextureType_SPECULAR);
   unsigned int normal_count = aiGetMaterialTextureCount(material, aiTextureType_HEIGHT);
   unsigned int height_count = aiGetMaterialTextureCount(material, aiTextureType_AMBIENT);
   size_t textures_size = diffuse_count + specular_count + normal_count + height_count;
-  texture_t *textures = calloc(textures_size, sizeof(texture_t));
-  assert(textures != NULL);
+  texture_t *textures = arena_calloc(job->arena, textures_size, sizeof(texture_t));
 
   texture_t *tmp = textures;
-  _load_material_textures(material, aiTextureType_DIFFUSE, TEXTURE_DIFFUSE, diffuse_count, tmp);
+  _collect_material_textures(job, material, aiTextureType_DIFFUSE, TEXTURE_DIFFUSE, diffuse_count, tmp);
   tmp += diffuse_count;
-  _load_material_textures(material, aiTextureType_SPECULAR, TEXTURE_SPECULAR, specular_count, tmp);
+  _collect_material_textures(job, material, aiTextureType_SPECULAR, TEXTURE_SPECULAR, specular_count, tmp);
   tmp += specular_count;
-  _load_material_textures(material, aiTextureType_HEIGHT, TEXTURE_NORMAL, normal_count, tmp);
+  _collect_material_textures(job, material, aiTextureType_HEIGHT, TEXTURE_NORMAL, normal_count, tmp);
   tmp += normal_count;
-  _load_material_textures(material, aiTextureType_AMBIENT, TEXTURE_HEIGHT, height_count, tmp);
+  _collect_material_textures(job, material, aiTextureType_AMBIENT, TEXTURE_HEIGHT, height_count, tmp);
+
+  *output = (mesh_data_t){
+      .vertices = vertices,
+      .vertices_size = mesh->mNumVertices,
+      .indices = indices,
+      .indices_size = indices_size,
+      .textures = textures,
+      .textures_size = textures_size,
+      .lods = {{.first_index = 0, .indices_size = indices_size, .error = 0.f}},
+      .lods_size = 1,
+  };
+  bounds_from_vertices(vertices, output->vertices_size, &output->bounds);
+}
+
+static void _optimize_mesh(mesh_data_t *data)
+{
+  mesh_opt_analyze(data->indices, data->indices_size, data->vertices_size, &data->before);
+  mesh_opt_optimize(data->vertices, &data->vertices_size, data->indices, data->indices_size);
+  mesh_opt_analyze(data->indices, data->indices_size, data->vertices_size, &data->after);
+
+  // unreferenced vertices are gone now, they may have widened the bounds
+  bounds_from_vertices(data->vertices, data->vertices_size, &data->bounds);
+}
+
+// every level halves the previous triangle count unless its error budget runs out first,
+// levels are simplified from full detail and appended to the index buffer
+static void _build_lods(mesh_data_t *data, model_options_t const *options)
+{
+  size_t base_size = data->lods[0].indices_size;
+  GLuint *simplified = malloc(base_size * sizeof(GLuint));
+  size_t *clusters = malloc(base_size / 3 * sizeof(size_t));
+  assert(base_size == 0 || (simplified != NULL && clusters != NULL));
+
+  size_t lods_size = options->lods_size < MESH_LOD_MAX ? options->lods_size : MESH_LOD_MAX;
+  for (size_t lod = 1; lod < lods_size; lod++)
+  {
+    mesh_lod_t const *previous = &data->lods[lod - 1];
+    size_t target = (base_size >> lod) / 3 * 3;
+    float error;
+    size_t simplified_size = mesh_lod_simplify(
+        simplified, data->indices, base_size, data->vertices, data->vertices_size, target, options->lod_errors[lod - 1], &error);
+    if (simplified_size == 0 || simplified_size > previous->indices_size * (1.f - LOD_MIN_REDUCTION))
+    {
+      break;
+    }
+
+    GLuint *indices = realloc(data->indices, (data->indices_size + simplified_size) * sizeof(GLuint));
+    assert(indices != NULL);
+    data->indices = indices;
+    mesh_opt_vertex_cache(&indices[data->indices_size], clusters, simplified, simplified_size, data->vertices_size);
+
+    data->lods[lod] = (mesh_lod_t){.first_index = data->indices_size, .indices_size = simplified_size, .error = error};
+    data->lods_size++;
+    data->indices_size += simplified_size;
+  }
+
+  free(clusters);
+  free(simplified);
+}
+
+// a mesh that fits in one meshlet gains nothing from cluster culling
+static void _build_meshlets(mesh_data_t *data, arena_t *arena)
+{
+  size_t triangles_size = data->lods[0].indices_size / 3;
+  meshlet_t *meshlets = malloc(triangles_size * sizeof(meshlet_t));
+  assert(triangles_size == 0 || meshlets != NULL);
+
+  size_t meshlets_size = meshlet_build(meshlets, data->indices, data->lods[0].indices_size, data->vertices, data->vertices_size);
+  if (meshlets_size < 2)
+  {
+    free(meshlets);
+    return;
+  }
 
-  mesh_init(vertices, mesh->mNumVertices, indices, indices_size, textures, textures_size, output_mesh);
+  data->meshlets = arena_copy(arena, meshlets, meshlets_size * sizeof(meshlet_t));
+  data->meshlets_size = meshlets_size;
+  free(meshlets);
 }
 
-static size_t _count_meshes(struct aiNode *node)
+static void _process_mesh_task(void *data, size_t index)
 {
-  size_t meshes_count = node->mNumMeshes;
+  import_job_t *job = data;
+  struct aiMesh const *source = job->sources[index];
+  mesh_data_t *output = &job->outputs[index];
+  _process_mesh(job, source, &job->bone_remap[job->first_bones[index]], output);
+
+  if (source->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+  {
+    if (job->options->optimize)
+    {
+      _optimize_mesh(output);
+    }
+
+    if (job->options->lods_size > 1)
+    {
+      _build_lods(output, job->options);
+    }
 
-  for (unsigned int i = 0; node->mNumChildren; i++)
+    // skinned triangles move, bounds and cones of the bind pose would cull them wrong
+    if (job->options->meshlets && source->mNumBones == 0)
+    {
+      _build_meshlets(output, job->arena);
+    }
+  }
+
+  GLuint *indices = output->indices;
+  output->indices = arena_copy(job->geometry, indices, output->indices_size * sizeof(GLuint));
+  free(indices);
+}
+
+// packed textures are never loaded one by one, their handles only keep the paths
+static void _upload_mesh(mesh_data_t *data, bool pack_textures, mesh_t *mesh)
+{
+  for (size_t i = 0; i < data->textures_size && !pack_textures; i++)
   {
-    meshes_count += _count_meshes(node->mChildren[i]);
+    texture_t *texture = &data->textures[i];
+    texture->id = texture_cache_resolve(texture->handle);
   }
 
-  return meshes_count;
+  mesh_init(
+      data->vertices,
+      data->vertices_size,
+      data->indices,
+      data->indices_size,
+      data->lods,
+      data->lods_size,
+      data->meshlets,
+      data->meshlets_size,
+      &data->bounds,
+      data->textures,
+      data->textures_size,
+      mesh);
+}
+
+static void _copy_matrix(mat4 dest, struct aiMatrix4x4 const *src)
+{
+  dest[0][0] = src->a1, dest[1][0] = src->a2, dest[2][0] = src->a3, dest[3][0] = src->a4;
+  dest[0][1] = src->b1, dest[1][1] = src->b2, dest[2][1] = src->b3, dest[3][1] = src->b4;
+  dest[0][2] = src->c1, dest[1][2] = src->c2, dest[2][2] = src->c3, dest[3][2] = src->c4;
+  dest[0][3] = src->d1, dest[1][3] = src->d2, dest[2][3] = src->d3, dest[3][3] = src->d4;
+}
+
+static void _count_nodes(struct aiNode const *node, size_t *nodes_count, size_t *instances_count)
+{
+  (*nodes_count)++;
+  *instances_count += node->mNumMeshes;
+
+  for (unsigned int i = 0; i < node->mNumChildren; i++)
+  {
+    _count_nodes(node->mChildren[i], nodes_count, instances_count);
+  }
 }
 
-static void _process_node(struct aiNode *node, struct aiScene const *scene, mesh_t *meshes, size_t *index)
+// flattens the node tree in pre-order so every parent lands before its children,
+// instances keep the assimp mesh index until _share_meshes remaps them
+static void _collect_nodes(
+    struct aiNode const *node,
+    int32_t parent,
+    model_t *model,
+    struct aiNode const **nodes,
+    size_t *node_index,
+    size_t *instance_index)
 {
+  size_t index = (*node_index)++;
+  nodes[index] = node;
+  mat4 local;
+  _copy_matrix(local, &node->mTransformation);
+  scene_graph_set_node(&model->graph, index, parent, local);
+
   for (unsigned int i = 0; i < node->mNumMeshes; i++)
   {
-    struct aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-    _process_mesh(mesh, scene, &meshes[(*index)++]);
+    model->instances[(*instance_index)++] = (model_instance_t){.mesh = node->mMeshes[i], .node = index};
   }
 
   for (unsigned int i = 0; i < node->mNumChildren; i++)
   {
-    _process_node(node->mChildren[i], scene, meshes, index);
+    _collect_nodes(node->mChildren[i], index, model, nodes, node_index, instance_index);
   }
 }
 
-void model_init(char const *model_path, model_t *model)
+// keeps one mesh per referenced aiMesh, no matter how many nodes instance it
+static size_t _share_meshes(struct aiScene const *scene, model_t *model, struct aiMesh const **sources)
 {
-  struct aiScene const *scene = aiImportFile(model_path, aiProcess_Triangulate | aiProcess_FlipUVs);
+  uint32_t *remap = malloc(scene->mNumMeshes * sizeof(uint32_t));
+  assert(scene->mNumMeshes == 0 || remap != NULL);
+  memset(remap, 0xff, scene->mNumMeshes * sizeof(uint32_t));
 
-  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+  size_t meshes_size = 0;
+  for (size_t i = 0; i < model->instances_size; i++)
   {
-    fprintf(stderr, "ASSIMP error: %s\n", aiGetErrorString());
-    exit(1);
+    model_instance_t *instance = &model->instances[i];
+    if (remap[instance->mesh] == UINT32_MAX)
+    {
+      remap[instance->mesh] = meshes_size;
+      sources[meshes_size++] = scene->mMeshes[instance->mesh];
+    }
+    instance->mesh = remap[instance->mesh];
   }
 
-  size_t meshes_size = _count_meshes(scene->mRootNode);
-  mesh_t *meshes = calloc(meshes_size, sizeof(mesh_t));
-  assert(meshes != NULL);
-  size_t mesh_index = 0;
-  _process_node(scene->mRootNode, scene, meshes, &mesh_index);
-  model->meshes = meshes;
-  model->meshes_size = meshes_size;
+  free(remap);
+  return meshes_size;
 }
 
-void model_deinit(model_t *model)
+static int32_t _find_node(struct aiNode const *const *nodes, size_t nodes_size, char const *name)
 {
-  if (model == NULL)
+  for (size_t i = MODEL_ROOT_NODE + 1; i < nodes_size; i++)
+  {
+    if (strcmp(nodes[i]->mName.data, name) == 0)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// a bone used by several meshes is stored once if they agree on its bind pose,
+// bone j of source mesh i becomes model bone bone_remap[first_bones[i] + j]
+static void _collect_bones(
+    struct aiMesh const *const *sources,
+    size_t meshes_size,
+    struct aiNode const *const *nodes,
+    model_t *model,
+    uint32_t **bone_remap,
+    size_t **first_bones)
+{
+  size_t *first = malloc((meshes_size + 1) * sizeof(size_t));
+  assert(first != NULL);
+  first[0] = 0;
+  for (size_t i = 0; i < meshes_size; i++)
+  {
+    first[i + 1] = first[i] + sources[i]->mNumBones;
+  }
+
+  uint32_t *remap = malloc(first[meshes_size] * sizeof(uint32_t));
+  assert(first[meshes_size] == 0 || remap != NULL);
+  model->bones = arena_alloc(&model->arena, first[meshes_size] * sizeof(animation_bone_t), alignof(animation_bone_t));
+  model->bones_size = 0;
+
+  for (size_t i = 0; i < meshes_size; i++)
+  {
+    for (unsigned int j = 0; j < sources[i]->mNumBones; j++)
+    {
+      struct aiBone const *source = sources[i]->mBones[j];
+      uint32_t *bone = &remap[first[i] + j];
+      *bone = UINT32_MAX;
+
+      int32_t node = _find_node(nodes, model->graph.nodes_size, source->mName.data);
+      if (node < 0)
+      {
+        fprintf(stderr, "Bone %s has no node\n", source->mName.data);
+        continue;
+      }
+
+      animation_bone_t candidate = {.node = node};
+      _copy_matrix(candidate.offset, &source->mOffsetMatrix);
+      for (size_t k = 0; k < model->bones_size && *bone == UINT32_MAX; k++)
+      {
+        if (model->bones[k].node == candidate.node && memcmp(model->bones[k].offset, candidate.offset, sizeof(mat4)) == 0)
+        {
+          *bone = k;
+        }
+      }
+
+      // packed vertices keep 16 bit bone ids
+      if (*bone == UINT32_MAX && model->bones_size <= UINT16_MAX)
+      {
+        *bone = model->bones_size;
+        model->bones[model->bones_size++] = candidate;
+      }
+    }
+  }
+
+  *bone_remap = remap;
+  *first_bones = first;
+}
+
+// a skinned mesh is placed by its bones, not by the nodes that instance it
+static void _root_skinned_instances(struct aiMesh const *const *sources, model_t *model)
+{
+  for (size_t i = 0; i < model->instances_size; i++)
+  {
+    model_instance_t *instance = &model->instances[i];
+    if (sources[instance->mesh]->mNumBones > 0)
+    {
+      instance->node = MODEL_ROOT_NODE;
+    }
+  }
+}
+
+// worlds leave out the root so that palettes stay in model space
+static void _pose_palette(model_t const *model, mat4 *locals, mat4 *worlds, mat4 *palette)
+{
+  scene_graph_t const *graph = &model->graph;
+  glm_mat4_identity(worlds[MODEL_ROOT_NODE]);
+  for (size_t i = MODEL_ROOT_NODE + 1; i < graph->nodes_size; i++)
+  {
+    if (graph->parents[i] < 0)
+    {
+      glm_mat4_copy(locals[i], worlds[i]);
+    }
+    else
+    {
+      glm_mat4_mul(worlds[graph->parents[i]], locals[i], worlds[i]);
+    }
+  }
+
+  for (size_t i = 0; i < model->bones_size; i++)
+  {
+    glm_mat4_mul(worlds[model->bones[i].node], model->bones[i].offset, palette[i]);
+  }
+}
+
+static void _sample_vector(struct aiVectorKey const *keys, unsigned int keys_size, double tick, vec3 dest)
+{
+  unsigned int i = 0;
+  while (i + 1 < keys_size && keys[i + 1].mTime <= tick)
+  {
+    i++;
+  }
+
+  COPY_VEC3(dest, keys[i].mValue);
+  if (i + 1 < keys_size && keys[i].mTime < tick)
+  {
+    vec3 next;
+    COPY_VEC3(next, keys[i + 1].mValue);
+    glm_vec3_lerp(dest, next, (float)((tick - keys[i].mTime) / (keys[i + 1].mTime - keys[i].mTime)), dest);
+  }
+}
+
+static void _sample_rotation(struct aiQuatKey const *keys, unsigned int keys_size, double tick, versor dest)
+{
+  unsigned int i = 0;
+  while (i + 1 < keys_size && keys[i + 1].mTime <= tick)
+  {
+    i++;
+  }
+
+  struct aiQuaternion const *value = &keys[i].mValue;
+  glm_quat_init(dest, value->x, value->y, value->z, value->w);
+  if (i + 1 < keys_size && keys[i].mTime < tick)
+  {
+    versor next;
+    value = &keys[i + 1].mValue;
+    glm_quat_init(next, value->x, value->y, value->z, value->w);
+    glm_quat_slerp(dest, next, (float)((tick - keys[i].mTime) / (keys[i + 1].mTime - keys[i].mTime)), dest);
+  }
+}
+
+// a channel without keys of some kind keeps that part of the bind pose
+static void _sample_channel(struct aiNodeAnim const *channel, double tick, mat4 local)
+{
+  vec4 translation;
+  mat4 rotation;
+  vec3 scale;
+  glm_decompose(local, translation, rotation, scale);
+  versor orientation;
+  glm_mat4_quat(rotation, orientation);
+
+  if (channel->mNumPositionKeys > 0)
+  {
+    _sample_vector(channel->mPositionKeys, channel->mNumPositionKeys, tick, translation);
+  }
+  if (channel->mNumRotationKeys > 0)
+  {
+    _sample_rotation(channel->mRotationKeys, channel->mNumRotationKeys, tick, orientation);
+  }
+  if (channel->mNumScalingKeys > 0)
+  {
+    _sample_vector(channel->mScalingKeys, channel->mNumScalingKeys, tick, scale);
+  }
+
+  glm_translate_make(local, translation);
+  glm_quat_rotate(local, orientation, local);
+  glm_scale(local, scale);
+}
+
+static void _bake_frame(void *data, size_t frame)
+{
+  bake_job_t const *job = data;
+  model_t const *model = job->model;
+  size_t nodes_size = model->graph.nodes_size;
+  mat4 *locals = malloc(2 * nodes_size * sizeof(mat4));
+  assert(locals != NULL);
+  mat4 *worlds = &locals[nodes_size];
+  memcpy(locals, model->graph.locals, nodes_size * sizeof(mat4));
+
+  double tick = glm_min(frame / ANIMATION_FRAME_RATE * job->ticks_per_second, job->animation->mDuration);
+  for (unsigned int i = 0; i < job->animation->mNumChannels; i++)
+  {
+    if (job->channel_nodes[i] >= 0)
+    {
+      _sample_channel(job->animation->mChannels[i], tick, locals[job->channel_nodes[i]]);
+    }
+  }
+
+  _pose_palette(model, locals, worlds, &job->palettes[frame * model->bones_size]);
+  free(locals);
+}
+
+// every clip becomes a palette per frame, the frames of a clip are baked on the pool
+static void _bake_clips(struct aiScene const *scene, struct aiNode const *const *nodes, model_t *model)
+{
+  if (model->bones_size == 0 || scene->mNumAnimations == 0)
+  {
+    return;
+  }
+
+  model->clips = arena_calloc(&model->arena, scene->mNumAnimations, sizeof(animation_clip_t));
+  model->clips_size = scene->mNumAnimations;
+  for (unsigned int i = 0; i < scene->mNumAnimations; i++)
+  {
+    struct aiAnimation const *animation = scene->mAnimations[i];
+    double ticks_per_second = animation->mTicksPerSecond > 0. ? animation->mTicksPerSecond : 25.;
+    float duration = (float)(animation->mDuration / ticks_per_second);
+    size_t frames_size = (size_t)ceilf(duration * ANIMATION_FRAME_RATE) + 1;
+
+    int32_t *channel_nodes = malloc(animation->mNumChannels * sizeof(int32_t));
+    assert(animation->mNumChannels == 0 || channel_nodes != NULL);
+    for (unsigned int j = 0; j < animation->mNumChannels; j++)
+    {
+      channel_nodes[j] = _find_node(nodes, model->graph.nodes_size, animation->mChannels[j]->mNodeName.data);
+    }
+
+    bake_job_t job = {
+        .model = model,
+        .animation = animation,
+        .channel_nodes = channel_nodes,
+        .ticks_per_second = ticks_per_second,
+        .palettes = arena_alloc(&model->arena, frames_size * model->bones_size * sizeof(mat4), alignof(mat4)),
+    };
+    thread_pool_for(thread_pool_shared(), frames_size, _bake_frame, &job);
+    free(channel_nodes);
+
+    model->clips[i] = (animation_clip_t){
+        .name = arena_strdup(&model->arena, animation->mName.data),
+        .duration = duration,
+        .frame_rate = ANIMATION_FRAME_RATE,
+        .frames_size = frames_size,
+        .palettes = job.palettes,
+    };
+  }
+}
+
+// starts from the bind pose, the bone buffer is what the vertex shader skins with
+static void _setup_skinning(model_t *model)
+{
+  if (model->bones_size == 0)
   {
     return;
   }
 
+  mat4 *worlds = malloc(model->graph.nodes_size * sizeof(mat4));
+  assert(worlds != NULL);
+  model->palette = arena_alloc(&model->arena, model->bones_size * sizeof(mat4), alignof(mat4));
+  _pose_palette(model, model->graph.locals, worlds, model->palette);
+  free(worlds);
+
+  glGenBuffers(1, &model->bone_buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->bone_buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, model->bones_size * sizeof(mat4), model->palette, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// counting sort by mesh so every mesh draws its instances as one contiguous range
+static void _group_instances(model_t *model)
+{
+  uint32_t *first = arena_calloc(&model->arena, model->meshes_size + 1, sizeof(uint32_t));
+  model_instance_t *sorted = arena_alloc(&model->arena, model->instances_size * sizeof(model_instance_t), alignof(model_instance_t));
+
+  for (size_t i = 0; i < model->instances_size; i++)
+  {
+    first[model->instances[i].mesh + 1]++;
+  }
+
   for (size_t i = 0; i < model->meshes_size; i++)
   {
-    mesh_t *mesh = &model->meshes[i];
-    mesh_deinit(mesh);
-    free(mesh->textures);
-    free(mesh->indices);
-    free(mesh->vertices);
+    first[i + 1] += first[i];
+  }
+
+  uint32_t *cursor = malloc(model->meshes_size * sizeof(uint32_t));
+  assert(model->meshes_size == 0 || cursor != NULL);
+  memcpy(cursor, first, model->meshes_size * sizeof(uint32_t));
+  for (size_t i = 0; i < model->instances_size; i++)
+  {
+    sorted[cursor[model->instances[i].mesh]++] = model->instances[i];
+  }
+
+  free(cursor);
+  free(model->instances);
+  model->instances = sorted;
+  model->mesh_instances = first;
+}
+
+static void _setup_instances(model_t *model)
+{
+  glGenBuffers(1, &model->instance_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, model->instance_vbo);
+  glBufferData(GL_ARRAY_BUFFER, model->instances_size * sizeof(mat4), NULL, GL_DYNAMIC_DRAW);
+
+  // slots only move between the levels of their own mesh, so the mesh of a slot never changes
+  uint32_t *slot_meshes = malloc(model->instances_size * sizeof(uint32_t));
+  assert(model->instances_size == 0 || slot_meshes != NULL);
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    for (uint32_t j = model->mesh_instances[i]; j < model->mesh_instances[i + 1]; j++)
+    {
+      slot_meshes[j] = i;
+    }
+  }
+  glGenBuffers(1, &model->instance_meshes);
+  glBindBuffer(GL_ARRAY_BUFFER, model->instance_meshes);
+  glBufferData(GL_ARRAY_BUFFER, model->instances_size * sizeof(uint32_t), slot_meshes, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  free(slot_meshes);
+
+  model->lod_instances = arena_calloc(&model->arena, model->meshes_size * (MESH_LOD_MAX + 1), sizeof(uint32_t));
+  model->instance_lods = arena_calloc(&model->arena, model->instances_size, sizeof(uint8_t));
+  model->slot_instances = arena_calloc(&model->arena, model->instances_size, sizeof(uint32_t));
+  model->mesh_commands = arena_calloc(&model->arena, model->meshes_size + 1, sizeof(size_t));
+
+  glGenBuffers(1, &model->command_buffer);
+  model->instances_dirty = true;
+}
+
+// the root is still the identity here, so the node transforms place every mesh in model space
+static void _compute_bounds(model_t *model)
+{
+  scene_graph_update(&model->graph);
+  bounds_empty(&model->bounds);
+  for (size_t i = 0; i < model->instances_size; i++)
+  {
+    model_instance_t const *instance = &model->instances[i];
+    bounds_t bounds;
+    bounds_transform(&model->meshes[instance->mesh].bounds, model->graph.worlds[instance->node], &bounds);
+    bounds_merge(&model->bounds, &bounds);
   }
+}
 
-  free(model->meshes);
+static float _max_scale(mat4 world)
+{
+  return glm_max(glm_vec3_norm(world[0]), glm_max(glm_vec3_norm(world[1]), glm_vec3_norm(world[2])));
+}
+
+static float _projected_radius(model_t const *model, mesh_t const *mesh, model_instance_t const *instance, camera_t *camera)
+{
+  vec4 *world = model->graph.worlds[instance->node];
+  vec3 center;
+  glm_mat4_mulv3(world, (float *)mesh->bounds.center, 1.f, center);
+  return cam_projected_radius(camera, center, mesh->bounds.radius * _max_scale(world));
 }
 
-void model_draw(model_t *model, shader_t *shader)
+// picks a lod for every instance, the closest instance of a mesh decides which
+// mip levels its textures need. the slots are only regrouped by lod inside each
+// mesh range and rewritten when the graph moved or some instance changed level
+static void _upload_instances(model_t *model, camera_t *camera, float viewport_height, bool moved)
 {
+  bool changed = moved || model->instances_dirty;
   for (size_t i = 0; i < model->meshes_size; i++)
   {
-    mesh_draw(&model->meshes[i], shader);
+    mesh_t const *mesh = &model->meshes[i];
+    float max_projected_radius = 0.f;
+    for (uint32_t j = model->mesh_instances[i]; j < model->mesh_instances[i + 1]; j++)
+    {
+      float projected_radius = _projected_radius(model, mesh, &model->instances[j], camera);
+      uint8_t lod = mesh_select_lod(mesh, projected_radius, model->lod_screen_error);
+      changed |= lod != model->instance_lods[j];
+      model->instance_lods[j] = lod;
+      max_projected_radius = glm_max(max_projected_radius, projected_radius);
+    }
+
+    if (max_projected_radius > 0.f)
+    {
+      mesh_stream_textures(mesh, max_projected_radius, viewport_height);
+    }
+  }
+
+  if (!changed)
+  {
+    return;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, model->instance_vbo);
+  mat4 *matrices = glMapBufferRange(
+      GL_ARRAY_BUFFER, 0, model->instances_size * sizeof(mat4), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (matrices == NULL)
+  {
+    return;
+  }
+
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    uint32_t *ranges = &model->lod_instances[i * (MESH_LOD_MAX + 1)];
+    uint32_t cursor[MESH_LOD_MAX] = {0};
+    for (uint32_t j = model->mesh_instances[i]; j < model->mesh_instances[i + 1]; j++)
+    {
+      cursor[model->instance_lods[j]]++;
+    }
+
+    ranges[0] = model->mesh_instances[i];
+    for (size_t lod = 0; lod < MESH_LOD_MAX; lod++)
+    {
+      ranges[lod + 1] = ranges[lod] + cursor[lod];
+      cursor[lod] = ranges[lod];
+    }
+
+    for (uint32_t j = model->mesh_instances[i]; j < model->mesh_instances[i + 1]; j++)
+    {
+      uint32_t slot = cursor[model->instance_lods[j]]++;
+      model->slot_instances[slot] = j;
+      memcpy(matrices[slot], model->graph.worlds[model->instances[j].node], sizeof(mat4));
+    }
+  }
+
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  model->instances_dirty = false;
+}
+
+static void _push_command(model_t *model, size_t *commands_size, mesh_draw_command_t command)
+{
+  if (*commands_size == model->commands_capacity)
+  {
+    size_t capacity = model->commands_capacity ? model->commands_capacity << 1 : 256;
+    mesh_draw_command_t *commands = realloc(model->commands, capacity * sizeof(mesh_draw_command_t));
+    assert(commands != NULL);
+    model->commands = commands;
+    model->commands_capacity = capacity;
+  }
+
+  model->commands[(*commands_size)++] = command;
+}
+
+// one command per segment of every level with instances, except the full detail
+// of a mesh with meshlets that takes one per meshlet that survives frustum and
+// cone culling, for every instance
+static void _build_commands(model_t *model, camera_t *camera, mat4 projection)
+{
+  vec4 planes[6];
+  cam_get_frustum_planes(camera, projection, planes);
+
+  size_t commands_size = 0;
+  for (size_t k = 0; k < model->meshes_size; k++)
+  {
+    size_t i = model->draw_order[k];
+    mesh_t const *mesh = &model->meshes[i];
+    uint32_t const *ranges = &model->lod_instances[i * (MESH_LOD_MAX + 1)];
+    model->mesh_commands[k] = commands_size;
+
+    for (size_t lod = mesh->meshlets_size > 0 ? 1 : 0; lod < mesh->lods_size; lod++)
+    {
+      mesh_lod_t const *level = &mesh->lods[lod];
+      for (size_t j = level->first_segment; j < level->first_segment + level->segments_size && ranges[lod + 1] > ranges[lod]; j++)
+      {
+        _push_command(model, &commands_size, mesh_segment_command(mesh, &mesh->segments[j], ranges[lod + 1] - ranges[lod], ranges[lod]));
+      }
+    }
+
+    for (uint32_t slot = ranges[0]; mesh->meshlets_size > 0 && slot < ranges[1]; slot++)
+    {
+      vec4 *world = model->graph.worlds[model->instances[model->slot_instances[slot]].node];
+      float scale = _max_scale(world);
+      mesh_segment_t const *segment = &mesh->segments[mesh->lods[0].first_segment];
+      for (size_t j = 0; j < mesh->meshlets_size; j++)
+      {
+        meshlet_t const *meshlet = &mesh->meshlets[j];
+        while (meshlet->first_index >= segment->first_index + segment->indices_size)
+        {
+          segment++;
+        }
+
+        if (meshlet_visible(meshlet, world, scale, camera->pos, planes))
+        {
+          mesh_draw_command_t command = mesh_segment_command(mesh, segment, 1, slot);
+          command.count = meshlet->indices_size;
+          command.first_index = mesh->first_index + meshlet->first_index;
+          _push_command(model, &commands_size, command);
+        }
+      }
+    }
+  }
+  model->mesh_commands[model->meshes_size] = commands_size;
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, model->command_buffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, commands_size * sizeof(mesh_draw_command_t), model->commands, GL_STREAM_DRAW);
+}
+
+static int _compare_draw_keys(void const *a, void const *b)
+{
+  uint64_t left = *(uint64_t const *)a, right = *(uint64_t const *)b;
+  return (left > right) - (left < right);
+}
+
+static bool _same_batch(model_t const *model, size_t k)
+{
+  mesh_t const *previous = &model->meshes[model->draw_order[k - 1]], *mesh = &model->meshes[model->draw_order[k]];
+  return model->packed && previous->format == mesh->format && previous->index_type == mesh->index_type;
+}
+
+// runs once the regions are known, after packing
+static void _setup_draws(model_t *model)
+{
+  // format, then index type, then mesh so that the order is stable
+  uint64_t *keys = malloc(model->meshes_size * sizeof(uint64_t));
+  mesh_gpu_data_t *data = malloc(model->meshes_size * sizeof(mesh_gpu_data_t));
+  assert(model->meshes_size == 0 || (keys != NULL && data != NULL));
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    mesh_t const *mesh = &model->meshes[i];
+    keys[i] = (uint64_t)mesh->format << 33 | (uint64_t)(mesh->index_type == GL_UNSIGNED_INT) << 32 | i;
+    mesh_get_gpu_data(mesh, &data[i]);
+  }
+  qsort(keys, model->meshes_size, sizeof(uint64_t), _compare_draw_keys);
+
+  model->draw_order = arena_alloc(&model->arena, model->meshes_size * sizeof(uint32_t), alignof(uint32_t));
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    model->draw_order[i] = (uint32_t)keys[i];
+  }
+
+  model->batches_size = model->meshes_size > 0;
+  for (size_t k = 1; k < model->meshes_size; k++)
+  {
+    model->batches_size += !_same_batch(model, k);
+  }
+
+  glGenBuffers(1, &model->mesh_buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->mesh_buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, model->meshes_size * sizeof(mesh_gpu_data_t), data, GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  free(data);
+  free(keys);
+}
+
+// batches follow the draw order like model_draw, every instance can append one
+// command per segment of its largest level. skinned meshes move away from their
+// bounds so they only get a level
+static void _setup_gpu_cull(model_t *model)
+{
+  size_t segments_size = 0;
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    for (size_t lod = 0; lod < model->meshes[i].lods_size; lod++)
+    {
+      segments_size += model->meshes[i].lods[lod].segments_size;
+    }
+  }
+
+  gpu_cull_mesh_t *meshes = calloc(model->meshes_size, sizeof(gpu_cull_mesh_t));
+  gpu_cull_segment_t *segments = malloc(segments_size * sizeof(gpu_cull_segment_t));
+  model->cull_batches = arena_calloc(&model->arena, model->batches_size, sizeof(gpu_cull_batch_t));
+  model->mesh_scales = arena_calloc(&model->arena, model->meshes_size, sizeof(float));
+  assert(model->meshes_size == 0 || meshes != NULL);
+  assert(segments_size == 0 || segments != NULL);
+
+  size_t segment = 0, batch = 0;
+  for (size_t k = 0; k < model->meshes_size; k++)
+  {
+    size_t i = model->draw_order[k];
+    mesh_t const *mesh = &model->meshes[i];
+    gpu_cull_mesh_t *cull_mesh = &meshes[i];
+    batch += k > 0 && !_same_batch(model, k);
+
+    glm_vec3_copy((float *)mesh->bounds.center, cull_mesh->sphere);
+    cull_mesh->sphere[3] = mesh->bounds.radius;
+    cull_mesh->lods_size = mesh->lods_size;
+    cull_mesh->batch = batch;
+    cull_mesh->culled = !(mesh->format & VERTEX_FORMAT_SKINNED) && !bounds_is_empty(&mesh->bounds);
+
+    size_t max_segments = 0;
+    for (size_t lod = 0; lod < mesh->lods_size; lod++)
+    {
+      mesh_lod_t const *level = &mesh->lods[lod];
+      cull_mesh->lod_errors[lod] = level->error;
+      cull_mesh->lod_segments[lod] = segment;
+      cull_mesh->lod_segments_size[lod] = level->segments_size;
+      max_segments = level->segments_size > max_segments ? level->segments_size : max_segments;
+      for (size_t j = level->first_segment; j < level->first_segment + level->segments_size; j++)
+      {
+        mesh_draw_command_t command = mesh_segment_command(mesh, &mesh->segments[j], 0, 0);
+        segments[segment++] = (gpu_cull_segment_t){command.count, command.first_index, command.base_vertex, 0};
+      }
+    }
+
+    model->cull_batches[batch].capacity += (model->mesh_instances[i + 1] - model->mesh_instances[i]) * max_segments;
+  }
+
+  // the root is still the identity, so this is the scale of every instance relative to it
+  scene_graph_update(&model->graph);
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    for (uint32_t j = model->mesh_instances[i]; j < model->mesh_instances[i + 1]; j++)
+    {
+      model->mesh_scales[i] = glm_max(model->mesh_scales[i], _max_scale(model->graph.worlds[model->instances[j].node]));
+    }
+  }
+
+  for (size_t b = 1; b < model->batches_size; b++)
+  {
+    model->cull_batches[b].first_command = model->cull_batches[b - 1].first_command + model->cull_batches[b - 1].capacity;
+  }
+
+  gpu_cull_set_init(
+      meshes, model->meshes_size, segments, segments_size, model->cull_batches, model->batches_size, model->instances_size, &model->cull);
+  model->gpu_culled = true;
+  free(segments);
+  free(meshes);
+}
+
+// only the first texture of every type is sampled, so each mesh takes the
+// region of that one. sources are shared between meshes by handle
+static void _pack_type(char const *model_path, enum texture_type type, model_t *model)
+{
+  texture_handle_t *handles = malloc(model->meshes_size * sizeof(texture_handle_t));
+  uint32_t *mesh_sources = malloc(model->meshes_size * sizeof(uint32_t));
+  assert(model->meshes_size == 0 || (handles != NULL && mesh_sources != NULL));
+
+  size_t handles_size = 0;
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    mesh_t const *mesh = &model->meshes[i];
+    mesh_sources[i] = UINT32_MAX;
+    for (size_t j = 0; j < mesh->textures_size && mesh_sources[i] == UINT32_MAX; j++)
+    {
+      if (mesh->textures[j].type != type)
+      {
+        continue;
+      }
+
+      uint32_t source = 0;
+      while (source < handles_size && handles[source] != mesh->textures[j].handle)
+      {
+        source++;
+      }
+      if (source == handles_size)
+      {
+        handles[handles_size++] = mesh->textures[j].handle;
+      }
+      mesh_sources[i] = source;
+    }
+  }
+
+  texture_source_t *sources = calloc(handles_size, sizeof(texture_source_t));
+  texture_pack_region_t *regions = malloc(handles_size * sizeof(texture_pack_region_t));
+  assert(handles_size == 0 || (sources != NULL && regions != NULL));
+  for (size_t i = 0; i < handles_size; i++)
+  {
+    texture_cache_source(handles[i], &sources[i]);
+  }
+
+  size_t cache_path_size = strlen(model_path) + strlen(mesh_texture_type_name(type)) + sizeof("." TEXTURE_PACK_EXTENSION);
+  char *cache_path = malloc(cache_path_size);
+  assert(cache_path != NULL);
+  snprintf(cache_path, cache_path_size, "%s.%s" TEXTURE_PACK_EXTENSION, model_path, mesh_texture_type_name(type));
+
+  if (handles_size > 0)
+  {
+    texture_pack_build(cache_path, sources, handles_size, _texture_usage(type), &model->packs[type], regions);
+  }
+
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    texture_pack_region_t *region = &model->meshes[i].regions[type];
+    *region = mesh_sources[i] != UINT32_MAX ? regions[mesh_sources[i]] : (texture_pack_region_t){.layer = TEXTURE_PACK_LAYER_NONE};
+  }
+
+  free(cache_path);
+  free(regions);
+  free(sources);
+  free(mesh_sources);
+  free(handles);
+}
+
+static void _pack_textures(char const *model_path, model_t *model)
+{
+  double start = timer_now();
+  for (enum texture_type type = 0; type < TEXTURE_TYPES_SIZE; type++)
+  {
+    _pack_type(model_path, type, model);
+  }
+
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    model->meshes[i].packed = true;
+  }
+  model->packed = true;
+  printf("Packed textures of %s: %.1f ms\n", model_path, timer_elapsed_ms(start));
+}
+
+static void _print_texture_stats(model_t const *model)
+{
+  texture_cache_stats_t stats;
+  texture_cache_get_stats(&stats);
+  printf("Texture cache: %zu entries, %zu hits, %zu misses\n", stats.entries, stats.hits, stats.misses);
+
+  for (size_t i = 0; model->packed && i < TEXTURE_TYPES_SIZE; i++)
+  {
+    texture_pack_t const *pack = &model->packs[i];
+    if (pack->texture != 0)
+    {
+      printf("Texture pack %s: %u layers of %ux%u, %u levels\n",
+             mesh_texture_type_name(i), pack->layers_size, pack->width, pack->height, pack->levels_size);
+    }
+  }
+}
+
+static void _print_optimize_stats(mesh_data_t const *outputs, size_t outputs_size)
+{
+  mesh_opt_stats_t before = {0}, after = {0};
+  for (size_t i = 0; i < outputs_size; i++)
+  {
+    before.misses += outputs[i].before.misses;
+    before.triangles += outputs[i].before.triangles;
+    before.vertices += outputs[i].before.vertices;
+    after.misses += outputs[i].after.misses;
+    after.triangles += outputs[i].after.triangles;
+    after.vertices += outputs[i].after.vertices;
+  }
+
+  printf("Mesh optimization: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+         mesh_opt_acmr(&before), mesh_opt_acmr(&after), mesh_opt_atvr(&before), mesh_opt_atvr(&after));
+}
+
+static void _print_lod_stats(model_t const *model)
+{
+  size_t levels[MESH_LOD_MAX] = {0}, triangles[MESH_LOD_MAX] = {0};
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    for (size_t lod = 0; lod < model->meshes[i].lods_size; lod++)
+    {
+      levels[lod]++;
+      triangles[lod] += model->meshes[i].lods[lod].indices_size / 3;
+    }
+  }
+
+  printf("LOD chains:");
+  for (size_t lod = 0; lod < MESH_LOD_MAX && levels[lod] > 0; lod++)
+  {
+    printf(" %zu: %zu meshes %zu triangles%s", lod, levels[lod], triangles[lod], lod + 1 < MESH_LOD_MAX ? "," : "");
+  }
+  printf("\n");
+}
+
+static void _print_index_stats(model_t const *model)
+{
+  size_t bytes = 0, wide_bytes = 0, narrow_meshes = 0;
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    mesh_t const *mesh = &model->meshes[i];
+    bytes += mesh->indices_size * mesh_index_size(mesh);
+    wide_bytes += mesh->indices_size * sizeof(GLuint);
+    narrow_meshes += mesh->index_type == GL_UNSIGNED_SHORT;
+  }
+
+  geometry_buffer_stats_t stats;
+  geometry_buffer_get_stats(&stats);
+  printf("Index buffers: %.1f KiB (%.1f KiB as 32 bit), %zu of %zu meshes with 16 bit indices\n",
+         bytes / 1024., wide_bytes / 1024., narrow_meshes, model->meshes_size);
+  printf("Geometry buffer: vertices %.1f of %.1f MiB, indices %.1f of %.1f MiB, %zu free ranges, %zu draw batches\n",
+         stats.vertex_used / (1024. * 1024.), stats.vertex_capacity / (1024. * 1024.),
+         stats.index_used / (1024. * 1024.), stats.index_capacity / (1024. * 1024.), stats.free_ranges, model->batches_size);
+}
+
+static void _print_skeleton(model_t const *model)
+{
+  if (model->bones_size == 0)
+  {
+    return;
+  }
+
+  size_t frames_size = 0;
+  for (size_t i = 0; i < model->clips_size; i++)
+  {
+    frames_size += model->clips[i].frames_size;
+  }
+
+  printf("Skeleton: %zu bones, %zu clips, %.1f KiB of palettes\n",
+         model->bones_size, model->clips_size, frames_size * model->bones_size * sizeof(mat4) / 1024.);
+}
+
+static void _print_bounds(model_t const *model)
+{
+  bounds_t const *bounds = &model->bounds;
+  if (bounds_is_empty(bounds))
+  {
+    return;
+  }
+
+  printf("Bounds: min (%.2f, %.2f, %.2f), max (%.2f, %.2f, %.2f), sphere radius %.2f\n",
+         bounds->min[0], bounds->min[1], bounds->min[2],
+         bounds->max[0], bounds->max[1], bounds->max[2], bounds->radius);
+}
+
+static void _print_arena_stats(char const *name, arena_t const *arena)
+{
+  printf("%s arena: %.1f KiB in %zu allocations, %zu chunks (%.1f KiB reserved), high water %.1f KiB\n",
+         name, arena->used / 1024., arena->allocations, arena->chunks_size, arena->reserved / 1024., arena->high_water / 1024.);
+}
+
+// resident set size from procfs, 0 where there is none
+static size_t _resident_bytes(void)
+{
+  FILE *file = fopen("/proc/self/statm", "r");
+  if (file == NULL)
+  {
+    return 0;
+  }
+
+  unsigned long pages_size, resident_size;
+  bool ok = fscanf(file, "%lu %lu", &pages_size, &resident_size) == 2;
+  fclose(file);
+  return ok ? resident_size * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+// the gpu holds everything a draw needs by now. what the cpu keeps moves to the
+// model arena, with the meshlets that are still culled every frame, then the
+// geometry arena or the cache mapping that held the geometry goes away at once
+static void _release_geometry(model_t *model, enum model_geometry geometry)
+{
+  size_t before = _resident_bytes();
+  if (geometry == MODEL_GEOMETRY_KEEP)
+  {
+    printf("Geometry: CPU copies kept, resident %.1f MiB\n", before / (1024. * 1024.));
+    return;
+  }
+
+  bool from_cache = model->cache.mapping.data != NULL;
+  size_t dropped = 0;
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    mesh_t *mesh = &model->meshes[i];
+    dropped += mesh->vertices_size * sizeof(vertex_t);
+    if (geometry == MODEL_GEOMETRY_POSITIONS)
+    {
+      vec3 *positions = arena_alloc(&model->arena, mesh->vertices_size * sizeof(vec3), alignof(vec3));
+      for (size_t j = 0; j < mesh->vertices_size; j++)
+      {
+        glm_vec3_copy(mesh->vertices[j].position, positions[j]);
+      }
+      mesh->positions = positions;
+      mesh->indices = arena_copy(&model->arena, mesh->indices, mesh->indices_size * sizeof(GLuint));
+      dropped -= mesh->vertices_size * sizeof(vec3);
+    }
+    else
+    {
+      mesh->indices = NULL;
+      dropped += mesh->indices_size * sizeof(GLuint);
+    }
+    mesh->vertices = NULL;
+
+    if (from_cache && mesh->meshlets_size > 0)
+    {
+      mesh->meshlets = arena_copy(&model->arena, mesh->meshlets, mesh->meshlets_size * sizeof(meshlet_t));
+    }
+  }
+
+  for (size_t i = 0; i < model->clips_size && from_cache; i++)
+  {
+    animation_clip_t *clip = &model->clips[i];
+    clip->palettes = arena_copy(&model->arena, clip->palettes, clip->frames_size * model->bones_size * sizeof(mat4));
+  }
+
+  arena_release(&model->geometry);
+  mesh_cache_close(&model->cache);
+  printf("Geometry: dropped %.1f KiB of CPU copies%s, resident %.1f MiB -> %.1f MiB\n",
+         dropped / 1024., geometry == MODEL_GEOMETRY_POSITIONS ? " but positions and indices" : "",
+         before / (1024. * 1024.), _resident_bytes() / (1024. * 1024.));
+}
+
+// everything that changes what gets written to the cache
+static uint64_t _pipeline_hash(model_options_t const *options)
+{
+  float key[3 + MESH_LOD_MAX - 1] = {options->optimize, options->meshlets, options->lods_size};
+  memcpy(&key[3], options->lod_errors, sizeof(options->lod_errors));
+  return fs_hash(key, sizeof(key), 0);
+}
+
+static char *_cache_path(char const *model_path)
+{
+  size_t size = strlen(model_path) + sizeof(MESH_CACHE_EXTENSION);
+  char *path = malloc(size);
+  assert(path != NULL);
+  snprintf(path, size, "%s" MESH_CACHE_EXTENSION, model_path);
+  return path;
+}
+
+static bool _load_cache(
+    char const *cache_path,
+    char const *directory,
+    uint64_t source_hash,
+    uint64_t pipeline_hash,
+    bool pack_textures,
+    model_t *model)
+{
+  mesh_cache_t *cache = &model->cache;
+  if (!mesh_cache_open(cache_path, source_hash, IMPORT_FLAGS, pipeline_hash, cache))
+  {
+    return false;
+  }
+
+  scene_graph_init(cache->header->nodes.count, &model->graph);
+  for (size_t i = 0; i < cache->header->nodes.count; i++)
+  {
+    mat4 local;
+    memcpy(local, cache->nodes[i].transform, sizeof(mat4));
+    scene_graph_set_node(&model->graph, i, cache->nodes[i].parent, local);
+  }
+
+  model->instances_size = cache->header->instances.count;
+  model->instances = malloc(model->instances_size * sizeof(model_instance_t));
+  assert(model->instances_size == 0 || model->instances != NULL);
+  for (size_t i = 0; i < model->instances_size; i++)
+  {
+    model->instances[i] = (model_instance_t){.mesh = cache->instances[i].mesh, .node = cache->instances[i].node};
+  }
+
+  size_t meshes_size = cache->header->meshes.count;
+  mesh_t *meshes = arena_calloc(&model->arena, meshes_size, sizeof(mesh_t));
+  for (size_t i = 0; i < meshes_size; i++)
+  {
+    mesh_cache_mesh_t const *entry = &cache->meshes[i];
+
+    texture_t *textures = arena_calloc(&model->arena, entry->textures_size, sizeof(texture_t));
+    for (uint32_t j = 0; j < entry->textures_size; j++)
+    {
+      mesh_cache_texture_t const *texture = &cache->textures[entry->first_texture + j];
+      char *path = fs_join_path(directory, &cache->strings[texture->path_offset]);
+      texture_source_t source = {.path = path};
+      if (texture->data_size > 0)
+      {
+        source.data = &cache->embedded[texture->data_offset];
+        source.size = texture->data_size;
+        source.width = texture->width;
+        source.height = texture->height;
+      }
+      textures[j].type = texture->type;
+      textures[j].handle = texture_cache_acquire_source(&source, _texture_usage(texture->type));
+      textures[j].id = pack_textures ? 0 : texture_cache_resolve(textures[j].handle);
+      free(path);
+    }
+
+    mesh_lod_t lods[MESH_LOD_MAX];
+    for (uint32_t j = 0; j < entry->lods_size; j++)
+    {
+      lods[j] = (mesh_lod_t){
+          .first_index = entry->lods[j].first_index,
+          .indices_size = entry->lods[j].indices_size,
+          .error = entry->lods[j].error,
+      };
+    }
+
+    mesh_init(
+        (vertex_t *)&cache->vertices[entry->first_vertex],
+        entry->vertices_size,
+        (GLuint *)&cache->indices[entry->first_index],
+        entry->indices_size,
+        lods,
+        entry->lods_size,
+        (meshlet_t *)&cache->meshlets[entry->first_meshlet],
+        entry->meshlets_size,
+        &entry->bounds,
+        textures,
+        entry->textures_size,
+        &meshes[i]);
+  }
+
+  model->bones_size = cache->header->bones.count;
+  model->bones = arena_alloc(&model->arena, model->bones_size * sizeof(animation_bone_t), alignof(animation_bone_t));
+  for (size_t i = 0; i < model->bones_size; i++)
+  {
+    model->bones[i].node = cache->bones[i].node;
+    memcpy(model->bones[i].offset, cache->bones[i].offset, sizeof(mat4));
+  }
+
+  model->clips_size = cache->header->clips.count;
+  model->clips = arena_calloc(&model->arena, model->clips_size, sizeof(animation_clip_t));
+  for (size_t i = 0; i < model->clips_size; i++)
+  {
+    mesh_cache_clip_t const *clip = &cache->clips[i];
+    model->clips[i] = (animation_clip_t){
+        .name = arena_strdup(&model->arena, &cache->strings[clip->name_offset]),
+        .duration = clip->duration,
+        .frame_rate = clip->frame_rate,
+        .frames_size = clip->frames_size,
+        .palettes = &cache->palettes[clip->first_palette],
+    };
+  }
+
+  model->meshes = meshes;
+  model->meshes_size = meshes_size;
+  model->bounds = cache->header->bounds;
+  _group_instances(model);
+  _setup_instances(model);
+  _setup_skinning(model);
+  return true;
+}
+
+void model_init(char const *model_path, model_options_t const *options, model_t *model)
+{
+  memset(model, 0, sizeof(model_t));
+  arena_init(ARENA_CHUNK_SIZE_DEFAULT, &model->arena);
+  arena_init(ARENA_CHUNK_SIZE_DEFAULT, &model->geometry);
+
+  uint64_t source_hash;
+  bool has_hash = fs_hash_file(model_path, &source_hash);
+  char *cache_path = _cache_path(model_path);
+  char *directory = fs_directory(model_path);
+  uint64_t pipeline_hash = _pipeline_hash(options);
+  model->lod_screen_error = options->lod_screen_error;
+  double start = timer_now();
+  if (has_hash && _load_cache(cache_path, directory, source_hash, pipeline_hash, options->pack_textures, model))
+  {
+    printf("Loaded %s from cache: %.1f ms\n", model_path, timer_elapsed_ms(start));
+    if (options->pack_textures)
+    {
+      _pack_textures(model_path, model);
+    }
+    _setup_draws(model);
+    if (options->gpu_culling && gpu_cull_ready())
+    {
+      _setup_gpu_cull(model);
+    }
+    _print_texture_stats(model);
+    _print_index_stats(model);
+    _print_skeleton(model);
+    _print_bounds(model);
+    _release_geometry(model, options->geometry);
+    _print_arena_stats("Model", &model->arena);
+    free(directory);
+    free(cache_path);
+    return;
+  }
+
+  struct aiFileIO io;
+  model_io_init(&io);
+  struct aiScene const *scene = aiImportFileEx(model_path, IMPORT_FLAGS, &io);
+
+  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+  {
+    fprintf(stderr, "ASSIMP error: %s\n", aiGetErrorString());
+    exit(1);
+  }
+
+  double import_ms = timer_elapsed_ms(start);
+  start = timer_now();
+
+  size_t nodes_size = 1, instances_size = 0;
+  _count_nodes(scene->mRootNode, &nodes_size, &instances_size);
+  scene_graph_init(nodes_size, &model->graph);
+
+  model->instances = calloc(instances_size, sizeof(model_instance_t));
+  model->instances_size = instances_size;
+  struct aiMesh const **sources = calloc(instances_size, sizeof(struct aiMesh const *));
+  struct aiNode const **nodes = calloc(nodes_size, sizeof(struct aiNode const *));
+  assert(nodes != NULL && (instances_size == 0 || (model->instances != NULL && sources != NULL)));
+  size_t node_index = MODEL_ROOT_NODE + 1, instance_index = 0;
+  _collect_nodes(scene->mRootNode, MODEL_ROOT_NODE, model, nodes, &node_index, &instance_index);
+
+  size_t meshes_size = _share_meshes(scene, model, sources);
+  uint32_t *bone_remap;
+  size_t *first_bones;
+  _collect_bones(sources, meshes_size, nodes, model, &bone_remap, &first_bones);
+  _root_skinned_instances(sources, model);
+  mesh_data_t *outputs = calloc(meshes_size, sizeof(mesh_data_t));
+  assert(meshes_size == 0 || outputs != NULL);
+
+  thread_pool_t *pool = thread_pool_shared();
+  import_job_t job = {
+      .model_path = model_path,
+      .directory = directory,
+      .scene = scene,
+      .sources = sources,
+      .outputs = outputs,
+      .options = options,
+      .arena = &model->arena,
+      .geometry = &model->geometry,
+      .bone_remap = bone_remap,
+      .first_bones = first_bones,
+  };
+  thread_pool_for(pool, meshes_size, _process_mesh_task, &job);
+  _bake_clips(scene, nodes, model);
+
+  double process_ms = timer_elapsed_ms(start);
+  start = timer_now();
+
+  mesh_t *meshes = arena_calloc(&model->arena, meshes_size, sizeof(mesh_t));
+  for (size_t i = 0; i < meshes_size; i++)
+  {
+    _upload_mesh(&outputs[i], options->pack_textures, &meshes[i]);
+  }
+  model->meshes = meshes;
+  model->meshes_size = meshes_size;
+  _group_instances(model);
+  _setup_instances(model);
+  _setup_skinning(model);
+  _compute_bounds(model);
+  if (options->pack_textures)
+  {
+    _pack_textures(model_path, model);
+  }
+  _setup_draws(model);
+  if (options->gpu_culling && gpu_cull_ready())
+  {
+    _setup_gpu_cull(model);
+  }
+
+  double upload_ms = timer_elapsed_ms(start);
+  printf("Loaded %s: import %.1f ms, process %.1f ms (%zu threads), upload %.1f ms, %zu meshes, %zu instances\n",
+         model_path, import_ms, process_ms, pool->threads_size + 1, upload_ms, meshes_size, instances_size);
+  _print_texture_stats(model);
+  if (options->optimize)
+  {
+    _print_optimize_stats(outputs, meshes_size);
+  }
+  if (options->lods_size > 1)
+  {
+    _print_lod_stats(model);
+  }
+  _print_index_stats(model);
+  _print_skeleton(model);
+  _print_bounds(model);
+  _print_arena_stats("Model", &model->arena);
+  _print_arena_stats("Geometry", &model->geometry);
+
+  free(outputs);
+  free(first_bones);
+  free(bone_remap);
+  free(nodes);
+  free(sources);
+  aiReleaseImport(scene);
+
+  if (has_hash && !mesh_cache_write(cache_path, source_hash, IMPORT_FLAGS, pipeline_hash, directory, model))
+  {
+    fprintf(stderr, "Cannot write mesh cache %s\n", cache_path);
+  }
+  _release_geometry(model, options->geometry);
+
+  free(directory);
+  free(cache_path);
+}
+
+void model_deinit(model_t *model)
+{
+  if (model == NULL)
+  {
+    return;
+  }
+
+  for (size_t i = 0; i < TEXTURE_TYPES_SIZE; i++)
+  {
+    texture_pack_deinit(&model->packs[i]);
+  }
+
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    mesh_t *mesh = &model->meshes[i];
+    mesh_deinit(mesh);
+    for (size_t j = 0; j < mesh->textures_size; j++)
+    {
+      texture_cache_release(mesh->textures[j].handle);
+    }
+  }
+
+  gpu_cull_set_deinit(&model->cull);
+  glDeleteBuffers(1, &model->command_buffer);
+  glDeleteBuffers(1, &model->mesh_buffer);
+  glDeleteBuffers(1, &model->bone_buffer);
+  glDeleteBuffers(1, &model->instance_meshes);
+  glDeleteBuffers(1, &model->instance_vbo);
+  free(model->commands);
+  arena_deinit(&model->geometry);
+  arena_deinit(&model->arena);
+  scene_graph_deinit(&model->graph);
+  mesh_cache_close(&model->cache);
+}
+
+void model_set_transform(model_t *model, mat4 transform)
+{
+  scene_graph_set_local(&model->graph, MODEL_ROOT_NODE, transform);
+}
+
+// the next draws skin with clip at time, looping
+void model_set_pose(model_t *model, size_t clip, float time)
+{
+  if (clip >= model->clips_size)
+  {
+    return;
+  }
+
+  animation_sample(&model->clips[clip], model->bones_size, time, true, model->palette);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->bone_buffer);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, model->bones_size * sizeof(mat4), model->palette);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// every mesh streams its textures as if its largest instance sat on the bounds
+// of the whole model as close to the camera as they get, which does not look
+// at the instances and asks for no less than any of them needs
+static void _stream_model_textures(model_t const *model, camera_t *camera, float viewport_height)
+{
+  if (bounds_is_empty(&model->bounds))
+  {
+    return;
+  }
+
+  vec4 *root = model->graph.worlds[MODEL_ROOT_NODE];
+  float scale = _max_scale(root);
+  vec3 center, towards;
+  glm_mat4_mulv3(root, (float *)model->bounds.center, 1.f, center);
+  glm_vec3_sub(camera->pos, center, towards);
+  float distance = glm_vec3_norm(towards);
+  if (distance > 0.f)
+  {
+    glm_vec3_scale(towards, glm_min(model->bounds.radius * scale, distance) / distance, towards);
+    glm_vec3_add(center, towards, center);
+  }
+
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    mesh_t const *mesh = &model->meshes[i];
+    float radius = mesh->bounds.radius * model->mesh_scales[i] * scale;
+    mesh_stream_textures(mesh, cam_projected_radius(camera, center, radius), viewport_height);
+  }
+}
+
+// the instance buffer holds the matrices in instance order, so the cpu only
+// touches them when the graph moved and the compute pass writes the commands
+static void _draw_gpu_culled(model_t *model, shader_t *shader, camera_t *camera, mat4 projection, float viewport_height)
+{
+  if (scene_graph_update(&model->graph) || model->instances_dirty)
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, model->instance_vbo);
+    mat4 *matrices = glMapBufferRange(
+        GL_ARRAY_BUFFER, 0, model->instances_size * sizeof(mat4), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (matrices != NULL)
+    {
+      for (size_t i = 0; i < model->instances_size; i++)
+      {
+        memcpy(matrices[i], model->graph.worlds[model->instances[i].node], sizeof(mat4));
+      }
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      model->instances_dirty = false;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  _stream_model_textures(model, camera, viewport_height);
+  gpu_cull_dispatch(&model->cull, model->instance_vbo, model->instance_meshes, camera, projection, model->lod_screen_error);
+
+  shader_use(shader);
+  mesh_bind_packs(model->packed ? model->packs : NULL, shader);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BONE_BINDING, model->bone_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_DATA_BINDING, model->mesh_buffer);
+  geometry_buffer_set_instances(model->instance_vbo, model->instance_meshes);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, model->cull.commands);
+  glBindBuffer(GL_PARAMETER_BUFFER, model->cull.counts);
+
+  size_t batch = 0;
+  for (size_t k = 0; k < model->meshes_size; batch++)
+  {
+    size_t end = k + 1;
+    while (end < model->meshes_size && _same_batch(model, end))
+    {
+      end++;
+    }
+
+    mesh_t const *mesh = &model->meshes[model->draw_order[k]];
+    gpu_cull_batch_t const *cull_batch = &model->cull_batches[batch];
+    mesh_bind_textures(mesh, shader);
+    mesh_draw_indirect_count(mesh, cull_batch->first_command, batch, cull_batch->capacity);
+    k = end;
+  }
+  glBindBuffer(GL_PARAMETER_BUFFER, 0);
+  glBindVertexArray(0);
+}
+
+// a packed model draws a run of meshes of one format and index type with a
+// single multi draw, an unpacked one binds the textures of every mesh between draws
+void model_draw(model_t *model, shader_t *shader, camera_t *camera, mat4 projection)
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if (model->gpu_culled)
+  {
+    _draw_gpu_culled(model, shader, camera, projection, viewport[3]);
+    return;
+  }
+
+  bool moved = scene_graph_update(&model->graph);
+  _upload_instances(model, camera, viewport[3], moved);
+  _build_commands(model, camera, projection);
+  mesh_bind_packs(model->packed ? model->packs : NULL, shader);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BONE_BINDING, model->bone_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_DATA_BINDING, model->mesh_buffer);
+  geometry_buffer_set_instances(model->instance_vbo, model->instance_meshes);
+
+  for (size_t k = 0; k < model->meshes_size;)
+  {
+    size_t end = k + 1;
+    while (end < model->meshes_size && _same_batch(model, end))
+    {
+      end++;
+    }
+
+    mesh_t const *mesh = &model->meshes[model->draw_order[k]];
+    mesh_bind_textures(mesh, shader);
+    mesh_draw_indirect(mesh, model->mesh_commands[k], model->mesh_commands[end] - model->mesh_commands[k]);
+    k = end;
   }
+  glBindVertexArray(0);
 }
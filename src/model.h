@@ -1,19 +1,131 @@
 #if !defined(_MODEL_H_)
 #define _MODEL_H_
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
+#include <cglm/types.h>
+
+#include "animation.h"
+#include "arena.h"
+#include "camera.h"
+#include "gpu_cull.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "scene_graph.h"
 #include "shader.h"
 
+#define MODEL_ROOT_NODE 0
+
+// what the cpu keeps of the geometry once it is on the gpu, positions keeps
+// positions and indices for culling and picking on the cpu
+enum model_geometry
+{
+  MODEL_GEOMETRY_KEEP,
+  MODEL_GEOMETRY_DROP,
+  MODEL_GEOMETRY_POSITIONS,
+};
+
+// post import steps, all of them but pack_textures, geometry and gpu_culling are part of the mesh cache key.
+// lod_errors is the error budget of every level after the first relative to
+// the mesh radius, lod_screen_error the error allowed on screen as a fraction
+// of half the viewport height. meshlets splits full detail into clusters that
+// are culled one by one. pack_textures puts the textures of every type into
+// one array for the whole model instead of streaming them one by one, built
+// on the gl thread while loading and resident outside the streaming budget.
+// gpu_culling culls and picks levels in a compute pass when gpu_cull_init
+// succeeded, which gives up meshlets
+typedef struct model_options
+{
+  bool optimize, meshlets;
+  size_t lods_size;
+  float lod_errors[MESH_LOD_MAX - 1];
+  float lod_screen_error;
+  bool pack_textures;
+  enum model_geometry geometry;
+  bool gpu_culling;
+} model_options_t;
+
+#define MODEL_OPTIONS_DEFAULT ((model_options_t){ \
+    .optimize = true,                            \
+    .meshlets = true,                            \
+    .lods_size = MESH_LOD_MAX,                   \
+    .lod_errors = {.005f, .02f, .08f},           \
+    .lod_screen_error = .002f,                   \
+    .pack_textures = false,                      \
+    .geometry = MODEL_GEOMETRY_KEEP,             \
+    .gpu_culling = false,                        \
+})
+
+typedef struct model_instance
+{
+  uint32_t mesh, node;
+} model_instance_t;
+
+// instances are grouped by mesh, mesh i owns [mesh_instances[i], mesh_instances[i + 1]).
+// every frame they are regrouped by lod inside that range, level l of mesh i draws
+// [lod_instances[i * (MESH_LOD_MAX + 1) + l], lod_instances[i * (MESH_LOD_MAX + 1) + l + 1]),
+// slot_instances maps every slot of the instance buffer back to its instance,
+// instance_meshes to the mesh that owns the slot.
+// meshes draw in draw_order, sorted by vertex format and index type, the one at
+// k from [mesh_commands[k], mesh_commands[k + 1]) of the command buffer. a level
+// takes one command per segment, full detail meshes with meshlets one per
+// visible meshlet of every instance. consecutive meshes that share format and
+// index type draw with one multi draw when nothing else tells them apart,
+// which is when the model is packed. mesh_buffer holds their mesh_gpu_data_t.
+// bounds hold every instance in model space, before the root transform.
+// a packed model binds packs once and its meshes only pick their regions.
+// the meshes, their meshlets and textures and the instance arrays all live in
+// arena and go away together, imported vertices and indices live in geometry
+// so that they can be dropped on their own.
+// instances_dirty forces the next draw to rewrite the instance buffer even
+// when the graph did not move. a gpu culled model keeps that buffer in
+// instance order, cull_batches are where the commands of every batch go in
+// cull.commands and mesh_scales the largest scale of the instances of every
+// mesh relative to the root.
+// skinned meshes are instanced at the root, their vertices reach model space
+// through palette, the bind pose until a clip is sampled into it, and the
+// bone buffer holds what the gpu skins with
 typedef struct model
 {
   mesh_t *meshes;
   size_t meshes_size;
+  model_instance_t *instances;
+  uint32_t *mesh_instances;
+  uint32_t *lod_instances;
+  uint8_t *instance_lods;
+  uint32_t *slot_instances;
+  size_t instances_size;
+  float lod_screen_error;
+  mesh_draw_command_t *commands;
+  size_t *mesh_commands;
+  uint32_t *draw_order;
+  size_t commands_capacity, batches_size;
+  GLuint instance_vbo, instance_meshes, command_buffer, mesh_buffer;
+  bounds_t bounds;
+  texture_pack_t packs[TEXTURE_TYPES_SIZE];
+  bool packed;
+  animation_bone_t *bones;
+  size_t bones_size;
+  animation_clip_t *clips;
+  size_t clips_size;
+  mat4 *palette;
+  GLuint bone_buffer;
+  gpu_cull_set_t cull;
+  gpu_cull_batch_t *cull_batches;
+  float *mesh_scales;
+  bool gpu_culled, instances_dirty;
+  scene_graph_t graph;
+  mesh_cache_t cache;
+  arena_t arena, geometry;
 } model_t;
 
-void model_init(char const *model_path, model_t *model);
+void model_init(char const *model_path, model_options_t const *options, model_t *model);
+#define model_init_defaults(model_path, model) model_init(model_path, &MODEL_OPTIONS_DEFAULT, model)
 void model_deinit(model_t *model);
-void model_draw(model_t *model, shader_t *shader);
+void model_set_transform(model_t *model, mat4 transform);
+void model_set_pose(model_t *model, size_t clip, float time);
+void model_draw(model_t *model, shader_t *shader, camera_t *camera, mat4 projection);
 
 #endif // _MODEL_H_
@@ -0,0 +1,111 @@
+#include "model_io.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fs.h"
+
+typedef struct mapped_file
+{
+  struct aiFile file;
+  fs_mapping_t mapping;
+  size_t cursor;
+} mapped_file_t;
+
+static mapped_file_t *_mapped(struct aiFile *file)
+{
+  return (mapped_file_t *)file->UserData;
+}
+
+static size_t _read(struct aiFile *file, char *buffer, size_t size, size_t count)
+{
+  mapped_file_t *mapped = _mapped(file);
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  size_t available = (mapped->mapping.size - mapped->cursor) / size;
+  count = count < available ? count : available;
+  memcpy(buffer, (char const *)mapped->mapping.data + mapped->cursor, count * size);
+  mapped->cursor += count * size;
+  return count;
+}
+
+static size_t _write(struct aiFile *file, char const *buffer, size_t size, size_t count)
+{
+  return 0;
+}
+
+static size_t _tell(struct aiFile *file)
+{
+  return _mapped(file)->cursor;
+}
+
+static size_t _size(struct aiFile *file)
+{
+  return _mapped(file)->mapping.size;
+}
+
+static aiReturn _seek(struct aiFile *file, size_t offset, enum aiOrigin origin)
+{
+  mapped_file_t *mapped = _mapped(file);
+  size_t base = origin == aiOrigin_CUR ? mapped->cursor : origin == aiOrigin_END ? mapped->mapping.size : 0;
+  if (offset > mapped->mapping.size - base)
+  {
+    return aiReturn_FAILURE;
+  }
+
+  mapped->cursor = base + offset;
+  return aiReturn_SUCCESS;
+}
+
+static void _flush(struct aiFile *file)
+{
+}
+
+static struct aiFile *_open(struct aiFileIO *io, char const *path, char const *mode)
+{
+  if (strpbrk(mode, "wa+") != NULL)
+  {
+    return NULL;
+  }
+
+  fs_mapping_t mapping;
+  if (!fs_map(path, &mapping))
+  {
+    return NULL;
+  }
+
+  mapped_file_t *mapped = calloc(1, sizeof(mapped_file_t));
+  assert(mapped != NULL);
+  mapped->mapping = mapping;
+  mapped->file = (struct aiFile){
+      .ReadProc = _read,
+      .WriteProc = _write,
+      .TellProc = _tell,
+      .FileSizeProc = _size,
+      .SeekProc = _seek,
+      .FlushProc = _flush,
+      .UserData = (aiUserData)mapped,
+  };
+  return &mapped->file;
+}
+
+static void _close(struct aiFileIO *io, struct aiFile *file)
+{
+  if (file == NULL)
+  {
+    return;
+  }
+
+  mapped_file_t *mapped = _mapped(file);
+  fs_unmap(&mapped->mapping);
+  free(mapped);
+}
+
+void model_io_init(struct aiFileIO *io)
+{
+  *io = (struct aiFileIO){.OpenProc = _open, .CloseProc = _close, .UserData = NULL};
+}
@@ -0,0 +1,10 @@
+#if !defined(_MODEL_IO_H_)
+#define _MODEL_IO_H_
+
+#include <assimp/cfileio.h>
+
+// read only assimp io that maps every file it opens instead of reading it
+// through stdio, so imports skip the extra buffering and read calls
+void model_io_init(struct aiFileIO *io);
+
+#endif // _MODEL_IO_H_
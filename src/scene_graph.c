@@ -0,0 +1,96 @@
+#include "scene_graph.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cglm/cglm.h>
+
+void scene_graph_init(size_t nodes_size, scene_graph_t *graph)
+{
+  graph->parents = malloc(nodes_size * sizeof(int32_t));
+  graph->locals = malloc(nodes_size * sizeof(mat4));
+  graph->worlds = malloc(nodes_size * sizeof(mat4));
+  graph->dirty = malloc(nodes_size * sizeof(bool));
+  assert(nodes_size == 0 || (graph->parents != NULL && graph->locals != NULL && graph->worlds != NULL && graph->dirty != NULL));
+
+  for (size_t i = 0; i < nodes_size; i++)
+  {
+    graph->parents[i] = SCENE_GRAPH_NO_PARENT;
+    glm_mat4_identity(graph->locals[i]);
+    glm_mat4_identity(graph->worlds[i]);
+    graph->dirty[i] = true;
+  }
+
+  graph->nodes_size = nodes_size;
+  graph->first_dirty = 0;
+}
+
+void scene_graph_deinit(scene_graph_t *graph)
+{
+  if (graph == NULL)
+  {
+    return;
+  }
+
+  free(graph->dirty);
+  free(graph->worlds);
+  free(graph->locals);
+  free(graph->parents);
+  memset(graph, 0, sizeof(scene_graph_t));
+}
+
+void scene_graph_set_node(scene_graph_t *graph, size_t node, int32_t parent, mat4 local)
+{
+  assert(parent < (int32_t)node);
+  graph->parents[node] = parent;
+  scene_graph_set_local(graph, node, local);
+}
+
+void scene_graph_set_local(scene_graph_t *graph, size_t node, mat4 local)
+{
+  glm_mat4_copy(local, graph->locals[node]);
+  graph->dirty[node] = true;
+  if (node < graph->first_dirty)
+  {
+    graph->first_dirty = node;
+  }
+}
+
+// a single forward pass from the first dirty node, dirtiness flows from
+// parents to children because parents always come first
+bool scene_graph_update(scene_graph_t *graph)
+{
+  size_t first = graph->first_dirty;
+  if (first >= graph->nodes_size)
+  {
+    return false;
+  }
+
+  for (size_t i = first; i < graph->nodes_size; i++)
+  {
+    int32_t parent = graph->parents[i];
+    if (parent != SCENE_GRAPH_NO_PARENT && graph->dirty[parent])
+    {
+      graph->dirty[i] = true;
+    }
+
+    if (!graph->dirty[i])
+    {
+      continue;
+    }
+
+    if (parent == SCENE_GRAPH_NO_PARENT)
+    {
+      glm_mat4_copy(graph->locals[i], graph->worlds[i]);
+    }
+    else
+    {
+      glm_mat4_mul(graph->worlds[parent], graph->locals[i], graph->worlds[i]);
+    }
+  }
+
+  memset(&graph->dirty[first], 0, (graph->nodes_size - first) * sizeof(bool));
+  graph->first_dirty = graph->nodes_size;
+  return true;
+}
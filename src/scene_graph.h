@@ -0,0 +1,27 @@
+#if !defined(_SCENE_GRAPH_H_)
+#define _SCENE_GRAPH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cglm/types.h>
+
+#define SCENE_GRAPH_NO_PARENT -1
+
+// nodes are stored in topological order, a parent always precedes its children
+typedef struct scene_graph
+{
+  int32_t *parents;
+  mat4 *locals, *worlds;
+  bool *dirty;
+  size_t nodes_size, first_dirty;
+} scene_graph_t;
+
+void scene_graph_init(size_t nodes_size, scene_graph_t *graph);
+void scene_graph_deinit(scene_graph_t *graph);
+void scene_graph_set_node(scene_graph_t *graph, size_t node, int32_t parent, mat4 local);
+void scene_graph_set_local(scene_graph_t *graph, size_t node, mat4 local);
+bool scene_graph_update(scene_graph_t *graph);
+
+#endif // _SCENE_GRAPH_H_
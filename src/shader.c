@@ -1,10 +1,14 @@
 #include "shader.h"
 
+#include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "fs.h"
 
+#define EMPTY_SLOT UINT32_MAX
+
 static bool _compile_shader(char const *filename, GLenum shader_type, GLuint *shader)
 {
   char *shader_source = fs_read_as_text(filename);
@@ -35,11 +39,13 @@ static bool _compile_shader(char const *filename, GLenum shader_type, GLuint *sh
   return true;
 }
 
-static bool _compile_program(GLuint vertex, GLuint frag, GLuint *program)
+static bool _compile_program(GLuint const *shaders, size_t shaders_size, GLuint *program)
 {
   GLuint new_program = glCreateProgram();
-  glAttachShader(new_program, vertex);
-  glAttachShader(new_program, frag);
+  for (size_t i = 0; i < shaders_size; i++)
+  {
+    glAttachShader(new_program, shaders[i]);
+  }
   glLinkProgram(new_program);
 
   int success;
@@ -58,8 +64,167 @@ static bool _compile_program(GLuint vertex, GLuint frag, GLuint *program)
   return true;
 }
 
+static uint32_t _find_slot(shader_t const *shader, char const *name, size_t length, uint64_t hash)
+{
+  size_t mask = shader->slots_size - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask)
+  {
+    uint32_t index = shader->slots[i];
+    if (index == EMPTY_SLOT)
+    {
+      return EMPTY_SLOT;
+    }
+
+    shader_uniform_t const *uniform = &shader->uniforms[index];
+    if (uniform->hash == hash && strncmp(uniform->name, name, length) == 0 && uniform->name[length] == 0)
+    {
+      return index;
+    }
+  }
+}
+
+// an element past the first of a basic array is found through the array
+static shader_uniform_t *_find_uniform(shader_t const *shader, char const *property, GLint *location)
+{
+  if (shader->slots_size == 0)
+  {
+    return NULL;
+  }
+
+  size_t length = strlen(property);
+  uint32_t index = _find_slot(shader, property, length, fs_hash(property, length, 0));
+  if (index != EMPTY_SLOT)
+  {
+    *location = shader->uniforms[index].location;
+    return &shader->uniforms[index];
+  }
+
+  char const *bracket = strrchr(property, '[');
+  if (bracket == NULL || length == 0 || property[length - 1] != ']')
+  {
+    return NULL;
+  }
+
+  char *end;
+  unsigned long element = strtoul(bracket + 1, &end, 10);
+  length = bracket - property;
+  index = _find_slot(shader, property, length, fs_hash(property, length, 0));
+  if (index == EMPTY_SLOT || end != &property[strlen(property) - 1] || element >= (unsigned long)shader->uniforms[index].size)
+  {
+    return NULL;
+  }
+
+  *location = shader->uniforms[index].location + (GLint)element;
+  return &shader->uniforms[index];
+}
+
+static bool _is_int_type(GLenum type)
+{
+  switch (type)
+  {
+  case GL_INT:
+  case GL_BOOL:
+  case GL_SAMPLER_2D:
+  case GL_SAMPLER_2D_ARRAY:
+  case GL_SAMPLER_3D:
+  case GL_SAMPLER_CUBE:
+  case GL_SAMPLER_2D_SHADOW:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+static GLint _resolve(shader_t const *shader, char const *property, GLenum type)
+{
+  GLint location = -1;
+  shader_uniform_t *uniform = _find_uniform(shader, property, &location);
+  if (uniform == NULL)
+  {
+    return -1;
+  }
+
+  bool matches = type == GL_INT ? _is_int_type(uniform->type) : uniform->type == type;
+  if (!matches)
+  {
+    if (!uniform->mismatch_reported)
+    {
+      fprintf(stderr, "Uniform %s is not of type 0x%x\n", property, type);
+      uniform->mismatch_reported = true;
+    }
+    return -1;
+  }
+
+  return location;
+}
+
+// block members have no location of their own and are left out
+static void _reflect(shader_t *shader)
+{
+  GLuint program = shader->program_id;
+  GLint uniforms_size = 0, name_size = 0;
+  glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniforms_size);
+  glGetProgramInterfaceiv(program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &name_size);
+
+  shader->uniforms = calloc(uniforms_size, sizeof(shader_uniform_t));
+  char *name = malloc(name_size + 1);
+  assert((uniforms_size == 0 || shader->uniforms != NULL) && name != NULL);
+
+  GLenum const properties[] = {GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE};
+  for (GLint i = 0; i < uniforms_size; i++)
+  {
+    GLint values[3];
+    glGetProgramResourceiv(program, GL_UNIFORM, i, 3, properties, 3, NULL, values);
+    if (values[0] < 0)
+    {
+      continue;
+    }
+
+    GLsizei length = 0;
+    glGetProgramResourceName(program, GL_UNIFORM, i, name_size + 1, &length, name);
+    if (length > 3 && strcmp(&name[length - 3], "[0]") == 0)
+    {
+      length -= 3;
+      name[length] = 0;
+    }
+
+    shader_uniform_t *uniform = &shader->uniforms[shader->uniforms_size++];
+    uniform->name = strdup(name);
+    assert(uniform->name != NULL);
+    uniform->hash = fs_hash(name, length, 0);
+    uniform->location = values[0];
+    uniform->type = values[1];
+    uniform->size = values[2];
+  }
+  free(name);
+
+  // at most half full so that probes stay short
+  shader->slots_size = 8;
+  while (shader->slots_size < shader->uniforms_size * 2)
+  {
+    shader->slots_size <<= 1;
+  }
+
+  shader->slots = malloc(shader->slots_size * sizeof(uint32_t));
+  assert(shader->slots != NULL);
+  memset(shader->slots, 0xff, shader->slots_size * sizeof(uint32_t));
+  for (size_t i = 0; i < shader->uniforms_size; i++)
+  {
+    size_t mask = shader->slots_size - 1;
+    size_t slot = shader->uniforms[i].hash & mask;
+    while (shader->slots[slot] != EMPTY_SLOT)
+    {
+      slot = (slot + 1) & mask;
+    }
+    shader->slots[slot] = i;
+  }
+}
+
 bool shader_init(char const *vertex_path, char const *frag_path, shader_t *shader)
 {
+  memset(shader, 0, sizeof(shader_t));
+
   GLuint vertex, frag;
   if (!_compile_shader(vertex_path, GL_VERTEX_SHADER, &vertex))
   {
@@ -74,7 +239,7 @@ bool shader_init(char const *vertex_path, char const *frag_path, shader_t *shade
     return false;
   }
 
-  bool result = _compile_program(vertex, frag, &shader->program_id);
+  bool result = _compile_program((GLuint[]){vertex, frag}, 2, &shader->program_id);
   glDeleteShader(vertex);
   glDeleteShader(frag);
   if (!result)
@@ -83,12 +248,48 @@ bool shader_init(char const *vertex_path, char const *frag_path, shader_t *shade
     return false;
   }
 
+  _reflect(shader);
+  return true;
+}
+
+bool shader_init_compute(char const *compute_path, shader_t *shader)
+{
+  memset(shader, 0, sizeof(shader_t));
+
+  GLuint compute;
+  if (!_compile_shader(compute_path, GL_COMPUTE_SHADER, &compute))
+  {
+    fprintf(stderr, "Cannot compile shader %s\n", compute_path);
+    return false;
+  }
+
+  bool result = _compile_program(&compute, 1, &shader->program_id);
+  glDeleteShader(compute);
+  if (!result)
+  {
+    fputs("Cannot compile shader program", stderr);
+    return false;
+  }
+
+  _reflect(shader);
   return true;
 }
 
 void shader_deinit(shader_t *shader)
 {
+  if (shader == NULL)
+  {
+    return;
+  }
+
   glDeleteProgram(shader->program_id);
+  for (size_t i = 0; i < shader->uniforms_size; i++)
+  {
+    free(shader->uniforms[i].name);
+  }
+  free(shader->slots);
+  free(shader->uniforms);
+  memset(shader, 0, sizeof(shader_t));
 }
 
 void shader_use(shader_t *shader)
@@ -96,27 +297,87 @@ void shader_use(shader_t *shader)
   glUseProgram(shader->program_id);
 }
 
+shader_int_t shader_resolve_int(shader_t const *shader, char const *property)
+{
+  return (shader_int_t){_resolve(shader, property, GL_INT)};
+}
+
+shader_float_t shader_resolve_float(shader_t const *shader, char const *property)
+{
+  return (shader_float_t){_resolve(shader, property, GL_FLOAT)};
+}
+
+shader_vec3_t shader_resolve_vec3(shader_t const *shader, char const *property)
+{
+  return (shader_vec3_t){_resolve(shader, property, GL_FLOAT_VEC3)};
+}
+
+shader_vec4_t shader_resolve_vec4(shader_t const *shader, char const *property)
+{
+  return (shader_vec4_t){_resolve(shader, property, GL_FLOAT_VEC4)};
+}
+
+shader_mat4_t shader_resolve_mat4(shader_t const *shader, char const *property)
+{
+  return (shader_mat4_t){_resolve(shader, property, GL_FLOAT_MAT4)};
+}
+
+void shader_put_int(shader_int_t uniform, int value)
+{
+  glUniform1i(uniform.location, value);
+}
+
+void shader_put_bool(shader_int_t uniform, bool value)
+{
+  glUniform1i(uniform.location, (int)value);
+}
+
+void shader_put_float(shader_float_t uniform, float value)
+{
+  glUniform1f(uniform.location, value);
+}
+
+void shader_put_vec3(shader_vec3_t uniform, vec3 vector)
+{
+  glUniform3fv(uniform.location, 1, vector);
+}
+
+void shader_put_vec4(shader_vec4_t uniform, vec4 vector)
+{
+  glUniform4fv(uniform.location, 1, vector);
+}
+
+void shader_put_mat4(shader_mat4_t uniform, mat4 matrix)
+{
+  glUniformMatrix4fv(uniform.location, 1, GL_FALSE, (GLfloat const *)matrix);
+}
+
 void shader_set_int(shader_t *shader, char const *property, int value)
 {
-  glUniform1i(glGetUniformLocation(shader->program_id, property), value);
+  shader_put_int(shader_resolve_int(shader, property), value);
 }
 
 void shader_set_bool(shader_t *shader, char const *property, bool value)
 {
-  shader_set_int(shader, property, (int)value);
+  shader_put_bool(shader_resolve_int(shader, property), value);
 }
 
 void shader_set_float(shader_t *shader, char const *property, float value)
 {
-  glUniform1f(glGetUniformLocation(shader->program_id, property), value);
+  shader_put_float(shader_resolve_float(shader, property), value);
 }
 
 void shader_set_vec3(shader_t *shader, char const *property, vec3 vector)
 {
-  glUniform3fv(glGetUniformLocation(shader->program_id, property), 1, vector);
+  shader_put_vec3(shader_resolve_vec3(shader, property), vector);
+}
+
+void shader_set_vec4(shader_t *shader, char const *property, vec4 vector)
+{
+  shader_put_vec4(shader_resolve_vec4(shader, property), vector);
 }
 
 void shader_set_mat4(shader_t *shader, char const *property, mat4 matrix)
 {
-  glUniformMatrix4fv(glGetUniformLocation(shader->program_id, property), 1, GL_FALSE, (GLfloat const *)matrix);
+  shader_put_mat4(shader_resolve_mat4(shader, property), matrix);
 }
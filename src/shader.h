@@ -2,22 +2,87 @@
 #define _SHADER_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include <glad/gl.h>
 #include <cglm/types.h>
 
+// an active uniform of the linked program, an array of a basic type is one
+// uniform named without its [0] whose elements follow location.
+// mismatch_reported keeps a setter of the wrong type from logging every call
+typedef struct shader_uniform
+{
+  char *name;
+  uint64_t hash;
+  GLint location, size;
+  GLenum type;
+  bool mismatch_reported;
+} shader_uniform_t;
+
+// uniforms are reflected once after linking, slots is an open addressed table
+// of indices into uniforms keyed by the hash of their names
 typedef struct shader
 {
   GLuint program_id;
+  shader_uniform_t *uniforms;
+  size_t uniforms_size;
+  uint32_t *slots;
+  size_t slots_size;
 } shader_t;
 
+// handles are resolved once and set without any lookup, an inactive uniform
+// or one of another type resolves to location -1 which gl ignores.
+// ints also set bools and samplers, but not uints which glUniform1i rejects
+typedef struct shader_int
+{
+  GLint location;
+} shader_int_t;
+
+typedef struct shader_float
+{
+  GLint location;
+} shader_float_t;
+
+typedef struct shader_vec3
+{
+  GLint location;
+} shader_vec3_t;
+
+typedef struct shader_vec4
+{
+  GLint location;
+} shader_vec4_t;
+
+typedef struct shader_mat4
+{
+  GLint location;
+} shader_mat4_t;
+
 bool shader_init(char const *vertex_path, char const *frag_path, shader_t *shader);
+bool shader_init_compute(char const *compute_path, shader_t *shader);
 void shader_deinit(shader_t *shader);
 void shader_use(shader_t *shader);
+
+shader_int_t shader_resolve_int(shader_t const *shader, char const *property);
+shader_float_t shader_resolve_float(shader_t const *shader, char const *property);
+shader_vec3_t shader_resolve_vec3(shader_t const *shader, char const *property);
+shader_vec4_t shader_resolve_vec4(shader_t const *shader, char const *property);
+shader_mat4_t shader_resolve_mat4(shader_t const *shader, char const *property);
+
+void shader_put_int(shader_int_t uniform, int value);
+void shader_put_bool(shader_int_t uniform, bool value);
+void shader_put_float(shader_float_t uniform, float value);
+void shader_put_vec3(shader_vec3_t uniform, vec3 vector);
+void shader_put_vec4(shader_vec4_t uniform, vec4 vector);
+void shader_put_mat4(shader_mat4_t uniform, mat4 matrix);
+
+// look the uniform up in the table on every call, for anything off the hot path
 void shader_set_int(shader_t *shader, char const *property, int value);
 void shader_set_bool(shader_t *shader, char const *property, bool value);
 void shader_set_float(shader_t *shader, char const *property, float value);
 void shader_set_vec3(shader_t *shader, char const *property, vec3 vector);
+void shader_set_vec4(shader_t *shader, char const *property, vec4 vector);
 void shader_set_mat4(shader_t *shader, char const *property, mat4 matrix);
 
 #endif // _SHADER_H_
@@ -0,0 +1,154 @@
+#include "skinning.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <cglm/cglm.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+typedef struct skinning_context
+{
+  skinning_job_t const *jobs;
+  size_t jobs_size;
+  size_t *first_blocks;
+} skinning_context_t;
+
+void skinning_add_influence(vertex_t *vertex, int bone, float weight)
+{
+  size_t weakest = 0;
+  for (size_t i = 1; i < MAX_BONE_INFLUENCE; i++)
+  {
+    if (vertex->weights[i] < vertex->weights[weakest])
+    {
+      weakest = i;
+    }
+  }
+
+  if (weight > vertex->weights[weakest])
+  {
+    vertex->bone_ids[weakest] = bone;
+    vertex->weights[weakest] = weight;
+  }
+}
+
+void skinning_normalize(vertex_t *vertex)
+{
+  float sum = 0.f;
+  for (size_t i = 0; i < MAX_BONE_INFLUENCE; i++)
+  {
+    sum += vertex->weights[i];
+  }
+
+  if (sum <= 0.f)
+  {
+    return;
+  }
+
+  for (size_t i = 0; i < MAX_BONE_INFLUENCE; i++)
+  {
+    vertex->weights[i] /= sum;
+  }
+}
+
+#if defined(__SSE__)
+static void _skin_vertex(vertex_t const *vertex, mat4 const *palette, vec3 position, vec3 normal)
+{
+  __m128 columns[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+  for (size_t i = 0; i < MAX_BONE_INFLUENCE; i++)
+  {
+    if (vertex->weights[i] <= 0.f)
+    {
+      continue;
+    }
+
+    __m128 weight = _mm_set1_ps(vertex->weights[i]);
+    vec4 const *bone = palette[vertex->bone_ids[i]];
+    for (size_t c = 0; c < 4; c++)
+    {
+      columns[c] = _mm_add_ps(columns[c], _mm_mul_ps(_mm_loadu_ps(bone[c]), weight));
+    }
+  }
+
+  __m128 p = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(vertex->position[0])), _mm_mul_ps(columns[1], _mm_set1_ps(vertex->position[1]))),
+      _mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(vertex->position[2])), columns[3]));
+  __m128 n = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(vertex->normal[0])), _mm_mul_ps(columns[1], _mm_set1_ps(vertex->normal[1]))),
+      _mm_mul_ps(columns[2], _mm_set1_ps(vertex->normal[2])));
+
+  vec4 result;
+  _mm_storeu_ps(result, p);
+  glm_vec3_copy(result, position);
+  _mm_storeu_ps(result, n);
+  glm_vec3_normalize_to(result, normal);
+}
+#else
+static void _skin_vertex(vertex_t const *vertex, mat4 const *palette, vec3 position, vec3 normal)
+{
+  mat4 skin = GLM_MAT4_ZERO_INIT;
+  for (size_t i = 0; i < MAX_BONE_INFLUENCE; i++)
+  {
+    if (vertex->weights[i] <= 0.f)
+    {
+      continue;
+    }
+
+    vec4 const *bone = palette[vertex->bone_ids[i]];
+    for (size_t c = 0; c < 4; c++)
+    {
+      glm_vec4_muladds((float *)bone[c], vertex->weights[i], skin[c]);
+    }
+  }
+
+  glm_mat4_mulv3(skin, (float *)vertex->position, 1.f, position);
+  glm_mat4_mulv3(skin, (float *)vertex->normal, 0.f, normal);
+  glm_vec3_normalize(normal);
+}
+#endif
+
+static void _skin_block(void *data, size_t index)
+{
+  skinning_context_t const *context = data;
+
+  // the last job whose first block is at most index
+  size_t low = 0, high = context->jobs_size;
+  while (high - low > 1)
+  {
+    size_t middle = (low + high) / 2;
+    if (context->first_blocks[middle] <= index)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  skinning_job_t const *job = &context->jobs[low];
+  size_t first = (index - context->first_blocks[low]) * SKINNING_BLOCK_SIZE;
+  size_t last = first + SKINNING_BLOCK_SIZE < job->vertices_size ? first + SKINNING_BLOCK_SIZE : job->vertices_size;
+  for (size_t i = first; i < last; i++)
+  {
+    _skin_vertex(&job->vertices[i], job->palette, job->positions[i], job->normals[i]);
+  }
+}
+
+void skinning_cpu(thread_pool_t *pool, skinning_job_t const *jobs, size_t jobs_size)
+{
+  size_t *first_blocks = malloc((jobs_size + 1) * sizeof(size_t));
+  assert(first_blocks != NULL);
+
+  first_blocks[0] = 0;
+  for (size_t i = 0; i < jobs_size; i++)
+  {
+    first_blocks[i + 1] = first_blocks[i] + (jobs[i].vertices_size + SKINNING_BLOCK_SIZE - 1) / SKINNING_BLOCK_SIZE;
+  }
+
+  skinning_context_t context = {.jobs = jobs, .jobs_size = jobs_size, .first_blocks = first_blocks};
+  thread_pool_for(pool, first_blocks[jobs_size], _skin_block, &context);
+  free(first_blocks);
+}
@@ -0,0 +1,34 @@
+#if !defined(_SKINNING_H_)
+#define _SKINNING_H_
+
+#include <stddef.h>
+
+#include <cglm/types.h>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+// shader storage binding of the palette the vertex shader skins with
+#define SKINNING_BONE_BINDING 0
+#define SKINNING_BLOCK_SIZE 1024
+
+// a palette holds one model space matrix per bone, its world transform times
+// its inverse bind pose. a vertex moves by the weighted sum of the matrices of
+// its bones, normals by the upper 3x3 of that sum
+typedef struct skinning_job
+{
+  vertex_t const *vertices;
+  size_t vertices_size;
+  mat4 const *palette;
+  vec3 *positions, *normals;
+} skinning_job_t;
+
+// keeps the MAX_BONE_INFLUENCE strongest bones of a vertex
+void skinning_add_influence(vertex_t *vertex, int bone, float weight);
+// makes the weights of a vertex sum to one
+void skinning_normalize(vertex_t *vertex);
+
+// splits every job in blocks of SKINNING_BLOCK_SIZE vertices and skins them on the pool
+void skinning_cpu(thread_pool_t *pool, skinning_job_t const *jobs, size_t jobs_size);
+
+#endif // _SKINNING_H_
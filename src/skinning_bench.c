@@ -0,0 +1,167 @@
+#include "skinning_bench.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cglm/cglm.h>
+
+#include "camera.h"
+#include "frame_uniforms.h"
+#include "model.h"
+#include "skinning.h"
+#include "timer.h"
+#include "vertex_format.h"
+
+// characters are spread over the clip so that they never share a palette
+static float _character_time(animation_clip_t const *clip, size_t character, size_t characters, size_t frame)
+{
+  return clip->duration * character / characters + frame / ANIMATION_FRAME_RATE;
+}
+
+static void _sample_palettes(model_t const *model, size_t characters, size_t frame, mat4 *palettes)
+{
+  for (size_t i = 0; i < characters; i++)
+  {
+    mat4 *palette = &palettes[i * model->bones_size];
+    if (model->clips_size == 0)
+    {
+      memcpy(palette, model->palette, model->bones_size * sizeof(mat4));
+      continue;
+    }
+
+    animation_sample(&model->clips[0], model->bones_size, _character_time(&model->clips[0], i, characters, frame), true, palette);
+  }
+}
+
+// one job per skinned mesh of every character, each with its own output
+static size_t _cpu_jobs(model_t const *model, size_t characters, mat4 const *palettes, skinning_job_t **jobs, vec3 **outputs)
+{
+  size_t meshes_size = 0, vertices_size = 0;
+  for (size_t i = 0; i < model->meshes_size; i++)
+  {
+    mesh_t const *mesh = &model->meshes[i];
+    if (mesh->format & VERTEX_FORMAT_SKINNED)
+    {
+      meshes_size++;
+      vertices_size += mesh->vertices_size;
+    }
+  }
+
+  *jobs = malloc(characters * meshes_size * sizeof(skinning_job_t));
+  *outputs = malloc(2 * characters * vertices_size * sizeof(vec3));
+  assert(characters * meshes_size == 0 || (*jobs != NULL && *outputs != NULL));
+
+  size_t jobs_size = 0;
+  vec3 *output = *outputs;
+  for (size_t i = 0; i < characters; i++)
+  {
+    for (size_t j = 0; j < model->meshes_size; j++)
+    {
+      mesh_t const *mesh = &model->meshes[j];
+      if (!(mesh->format & VERTEX_FORMAT_SKINNED))
+      {
+        continue;
+      }
+
+      (*jobs)[jobs_size++] = (skinning_job_t){
+          .vertices = mesh->vertices,
+          .vertices_size = mesh->vertices_size,
+          .palette = &palettes[i * model->bones_size],
+          .positions = output,
+          .normals = output + mesh->vertices_size,
+      };
+      output += 2 * mesh->vertices_size;
+    }
+  }
+
+  return jobs_size;
+}
+
+int skinning_bench(char const *model_path, size_t characters, size_t frames)
+{
+  model_options_t options = MODEL_OPTIONS_DEFAULT;
+  options.geometry = MODEL_GEOMETRY_KEEP;
+  model_t model;
+  model_init(model_path, &options, &model);
+  if (model.bones_size == 0 || characters == 0 || frames == 0)
+  {
+    fprintf(stderr, "%s has no bones to skin\n", model_path);
+    model_deinit(&model);
+    return 1;
+  }
+
+  shader_t shader;
+  if (!shader_init("resources/shaders/model.vert", "resources/shaders/model.frag", &shader))
+  {
+    fputs("Cannot load model shaders\n", stderr);
+    model_deinit(&model);
+    return 1;
+  }
+
+  camera_t camera;
+  vec3 position;
+  glm_vec3_add(model.bounds.center, (vec3){0.f, 0.f, model.bounds.radius * 2.5f}, position);
+  cam_init(position, (vec3){0.f, 1.f, 0.f}, (vec3){0.f, 0.f, -1.f}, DEFAULT_YAW, DEFAULT_PITCH, DEFAULT_SPEED, DEFAULT_SENSE, DEFAULT_ZOOM, &camera);
+  frame_camera_t frame_camera;
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glm_perspective(glm_rad(camera.zoom), (float)viewport[2] / (float)glm_max(viewport[3], 1), .1f, model.bounds.radius * 10.f, frame_camera.projection);
+  cam_get_view_matrix(&camera, frame_camera.view);
+  glm_vec3_copy(camera.pos, frame_camera.view_pos);
+
+  mat4 *palettes = malloc(characters * model.bones_size * sizeof(mat4));
+  assert(palettes != NULL);
+  skinning_job_t *jobs;
+  vec3 *outputs;
+  size_t jobs_size = _cpu_jobs(&model, characters, palettes, &jobs, &outputs);
+  size_t vertices_size = 0;
+  for (size_t i = 0; i < jobs_size; i++)
+  {
+    vertices_size += jobs[i].vertices_size;
+  }
+
+  thread_pool_t *pool = thread_pool_shared();
+  double sample_ms = 0., cpu_ms = 0., gpu_ms = 0.;
+  for (size_t frame = 0; frame < frames; frame++)
+  {
+    double start = timer_now();
+    _sample_palettes(&model, characters, frame, palettes);
+    sample_ms += timer_elapsed_ms(start);
+
+    start = timer_now();
+    skinning_cpu(pool, jobs, jobs_size);
+    cpu_ms += timer_elapsed_ms(start);
+
+    // every character uploads its palette and draws the whole model
+    start = timer_now();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    frame_uniforms_begin();
+    frame_uniforms_set_camera(&frame_camera);
+    shader_use(&shader);
+    for (size_t i = 0; i < characters; i++)
+    {
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, model.bone_buffer);
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, model.bones_size * sizeof(mat4), palettes[i * model.bones_size]);
+      model_draw(&model, &shader, &camera, frame_camera.projection);
+    }
+    frame_uniforms_end();
+    glFinish();
+    gpu_ms += timer_elapsed_ms(start);
+  }
+
+  printf("Skinning %zu characters of %zu bones, %zu vertices per frame over %zu frames:\n",
+         characters, model.bones_size, vertices_size, frames);
+  printf("  sample palettes %.3f ms\n", sample_ms / frames);
+  printf("  cpu skinning %.3f ms (%zu threads, %.1f M vertices/s)\n",
+         cpu_ms / frames, pool->threads_size + 1, cpu_ms > 0. ? vertices_size * frames / (cpu_ms * 1000.) : 0.);
+  printf("  gpu upload and draw %.3f ms\n", gpu_ms / frames);
+
+  free(outputs);
+  free(jobs);
+  free(palettes);
+  shader_deinit(&shader);
+  model_deinit(&model);
+  return 0;
+}
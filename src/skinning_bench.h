@@ -0,0 +1,10 @@
+#if !defined(_SKINNING_BENCH_H_)
+#define _SKINNING_BENCH_H_
+
+#include <stddef.h>
+
+// skins characters copies of a model for frames frames with both back ends and
+// prints the time of each per frame, needs a current gl context
+int skinning_bench(char const *model_path, size_t characters, size_t frames);
+
+#endif // _SKINNING_BENCH_H_
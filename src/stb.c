@@ -1,2 +1,5 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
@@ -0,0 +1,327 @@
+#include "texture_cache.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "fs.h"
+#include "texture_loader.h"
+
+#define SLOT_EMPTY 0u
+#define SLOT_TOMBSTONE UINT32_MAX
+#define MIN_SLOTS 64
+#define HANDLE_INDEX_BITS 24
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+
+typedef struct texture_entry
+{
+  texture_source_t source;
+  uint64_t hash;
+  texture_usage_t usage;
+  GLuint id;
+  atomic_uint refs;
+  uint32_t next_free;
+  uint8_t generation;
+  bool used;
+} texture_entry_t;
+
+static struct
+{
+  pthread_rwlock_t lock;
+  texture_entry_t *entries;
+  size_t entries_size, entries_capacity;
+  uint32_t free_list;
+  uint32_t *slots;
+  size_t slots_capacity, slots_used, live;
+  atomic_size_t hits, misses;
+} cache = {.lock = PTHREAD_RWLOCK_INITIALIZER};
+
+static texture_handle_t _handle(uint32_t index)
+{
+  return (index + 1) | ((uint32_t)cache.entries[index].generation << HANDLE_INDEX_BITS);
+}
+
+static texture_entry_t *_entry(texture_handle_t handle)
+{
+  uint32_t index = (handle & HANDLE_INDEX_MASK) - 1;
+  if (handle == TEXTURE_HANDLE_NONE || index >= cache.entries_size)
+  {
+    return NULL;
+  }
+
+  texture_entry_t *entry = &cache.entries[index];
+  if (!entry->used || entry->generation != (uint8_t)(handle >> HANDLE_INDEX_BITS))
+  {
+    return NULL;
+  }
+
+  return entry;
+}
+
+static size_t _find_slot(char const *path, uint64_t hash)
+{
+  if (cache.slots_capacity == 0)
+  {
+    return SIZE_MAX;
+  }
+
+  size_t mask = cache.slots_capacity - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask)
+  {
+    uint32_t slot = cache.slots[i];
+    if (slot == SLOT_EMPTY)
+    {
+      return SIZE_MAX;
+    }
+
+    if (slot != SLOT_TOMBSTONE)
+    {
+      texture_entry_t const *entry = &cache.entries[slot - 1];
+      if (entry->hash == hash && strcmp(entry->source.path, path) == 0)
+      {
+        return i;
+      }
+    }
+  }
+}
+
+static void _place(uint32_t index)
+{
+  size_t mask = cache.slots_capacity - 1;
+  size_t i = cache.entries[index].hash & mask;
+  while (cache.slots[i] != SLOT_EMPTY && cache.slots[i] != SLOT_TOMBSTONE)
+  {
+    i = (i + 1) & mask;
+  }
+
+  if (cache.slots[i] == SLOT_EMPTY)
+  {
+    cache.slots_used++;
+  }
+  cache.slots[i] = index + 1;
+}
+
+static void _rehash(size_t capacity)
+{
+  free(cache.slots);
+  cache.slots = calloc(capacity, sizeof(uint32_t));
+  assert(cache.slots != NULL);
+  cache.slots_capacity = capacity;
+  cache.slots_used = 0;
+
+  for (uint32_t i = 0; i < cache.entries_size; i++)
+  {
+    if (cache.entries[i].used)
+    {
+      _place(i);
+    }
+  }
+}
+
+static uint32_t _new_entry(void)
+{
+  if (cache.free_list != 0)
+  {
+    uint32_t index = cache.free_list - 1;
+    cache.free_list = cache.entries[index].next_free;
+    return index;
+  }
+
+  if (cache.entries_size == cache.entries_capacity)
+  {
+    size_t new_capacity = cache.entries_capacity ? cache.entries_capacity << 1 : MIN_SLOTS;
+    texture_entry_t *new_entries = realloc(cache.entries, new_capacity * sizeof(texture_entry_t));
+    assert(new_entries != NULL);
+    cache.entries = new_entries;
+    cache.entries_capacity = new_capacity;
+  }
+
+  assert(cache.entries_size < HANDLE_INDEX_MASK);
+  memset(&cache.entries[cache.entries_size], 0, sizeof(texture_entry_t));
+  return cache.entries_size++;
+}
+
+texture_handle_t texture_cache_acquire(char const *path, texture_usage_t usage)
+{
+  return texture_cache_acquire_source(&(texture_source_t){.path = path}, usage);
+}
+
+// the source is only copied by the first acquire of its path
+texture_handle_t texture_cache_acquire_source(texture_source_t const *source, texture_usage_t usage)
+{
+  char const *path = source->path;
+  uint64_t hash = fs_hash(path, strlen(path), 0);
+
+  pthread_rwlock_rdlock(&cache.lock);
+  size_t slot = _find_slot(path, hash);
+  if (slot != SIZE_MAX)
+  {
+    uint32_t index = cache.slots[slot] - 1;
+    atomic_fetch_add(&cache.entries[index].refs, 1);
+    texture_handle_t handle = _handle(index);
+    pthread_rwlock_unlock(&cache.lock);
+    atomic_fetch_add_explicit(&cache.hits, 1, memory_order_relaxed);
+    return handle;
+  }
+  pthread_rwlock_unlock(&cache.lock);
+
+  pthread_rwlock_wrlock(&cache.lock);
+  slot = _find_slot(path, hash);
+  if (slot != SIZE_MAX)
+  {
+    uint32_t index = cache.slots[slot] - 1;
+    atomic_fetch_add(&cache.entries[index].refs, 1);
+    texture_handle_t handle = _handle(index);
+    pthread_rwlock_unlock(&cache.lock);
+    atomic_fetch_add_explicit(&cache.hits, 1, memory_order_relaxed);
+    return handle;
+  }
+
+  if ((cache.slots_used + 1) * 2 > cache.slots_capacity)
+  {
+    size_t capacity = MIN_SLOTS;
+    while (capacity < (cache.live + 1) * 4)
+    {
+      capacity <<= 1;
+    }
+    _rehash(capacity);
+  }
+
+  uint32_t index = _new_entry();
+  texture_entry_t *entry = &cache.entries[index];
+  texture_source_copy(source, &entry->source);
+  entry->hash = hash;
+  entry->usage = usage;
+  entry->id = 0;
+  entry->used = true;
+  atomic_init(&entry->refs, 1);
+  _place(index);
+  cache.live++;
+
+  texture_handle_t handle = _handle(index);
+  pthread_rwlock_unlock(&cache.lock);
+  atomic_fetch_add_explicit(&cache.misses, 1, memory_order_relaxed);
+  return handle;
+}
+
+texture_handle_t texture_cache_retain(texture_handle_t handle)
+{
+  pthread_rwlock_rdlock(&cache.lock);
+  texture_entry_t *entry = _entry(handle);
+  if (entry != NULL)
+  {
+    atomic_fetch_add(&entry->refs, 1);
+  }
+  pthread_rwlock_unlock(&cache.lock);
+
+  return entry != NULL ? handle : TEXTURE_HANDLE_NONE;
+}
+
+char const *texture_cache_path(texture_handle_t handle)
+{
+  pthread_rwlock_rdlock(&cache.lock);
+  texture_entry_t *entry = _entry(handle);
+  char const *path = entry != NULL ? entry->source.path : NULL;
+  pthread_rwlock_unlock(&cache.lock);
+
+  return path;
+}
+
+bool texture_cache_source(texture_handle_t handle, texture_source_t *source)
+{
+  pthread_rwlock_rdlock(&cache.lock);
+  texture_entry_t *entry = _entry(handle);
+  if (entry != NULL)
+  {
+    *source = entry->source;
+  }
+  pthread_rwlock_unlock(&cache.lock);
+
+  return entry != NULL;
+}
+
+GLuint texture_cache_resolve(texture_handle_t handle)
+{
+  pthread_rwlock_rdlock(&cache.lock);
+  texture_entry_t *entry = _entry(handle);
+  GLuint id = entry != NULL ? entry->id : 0;
+  pthread_rwlock_unlock(&cache.lock);
+
+  if (entry == NULL || id != 0)
+  {
+    return id;
+  }
+
+  pthread_rwlock_wrlock(&cache.lock);
+  entry = _entry(handle);
+  if (entry != NULL && entry->id == 0)
+  {
+    entry->id = texture_loader_load_source(&entry->source, entry->usage);
+  }
+  id = entry != NULL ? entry->id : 0;
+  pthread_rwlock_unlock(&cache.lock);
+
+  return id;
+}
+
+void texture_cache_release(texture_handle_t handle)
+{
+  pthread_rwlock_wrlock(&cache.lock);
+  texture_entry_t *entry = _entry(handle);
+  if (entry != NULL && atomic_fetch_sub(&entry->refs, 1) == 1)
+  {
+    cache.slots[_find_slot(entry->source.path, entry->hash)] = SLOT_TOMBSTONE;
+    if (entry->id != 0)
+    {
+      texture_loader_unload(entry->id);
+    }
+    texture_source_deinit(&entry->source);
+
+    uint32_t index = entry - cache.entries;
+    entry->id = 0;
+    entry->used = false;
+    entry->generation++;
+    entry->next_free = cache.free_list;
+    cache.free_list = index + 1;
+    cache.live--;
+  }
+  pthread_rwlock_unlock(&cache.lock);
+}
+
+void texture_cache_get_stats(texture_cache_stats_t *stats)
+{
+  pthread_rwlock_rdlock(&cache.lock);
+  stats->entries = cache.live;
+  stats->capacity = cache.slots_capacity;
+  pthread_rwlock_unlock(&cache.lock);
+
+  stats->hits = atomic_load_explicit(&cache.hits, memory_order_relaxed);
+  stats->misses = atomic_load_explicit(&cache.misses, memory_order_relaxed);
+}
+
+void texture_cache_deinit(void)
+{
+  pthread_rwlock_wrlock(&cache.lock);
+  for (size_t i = 0; i < cache.entries_size; i++)
+  {
+    texture_entry_t *entry = &cache.entries[i];
+    if (entry->used && entry->id != 0)
+    {
+      texture_loader_unload(entry->id);
+    }
+    texture_source_deinit(&entry->source);
+  }
+
+  free(cache.entries);
+  free(cache.slots);
+  cache.entries = NULL;
+  cache.slots = NULL;
+  cache.entries_size = cache.entries_capacity = 0;
+  cache.slots_capacity = cache.slots_used = cache.live = 0;
+  cache.free_list = 0;
+  pthread_rwlock_unlock(&cache.lock);
+}
@@ -0,0 +1,40 @@
+#if !defined(_TEXTURE_CACHE_H_)
+#define _TEXTURE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/gl.h>
+
+#include "texture_compress.h"
+#include "texture_source.h"
+
+#define TEXTURE_HANDLE_NONE 0u
+
+// low 24 bits hold the entry index + 1, high 8 bits its generation
+typedef uint32_t texture_handle_t;
+
+typedef struct texture_cache_stats
+{
+  size_t hits, misses, entries, capacity;
+} texture_cache_stats_t;
+
+// thread safe, every acquire takes a reference the caller has to release.
+// the usage of the first acquire of a path decides how it is compressed
+texture_handle_t texture_cache_acquire(char const *path, texture_usage_t usage);
+texture_handle_t texture_cache_acquire_source(texture_source_t const *source, texture_usage_t usage);
+texture_handle_t texture_cache_retain(texture_handle_t handle);
+char const *texture_cache_path(texture_handle_t handle);
+
+// the source stays valid while the caller holds its reference
+bool texture_cache_source(texture_handle_t handle, texture_source_t *source);
+
+// GL thread only
+GLuint texture_cache_resolve(texture_handle_t handle);
+void texture_cache_release(texture_handle_t handle);
+
+void texture_cache_get_stats(texture_cache_stats_t *stats);
+void texture_cache_deinit(void);
+
+#endif // _TEXTURE_CACHE_H_
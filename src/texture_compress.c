@@ -0,0 +1,374 @@
+#include "texture_compress.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <stb_dxt.h>
+
+#include "thread_pool.h"
+
+#define BLOCK_PIXELS (TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE)
+#define BC7_MODE_6 (1u << 6)
+
+typedef struct compress_job
+{
+  texture_format_t format;
+  uint8_t const *rgba;
+  uint32_t width, height, blocks_x;
+  uint8_t *dest;
+} compress_job_t;
+
+static uint8_t const bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+texture_format_t texture_compress_select(texture_usage_t usage, uint8_t const *rgba, size_t pixels_size)
+{
+  if (usage == TEXTURE_USAGE_NORMAL)
+  {
+    return TEXTURE_FORMAT_BC5;
+  }
+
+  bool alpha = false;
+  for (size_t i = 0; i < pixels_size && !alpha; i++)
+  {
+    alpha = rgba[i * 4 + 3] != 255;
+  }
+
+  if (!alpha)
+  {
+    return TEXTURE_FORMAT_BC1;
+  }
+
+  return usage == TEXTURE_USAGE_COLOR ? TEXTURE_FORMAT_BC7 : TEXTURE_FORMAT_BC3;
+}
+
+size_t texture_compress_block_bytes(texture_format_t format)
+{
+  return format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+}
+
+size_t texture_compress_size(texture_format_t format, uint32_t width, uint32_t height)
+{
+  size_t blocks_x = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+  size_t blocks_y = (height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+  return blocks_x * blocks_y * texture_compress_block_bytes(format);
+}
+
+GLenum texture_compress_gl_format(texture_format_t format)
+{
+  switch (format)
+  {
+  case TEXTURE_FORMAT_BC1:
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  case TEXTURE_FORMAT_BC3:
+    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  case TEXTURE_FORMAT_BC5:
+    return GL_COMPRESSED_RG_RGTC2;
+  case TEXTURE_FORMAT_BC7:
+    return GL_COMPRESSED_RGBA_BPTC_UNORM;
+
+  default:
+    return GL_NONE;
+  }
+}
+
+static void _put_bits(uint8_t *block, size_t *offset, uint32_t value, size_t bits)
+{
+  for (size_t i = 0; i < bits; i++, (*offset)++)
+  {
+    block[*offset >> 3] |= ((value >> i) & 1u) << (*offset & 7);
+  }
+}
+
+// the seven stored bits of every channel share one low bit per endpoint
+static void _bc7_quantize(float const *endpoint, uint8_t *dest, uint8_t *p_bit)
+{
+  float best_error = INFINITY;
+  for (uint8_t p = 0; p < 2; p++)
+  {
+    uint8_t quantized[4];
+    float error = 0.f;
+    for (size_t c = 0; c < 4; c++)
+    {
+      float value = roundf((endpoint[c] - p) * .5f);
+      quantized[c] = value < 0.f ? 0 : value > 127.f ? 127 : (uint8_t)value;
+      float delta = (quantized[c] << 1 | p) - endpoint[c];
+      error += delta * delta;
+    }
+
+    if (error < best_error)
+    {
+      best_error = error;
+      memcpy(dest, quantized, sizeof(quantized));
+      *p_bit = p;
+    }
+  }
+}
+
+static float _bc7_indices(uint8_t const *pixels, uint8_t const *e0, uint8_t const *e1, uint8_t *indices)
+{
+  int palette[16][4];
+  for (size_t i = 0; i < 16; i++)
+  {
+    for (size_t c = 0; c < 4; c++)
+    {
+      palette[i][c] = ((64 - bc7_weights[i]) * e0[c] + bc7_weights[i] * e1[c] + 32) >> 6;
+    }
+  }
+
+  float total = 0.f;
+  for (size_t i = 0; i < BLOCK_PIXELS; i++)
+  {
+    int best = INT32_MAX;
+    for (uint8_t j = 0; j < 16; j++)
+    {
+      int error = 0;
+      for (size_t c = 0; c < 4; c++)
+      {
+        int delta = palette[j][c] - pixels[i * 4 + c];
+        error += delta * delta;
+      }
+
+      if (error < best)
+      {
+        best = error;
+        indices[i] = j;
+      }
+    }
+    total += best;
+  }
+
+  return total;
+}
+
+// endpoints go to the extremes of the pixels along their principal axis
+static void _bc7_principal_endpoints(uint8_t const *pixels, float *e0, float *e1)
+{
+  float mean[4] = {0.f};
+  for (size_t i = 0; i < BLOCK_PIXELS; i++)
+  {
+    for (size_t c = 0; c < 4; c++)
+    {
+      mean[c] += pixels[i * 4 + c] / (float)BLOCK_PIXELS;
+    }
+  }
+
+  float covariance[4][4] = {{0.f}};
+  for (size_t i = 0; i < BLOCK_PIXELS; i++)
+  {
+    for (size_t r = 0; r < 4; r++)
+    {
+      for (size_t c = 0; c < 4; c++)
+      {
+        covariance[r][c] += (pixels[i * 4 + r] - mean[r]) * (pixels[i * 4 + c] - mean[c]);
+      }
+    }
+  }
+
+  float axis[4] = {1.f, 1.f, 1.f, 1.f};
+  for (size_t iteration = 0; iteration < 8; iteration++)
+  {
+    float next[4] = {0.f}, length = 0.f;
+    for (size_t r = 0; r < 4; r++)
+    {
+      for (size_t c = 0; c < 4; c++)
+      {
+        next[r] += covariance[r][c] * axis[c];
+      }
+      length = fmaxf(length, fabsf(next[r]));
+    }
+
+    if (length == 0.f)
+    {
+      break;
+    }
+
+    for (size_t c = 0; c < 4; c++)
+    {
+      axis[c] = next[c] / length;
+    }
+  }
+
+  float min = INFINITY, max = -INFINITY;
+  for (size_t i = 0; i < BLOCK_PIXELS; i++)
+  {
+    float t = 0.f;
+    for (size_t c = 0; c < 4; c++)
+    {
+      t += (pixels[i * 4 + c] - mean[c]) * axis[c];
+    }
+    min = fminf(min, t), max = fmaxf(max, t);
+  }
+
+  float norm2 = 0.f;
+  for (size_t c = 0; c < 4; c++)
+  {
+    norm2 += axis[c] * axis[c];
+  }
+
+  for (size_t c = 0; c < 4; c++)
+  {
+    float direction = norm2 > 0.f ? axis[c] / norm2 : 0.f;
+    e0[c] = fminf(fmaxf(mean[c] + direction * min, 0.f), 255.f);
+    e1[c] = fminf(fmaxf(mean[c] + direction * max, 0.f), 255.f);
+  }
+}
+
+// least squares endpoints for the current indices
+static bool _bc7_refit(uint8_t const *pixels, uint8_t const *indices, float *e0, float *e1)
+{
+  float a = 0.f, b = 0.f, c = 0.f, x0[4] = {0.f}, x1[4] = {0.f};
+  for (size_t i = 0; i < BLOCK_PIXELS; i++)
+  {
+    float w = bc7_weights[indices[i]] / 64.f;
+    a += (1.f - w) * (1.f - w), b += (1.f - w) * w, c += w * w;
+    for (size_t ch = 0; ch < 4; ch++)
+    {
+      x0[ch] += (1.f - w) * pixels[i * 4 + ch];
+      x1[ch] += w * pixels[i * 4 + ch];
+    }
+  }
+
+  float determinant = a * c - b * b;
+  if (fabsf(determinant) < 1e-6f)
+  {
+    return false;
+  }
+
+  for (size_t ch = 0; ch < 4; ch++)
+  {
+    e0[ch] = fminf(fmaxf((c * x0[ch] - b * x1[ch]) / determinant, 0.f), 255.f);
+    e1[ch] = fminf(fmaxf((a * x1[ch] - b * x0[ch]) / determinant, 0.f), 255.f);
+  }
+  return true;
+}
+
+static float _bc7_fit(uint8_t const *pixels, float const *e0, float const *e1, uint8_t q[2][4], uint8_t p[2], uint8_t *indices)
+{
+  _bc7_quantize(e0, q[0], &p[0]);
+  _bc7_quantize(e1, q[1], &p[1]);
+
+  uint8_t d0[4], d1[4];
+  for (size_t c = 0; c < 4; c++)
+  {
+    d0[c] = q[0][c] << 1 | p[0];
+    d1[c] = q[1][c] << 1 | p[1];
+  }
+  return _bc7_indices(pixels, d0, d1, indices);
+}
+
+// mode 6 only: one subset, rgba endpoints and 4 bit indices
+static void _bc7_block(uint8_t const *pixels, uint8_t *dest)
+{
+  float e0[4], e1[4];
+  _bc7_principal_endpoints(pixels, e0, e1);
+
+  uint8_t q[2][4], p[2], indices[BLOCK_PIXELS];
+  float error = _bc7_fit(pixels, e0, e1, q, p, indices);
+
+  uint8_t refit_q[2][4], refit_p[2], refit_indices[BLOCK_PIXELS];
+  if (error > 0.f && _bc7_refit(pixels, indices, e0, e1) &&
+      _bc7_fit(pixels, e0, e1, refit_q, refit_p, refit_indices) < error)
+  {
+    memcpy(q, refit_q, sizeof(q));
+    memcpy(p, refit_p, sizeof(p));
+    memcpy(indices, refit_indices, sizeof(indices));
+  }
+
+  // the first index drops its high bit, swapping the endpoints clears it
+  if (indices[0] & 8)
+  {
+    uint8_t swap[4];
+    memcpy(swap, q[0], 4), memcpy(q[0], q[1], 4), memcpy(q[1], swap, 4);
+    uint8_t p_swap = p[0];
+    p[0] = p[1], p[1] = p_swap;
+    for (size_t i = 0; i < BLOCK_PIXELS; i++)
+    {
+      indices[i] = 15 - indices[i];
+    }
+  }
+
+  memset(dest, 0, 16);
+  size_t offset = 0;
+  _put_bits(dest, &offset, BC7_MODE_6, 7);
+  for (size_t c = 0; c < 4; c++)
+  {
+    _put_bits(dest, &offset, q[0][c], 7);
+    _put_bits(dest, &offset, q[1][c], 7);
+  }
+  _put_bits(dest, &offset, p[0], 1);
+  _put_bits(dest, &offset, p[1], 1);
+  _put_bits(dest, &offset, indices[0], 3);
+  for (size_t i = 1; i < BLOCK_PIXELS; i++)
+  {
+    _put_bits(dest, &offset, indices[i], 4);
+  }
+}
+
+// edge blocks of sizes that are not a multiple of 4 repeat the last row and column
+static void _gather_block(compress_job_t const *job, uint32_t block_x, uint32_t block_y, uint8_t *pixels)
+{
+  for (uint32_t y = 0; y < TEXTURE_BLOCK_SIZE; y++)
+  {
+    uint32_t source_y = block_y * TEXTURE_BLOCK_SIZE + y;
+    source_y = source_y < job->height ? source_y : job->height - 1;
+    for (uint32_t x = 0; x < TEXTURE_BLOCK_SIZE; x++)
+    {
+      uint32_t source_x = block_x * TEXTURE_BLOCK_SIZE + x;
+      source_x = source_x < job->width ? source_x : job->width - 1;
+      memcpy(&pixels[(y * TEXTURE_BLOCK_SIZE + x) * 4], &job->rgba[((size_t)source_y * job->width + source_x) * 4], 4);
+    }
+  }
+}
+
+static void _compress_row(void *data, size_t block_y)
+{
+  compress_job_t const *job = data;
+  size_t block_bytes = texture_compress_block_bytes(job->format);
+  uint8_t *dest = job->dest + block_y * job->blocks_x * block_bytes;
+
+  for (uint32_t block_x = 0; block_x < job->blocks_x; block_x++, dest += block_bytes)
+  {
+    uint8_t pixels[BLOCK_PIXELS * 4];
+    _gather_block(job, block_x, block_y, pixels);
+
+    switch (job->format)
+    {
+    case TEXTURE_FORMAT_BC1:
+      stb_compress_dxt_block(dest, pixels, 0, STB_DXT_HIGHQUAL);
+      break;
+    case TEXTURE_FORMAT_BC3:
+      stb_compress_dxt_block(dest, pixels, 1, STB_DXT_HIGHQUAL);
+      break;
+    case TEXTURE_FORMAT_BC5:
+    {
+      uint8_t rg[BLOCK_PIXELS * 2];
+      for (size_t i = 0; i < BLOCK_PIXELS; i++)
+      {
+        rg[i * 2] = pixels[i * 4];
+        rg[i * 2 + 1] = pixels[i * 4 + 1];
+      }
+      stb_compress_bc5_block(dest, rg);
+      break;
+    }
+    case TEXTURE_FORMAT_BC7:
+      _bc7_block(pixels, dest);
+      break;
+
+    default:
+      break;
+    }
+  }
+}
+
+void texture_compress(texture_format_t format, uint8_t const *rgba, uint32_t width, uint32_t height, void *dest)
+{
+  compress_job_t job = {
+      .format = format,
+      .rgba = rgba,
+      .width = width,
+      .height = height,
+      .blocks_x = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE,
+      .dest = dest,
+  };
+  thread_pool_for(thread_pool_shared(), (height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE, _compress_row, &job);
+}
@@ -0,0 +1,47 @@
+#if !defined(_TEXTURE_COMPRESS_H_)
+#define _TEXTURE_COMPRESS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/gl.h>
+
+// s3tc is an extension, glad only generates the core profile
+#if !defined(GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#if !defined(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#define TEXTURE_BLOCK_SIZE 4
+
+// decides the block format a texture is compressed to
+typedef enum texture_usage
+{
+  TEXTURE_USAGE_COLOR,
+  TEXTURE_USAGE_DATA,
+  TEXTURE_USAGE_NORMAL,
+} texture_usage_t;
+
+// bc1 is opaque rgb, bc3 rgb with smooth alpha, bc5 the two channels of a
+// tangent space normal and bc7 high quality rgba
+typedef enum texture_format
+{
+  TEXTURE_FORMAT_BC1,
+  TEXTURE_FORMAT_BC3,
+  TEXTURE_FORMAT_BC5,
+  TEXTURE_FORMAT_BC7,
+  TEXTURE_FORMATS_SIZE
+} texture_format_t;
+
+texture_format_t texture_compress_select(texture_usage_t usage, uint8_t const *rgba, size_t pixels_size);
+size_t texture_compress_block_bytes(texture_format_t format);
+size_t texture_compress_size(texture_format_t format, uint32_t width, uint32_t height);
+GLenum texture_compress_gl_format(texture_format_t format);
+
+// rgba is tightly packed 8 bit rgba, rows of blocks are spread over the shared pool
+void texture_compress(texture_format_t format, uint8_t const *rgba, uint32_t width, uint32_t height, void *dest);
+
+#endif // _TEXTURE_COMPRESS_H_
@@ -0,0 +1,290 @@
+#include "texture_ktx.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "texture_mips.h"
+
+// values from the vulkan and khronos data format specifications
+#define VK_FORMAT_BC1_RGB_UNORM_BLOCK 131
+#define VK_FORMAT_BC3_UNORM_BLOCK 137
+#define VK_FORMAT_BC5_UNORM_BLOCK 141
+#define VK_FORMAT_BC7_UNORM_BLOCK 145
+
+#define KHR_DF_MODEL_BC1A 128
+#define KHR_DF_MODEL_BC3 130
+#define KHR_DF_MODEL_BC5 132
+#define KHR_DF_MODEL_BC7 134
+#define KHR_DF_PRIMARIES_BT709 1
+#define KHR_DF_TRANSFER_LINEAR 1
+#define KHR_DF_VERSION 2
+
+#define DFD_BLOCK_HEADER_SIZE 24
+#define DFD_SAMPLE_SIZE 16
+#define DFD_SAMPLES_MAX 2
+
+#define SOURCE_KEY "render.source"
+
+static uint8_t const identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+typedef struct ktx_header
+{
+  uint8_t identifier[12];
+  uint32_t vk_format, type_size;
+  uint32_t pixel_width, pixel_height, pixel_depth;
+  uint32_t layer_count, face_count, level_count, supercompression_scheme;
+  uint32_t dfd_offset, dfd_length, kvd_offset, kvd_length;
+  uint64_t sgd_offset, sgd_length;
+} ktx_header_t;
+
+typedef struct ktx_level
+{
+  uint64_t offset, length, uncompressed_length;
+} ktx_level_t;
+
+typedef struct ktx_source
+{
+  uint64_t hash;
+  uint32_t version;
+} ktx_source_t;
+
+typedef struct ktx_channel
+{
+  uint8_t id;
+  uint8_t bit_offset;
+} ktx_channel_t;
+
+typedef struct ktx_format_info
+{
+  uint32_t vk_format, model;
+  ktx_channel_t channels[DFD_SAMPLES_MAX];
+  uint32_t channels_size;
+} ktx_format_info_t;
+
+// bc3 stores its alpha block first, bc5 red then green
+static ktx_format_info_t const formats[TEXTURE_FORMATS_SIZE] = {
+    [TEXTURE_FORMAT_BC1] = {VK_FORMAT_BC1_RGB_UNORM_BLOCK, KHR_DF_MODEL_BC1A, {{0, 0}}, 1},
+    [TEXTURE_FORMAT_BC3] = {VK_FORMAT_BC3_UNORM_BLOCK, KHR_DF_MODEL_BC3, {{15, 0}, {0, 64}}, 2},
+    [TEXTURE_FORMAT_BC5] = {VK_FORMAT_BC5_UNORM_BLOCK, KHR_DF_MODEL_BC5, {{0, 0}, {1, 64}}, 2},
+    [TEXTURE_FORMAT_BC7] = {VK_FORMAT_BC7_UNORM_BLOCK, KHR_DF_MODEL_BC7, {{0, 0}}, 1},
+};
+
+static uint64_t _align(uint64_t offset, uint64_t alignment)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+static bool _find_format(uint32_t vk_format, texture_format_t *format)
+{
+  for (size_t i = 0; i < TEXTURE_FORMATS_SIZE; i++)
+  {
+    if (formats[i].vk_format == vk_format)
+    {
+      *format = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool _find_source(unsigned char const *kvd, size_t kvd_size, ktx_source_t *source)
+{
+  size_t offset = 0;
+  while (offset + sizeof(uint32_t) <= kvd_size)
+  {
+    uint32_t length;
+    memcpy(&length, &kvd[offset], sizeof(length));
+    offset += sizeof(length);
+    if (length > kvd_size - offset)
+    {
+      return false;
+    }
+
+    if (length == sizeof(SOURCE_KEY) + sizeof(ktx_source_t) && memcmp(&kvd[offset], SOURCE_KEY, sizeof(SOURCE_KEY)) == 0)
+    {
+      memcpy(source, &kvd[offset + sizeof(SOURCE_KEY)], sizeof(ktx_source_t));
+      return true;
+    }
+    offset = _align(offset + length, 4);
+  }
+
+  return false;
+}
+
+bool texture_ktx_open(char const *path, uint64_t source_hash, texture_ktx_t *ktx)
+{
+  memset(ktx, 0, sizeof(texture_ktx_t));
+
+  fs_mapping_t mapping;
+  if (!fs_map(path, &mapping))
+  {
+    return false;
+  }
+
+  unsigned char const *bytes = mapping.data;
+  ktx_header_t header;
+  ktx_source_t source;
+  bool valid = mapping.size >= sizeof(ktx_header_t);
+  if (valid)
+  {
+    memcpy(&header, bytes, sizeof(header));
+    valid = memcmp(header.identifier, identifier, sizeof(identifier)) == 0 &&
+            _find_format(header.vk_format, &ktx->format) &&
+            header.pixel_width > 0 && header.pixel_height > 0 && header.pixel_depth == 0 &&
+            header.face_count == 1 && header.supercompression_scheme == 0 &&
+            header.level_count > 0 && header.level_count <= TEXTURE_KTX_LEVELS_MAX &&
+            header.level_count <= texture_mips_count(header.pixel_width, header.pixel_height) &&
+            sizeof(ktx_header_t) + header.level_count * sizeof(ktx_level_t) <= mapping.size &&
+            header.kvd_offset <= mapping.size && header.kvd_length <= mapping.size - header.kvd_offset &&
+            _find_source(&bytes[header.kvd_offset], header.kvd_length, &source) &&
+            source.hash == source_hash && source.version == TEXTURE_KTX_VERSION;
+  }
+
+  for (uint32_t i = 0; valid && i < header.level_count; i++)
+  {
+    ktx_level_t level;
+    memcpy(&level, &bytes[sizeof(ktx_header_t) + i * sizeof(ktx_level_t)], sizeof(level));
+    size_t expected = texture_compress_size(
+        ktx->format, texture_mips_extent(header.pixel_width, i), texture_mips_extent(header.pixel_height, i));
+    expected *= header.layer_count > 0 ? header.layer_count : 1;
+    valid = level.length == expected && level.offset <= mapping.size && level.length <= mapping.size - level.offset;
+    ktx->levels[i] = (texture_ktx_level_t){.data = &bytes[level.offset], .size = level.length};
+  }
+
+  if (!valid)
+  {
+    fs_unmap(&mapping);
+    memset(ktx, 0, sizeof(texture_ktx_t));
+    return false;
+  }
+
+  ktx->mapping = mapping;
+  ktx->width = header.pixel_width;
+  ktx->height = header.pixel_height;
+  ktx->layers_size = header.layer_count;
+  ktx->levels_size = header.level_count;
+  return true;
+}
+
+void texture_ktx_close(texture_ktx_t *ktx)
+{
+  if (ktx == NULL)
+  {
+    return;
+  }
+
+  fs_unmap(&ktx->mapping);
+  memset(ktx, 0, sizeof(texture_ktx_t));
+}
+
+// a basic data format descriptor with one sample per compressed channel
+static size_t _write_dfd(texture_format_t format, uint32_t *words)
+{
+  ktx_format_info_t const *info = &formats[format];
+  uint32_t block_size = DFD_BLOCK_HEADER_SIZE + info->channels_size * DFD_SAMPLE_SIZE;
+  uint32_t block_bytes = texture_compress_block_bytes(format);
+
+  size_t i = 0;
+  words[i++] = sizeof(uint32_t) + block_size;
+  words[i++] = 0;
+  words[i++] = KHR_DF_VERSION | block_size << 16;
+  words[i++] = info->model | KHR_DF_PRIMARIES_BT709 << 8 | KHR_DF_TRANSFER_LINEAR << 16;
+  words[i++] = (TEXTURE_BLOCK_SIZE - 1) | (TEXTURE_BLOCK_SIZE - 1) << 8;
+  words[i++] = block_bytes;
+  words[i++] = 0;
+
+  uint32_t sample_bits = block_bytes * 8 / info->channels_size;
+  for (size_t j = 0; j < info->channels_size; j++)
+  {
+    words[i++] = info->channels[j].bit_offset | (sample_bits - 1) << 16 | (uint32_t)info->channels[j].id << 24;
+    words[i++] = 0;
+    words[i++] = 0;
+    words[i++] = UINT32_MAX;
+  }
+
+  return i * sizeof(uint32_t);
+}
+
+static bool _write_at(FILE *file, void const *data, size_t size, uint64_t offset, uint64_t *written)
+{
+  static unsigned char const zeros[16] = {0};
+  assert(offset >= *written && offset - *written <= sizeof(zeros));
+  size_t padding = offset - *written;
+  *written = offset + size;
+  return fwrite(zeros, 1, padding, file) == padding && fwrite(data, 1, size, file) == size;
+}
+
+bool texture_ktx_write(char const *path, uint64_t source_hash, texture_ktx_t const *ktx)
+{
+  uint32_t dfd[(DFD_BLOCK_HEADER_SIZE + DFD_SAMPLES_MAX * DFD_SAMPLE_SIZE) / sizeof(uint32_t) + 1];
+  size_t dfd_size = _write_dfd(ktx->format, dfd);
+
+  unsigned char kvd[sizeof(uint32_t) + sizeof(SOURCE_KEY) + sizeof(ktx_source_t) + 4] = {0};
+  uint32_t kvd_length = sizeof(SOURCE_KEY) + sizeof(ktx_source_t);
+  ktx_source_t source = {.hash = source_hash, .version = TEXTURE_KTX_VERSION};
+  memcpy(kvd, &kvd_length, sizeof(kvd_length));
+  memcpy(&kvd[sizeof(uint32_t)], SOURCE_KEY, sizeof(SOURCE_KEY));
+  memcpy(&kvd[sizeof(uint32_t) + sizeof(SOURCE_KEY)], &source, sizeof(source));
+  size_t kvd_size = _align(sizeof(uint32_t) + kvd_length, 4);
+
+  ktx_header_t header = {
+      .vk_format = formats[ktx->format].vk_format,
+      .type_size = 1,
+      .pixel_width = ktx->width,
+      .pixel_height = ktx->height,
+      .layer_count = ktx->layers_size,
+      .face_count = 1,
+      .level_count = ktx->levels_size,
+      .dfd_offset = sizeof(ktx_header_t) + ktx->levels_size * sizeof(ktx_level_t),
+      .dfd_length = dfd_size,
+  };
+  memcpy(header.identifier, identifier, sizeof(identifier));
+  header.kvd_offset = header.dfd_offset + header.dfd_length;
+  header.kvd_length = kvd_size;
+
+  // the smallest level comes first in the file
+  ktx_level_t levels[TEXTURE_KTX_LEVELS_MAX];
+  size_t block_bytes = texture_compress_block_bytes(ktx->format);
+  uint64_t offset = header.kvd_offset + header.kvd_length;
+  for (uint32_t i = ktx->levels_size; i-- > 0;)
+  {
+    offset = _align(offset, block_bytes);
+    levels[i] = (ktx_level_t){.offset = offset, .length = ktx->levels[i].size, .uncompressed_length = ktx->levels[i].size};
+    offset += ktx->levels[i].size;
+  }
+
+  size_t tmp_path_size = strlen(path) + sizeof(".tmp");
+  char *tmp_path = malloc(tmp_path_size);
+  assert(tmp_path != NULL);
+  snprintf(tmp_path, tmp_path_size, "%s.tmp", path);
+
+  bool ok = false;
+  FILE *file = fopen(tmp_path, "wb");
+  if (file)
+  {
+    uint64_t written = 0;
+    ok = _write_at(file, &header, sizeof(header), 0, &written) &&
+         _write_at(file, levels, ktx->levels_size * sizeof(ktx_level_t), written, &written) &&
+         _write_at(file, dfd, dfd_size, header.dfd_offset, &written) &&
+         _write_at(file, kvd, kvd_size, header.kvd_offset, &written);
+    for (uint32_t i = ktx->levels_size; ok && i-- > 0;)
+    {
+      ok = _write_at(file, ktx->levels[i].data, ktx->levels[i].size, levels[i].offset, &written);
+    }
+
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(tmp_path, path) == 0;
+  }
+
+  if (!ok)
+  {
+    perror("Cannot write texture cache");
+    remove(tmp_path);
+  }
+
+  free(tmp_path);
+  return ok;
+}
@@ -0,0 +1,37 @@
+#if !defined(_TEXTURE_KTX_H_)
+#define _TEXTURE_KTX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fs.h"
+#include "texture_compress.h"
+
+#define TEXTURE_KTX_VERSION 2
+#define TEXTURE_KTX_EXTENSION ".ktx2"
+#define TEXTURE_KTX_LEVELS_MAX 16
+
+typedef struct texture_ktx_level
+{
+  void const *data;
+  size_t size;
+} texture_ktx_level_t;
+
+// a 2d image with its block compressed mip chain, level 0 is full size. an
+// array has layers_size > 0 and every level holds all its layers one after the
+// other. levels point into mapping when opened from a file
+typedef struct texture_ktx
+{
+  fs_mapping_t mapping;
+  texture_format_t format;
+  uint32_t width, height, layers_size, levels_size;
+  texture_ktx_level_t levels[TEXTURE_KTX_LEVELS_MAX];
+} texture_ktx_t;
+
+// fails when the file is missing, malformed or was written for another source
+bool texture_ktx_open(char const *path, uint64_t source_hash, texture_ktx_t *ktx);
+void texture_ktx_close(texture_ktx_t *ktx);
+bool texture_ktx_write(char const *path, uint64_t source_hash, texture_ktx_t const *ktx);
+
+#endif // _TEXTURE_KTX_H_
@@ -0,0 +1,307 @@
+#include "texture_loader.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sched.h>
+
+#include "texture_ktx.h"
+#include "texture_mips.h"
+#include "texture_residency.h"
+#include "thread_pool.h"
+#include "timer.h"
+
+// ktx either maps the cache file or points into blocks, freshly encoded from pixels.
+// previous and following link every request not freed yet and are only touched
+// on the gl thread, texture is 0 once it was unloaded before its upload
+typedef struct texture_request
+{
+  struct texture_request *next, *previous, *following;
+  texture_source_t source;
+  texture_usage_t usage;
+  GLuint texture;
+  int width, height;
+  unsigned char *pixels;
+  texture_ktx_t ktx;
+  unsigned char *blocks;
+} texture_request_t;
+
+static struct
+{
+  _Atomic(texture_request_t *) completed;
+  atomic_size_t pending;
+  texture_request_t *ready, *requests;
+  unsigned char placeholder[4];
+} loader = {.placeholder = {128, 128, 128, 255}};
+
+static void _push_completed(texture_request_t *request)
+{
+  texture_request_t *head = atomic_load_explicit(&loader.completed, memory_order_relaxed);
+  do
+  {
+    request->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &loader.completed, &head, request, memory_order_release, memory_order_relaxed));
+}
+
+// takes every completed request at once and appends them in completion order
+static void _take_completed(void)
+{
+  texture_request_t *head = atomic_exchange_explicit(&loader.completed, NULL, memory_order_acquire);
+
+  texture_request_t *reversed = NULL;
+  while (head != NULL)
+  {
+    texture_request_t *next = head->next;
+    head->next = reversed;
+    reversed = head;
+    head = next;
+  }
+
+  texture_request_t **tail = &loader.ready;
+  while (*tail != NULL)
+  {
+    tail = &(*tail)->next;
+  }
+  *tail = reversed;
+}
+
+static void _free_request(texture_request_t *request)
+{
+  if (request->previous != NULL)
+  {
+    request->previous->following = request->following;
+  }
+  else
+  {
+    loader.requests = request->following;
+  }
+  if (request->following != NULL)
+  {
+    request->following->previous = request->previous;
+  }
+
+  texture_ktx_close(&request->ktx);
+  free(request->blocks);
+  texture_source_free(request->pixels);
+  texture_source_deinit(&request->source);
+  free(request);
+}
+
+static char *_cache_path(char const *path)
+{
+  size_t size = strlen(path) + sizeof(TEXTURE_KTX_EXTENSION);
+  char *cache_path = malloc(size);
+  assert(cache_path != NULL);
+  snprintf(cache_path, size, "%s" TEXTURE_KTX_EXTENSION, path);
+  return cache_path;
+}
+
+// compresses every level of the mip chain into one allocation
+static void _encode(texture_request_t *request)
+{
+  uint32_t width = request->width, height = request->height;
+  uint32_t levels_size = texture_mips_count(width, height);
+  levels_size = levels_size < TEXTURE_KTX_LEVELS_MAX ? levels_size : TEXTURE_KTX_LEVELS_MAX;
+  texture_format_t format = texture_compress_select(request->usage, request->pixels, (size_t)width * height);
+
+  size_t blocks_size = 0;
+  for (uint32_t i = 0; i < levels_size; i++)
+  {
+    blocks_size += texture_compress_size(format, texture_mips_extent(width, i), texture_mips_extent(height, i));
+  }
+  request->blocks = malloc(blocks_size);
+  assert(request->blocks != NULL);
+  request->ktx = (texture_ktx_t){.format = format, .width = width, .height = height, .levels_size = levels_size};
+
+  unsigned char *level = request->pixels, *blocks = request->blocks;
+  for (uint32_t i = 0; i < levels_size; i++)
+  {
+    uint32_t level_width = texture_mips_extent(width, i), level_height = texture_mips_extent(height, i);
+    size_t size = texture_compress_size(format, level_width, level_height);
+    texture_compress(format, level, level_width, level_height, blocks);
+    request->ktx.levels[i] = (texture_ktx_level_t){.data = blocks, .size = size};
+    blocks += size;
+
+    if (i + 1 < levels_size)
+    {
+      unsigned char *next = malloc((size_t)texture_mips_extent(width, i + 1) * texture_mips_extent(height, i + 1) * 4);
+      assert(next != NULL);
+      texture_mips_downsample(level, level_width, level_height, request->usage, next);
+      if (level != request->pixels)
+      {
+        free(level);
+      }
+      level = next;
+    }
+  }
+
+  if (level != request->pixels)
+  {
+    free(level);
+  }
+  texture_source_free(request->pixels);
+  request->pixels = NULL;
+}
+
+// levels stay around while the texture lives, a mapping lets the system page them out
+static void _map_written(texture_request_t *request, char const *cache_path, uint64_t source_hash)
+{
+  texture_ktx_t mapped;
+  if (texture_ktx_open(cache_path, source_hash, &mapped))
+  {
+    free(request->blocks);
+    request->blocks = NULL;
+    request->ktx = mapped;
+  }
+}
+
+// the block compressed cache next to the source is only trusted while its source hash matches
+static void _decode_task(void *data)
+{
+  texture_request_t *request = data;
+  uint64_t source_hash;
+  bool has_hash = texture_source_hash(&request->source, &source_hash);
+  char *cache_path = _cache_path(request->source.path);
+
+  if (!has_hash || !texture_ktx_open(cache_path, source_hash, &request->ktx))
+  {
+    request->pixels = texture_source_load(&request->source, &request->width, &request->height);
+    if (request->pixels != NULL)
+    {
+      double start = timer_now();
+      _encode(request);
+      printf("Compressed %s: %.1f ms\n", request->source.path, timer_elapsed_ms(start));
+      if (has_hash && !texture_ktx_write(cache_path, source_hash, &request->ktx))
+      {
+        fprintf(stderr, "Cannot write texture cache %s\n", cache_path);
+      }
+      else if (has_hash)
+      {
+        _map_written(request, cache_path, source_hash);
+      }
+    }
+  }
+
+  free(cache_path);
+  _push_completed(request);
+}
+
+static void _upload(texture_request_t *request)
+{
+  texture_ktx_t const *ktx = &request->ktx;
+  if (ktx->levels_size == 0)
+  {
+    fprintf(stderr, "Cannot load texture %s\n", request->source.path);
+    return;
+  }
+
+  if (request->texture == 0)
+  {
+    return;
+  }
+
+  texture_residency_add(request->texture, ktx, request->blocks);
+  memset(&request->ktx, 0, sizeof(texture_ktx_t));
+  request->blocks = NULL;
+}
+
+void texture_loader_init(void)
+{
+  atomic_init(&loader.completed, NULL);
+  atomic_init(&loader.pending, 0);
+  loader.ready = NULL;
+  loader.requests = NULL;
+}
+
+void texture_loader_deinit(void)
+{
+  while (atomic_load(&loader.pending) > 0)
+  {
+    _take_completed();
+    while (loader.ready != NULL)
+    {
+      texture_request_t *request = loader.ready;
+      loader.ready = request->next;
+      _free_request(request);
+      atomic_fetch_sub(&loader.pending, 1);
+    }
+    sched_yield();
+  }
+
+  texture_residency_deinit();
+}
+
+GLuint texture_loader_load(char const *path, texture_usage_t usage)
+{
+  return texture_loader_load_source(&(texture_source_t){.path = path}, usage);
+}
+
+GLuint texture_loader_load_source(texture_source_t const *source, texture_usage_t usage)
+{
+  texture_request_t *request = calloc(1, sizeof(texture_request_t));
+  assert(request != NULL);
+  texture_source_copy(source, &request->source);
+  request->usage = usage;
+  request->following = loader.requests;
+  if (loader.requests != NULL)
+  {
+    loader.requests->previous = request;
+  }
+  loader.requests = request;
+
+  glGenTextures(1, &request->texture);
+  glBindTexture(GL_TEXTURE_2D, request->texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, loader.placeholder);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  GLuint texture = request->texture;
+  atomic_fetch_add(&loader.pending, 1);
+  thread_pool_submit(thread_pool_shared(), _decode_task, request);
+  return texture;
+}
+
+size_t texture_loader_update(double budget_ms)
+{
+  _take_completed();
+
+  double start = timer_now();
+  size_t uploaded = 0;
+  while (loader.ready != NULL && (uploaded == 0 || timer_elapsed_ms(start) < budget_ms))
+  {
+    texture_request_t *request = loader.ready;
+    loader.ready = request->next;
+    _upload(request);
+    _free_request(request);
+    atomic_fetch_sub(&loader.pending, 1);
+    uploaded++;
+  }
+
+  texture_residency_update(budget_ms - timer_elapsed_ms(start));
+  return uploaded;
+}
+
+// a name gl hands out again must not get the upload of the texture it used to be
+void texture_loader_unload(GLuint texture)
+{
+  for (texture_request_t *request = loader.requests; request != NULL; request = request->following)
+  {
+    if (request->texture == texture)
+    {
+      request->texture = 0;
+    }
+  }
+  texture_residency_remove(texture);
+  glDeleteTextures(1, &texture);
+}
+
+size_t texture_loader_pending(void)
+{
+  return atomic_load(&loader.pending);
+}
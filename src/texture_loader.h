@@ -0,0 +1,27 @@
+#if !defined(_TEXTURE_LOADER_H_)
+#define _TEXTURE_LOADER_H_
+
+#include <stddef.h>
+
+#include <glad/gl.h>
+
+#include "texture_compress.h"
+#include "texture_source.h"
+
+#define TEXTURE_UPLOAD_BUDGET_MS 2.
+
+void texture_loader_init(void);
+void texture_loader_deinit(void);
+
+// returns a texture name right away, it shows a placeholder until
+// texture_loader_update uploads the decoded image into it. images are block
+// compressed on first load and kept in a ktx2 file next to them
+GLuint texture_loader_load(char const *path, texture_usage_t usage);
+GLuint texture_loader_load_source(texture_source_t const *source, texture_usage_t usage);
+void texture_loader_unload(GLuint texture);
+
+// uploads decoded textures, then streams mip levels in and out with what is left of the budget
+size_t texture_loader_update(double budget_ms);
+size_t texture_loader_pending(void);
+
+#endif // _TEXTURE_LOADER_H_
@@ -0,0 +1,235 @@
+#include "texture_mips.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "thread_pool.h"
+
+#define TAPS 3
+#define ROWS_PER_TASK 16
+#define LINEAR_TO_SRGB_SIZE 4096
+
+typedef struct mips_job
+{
+  uint8_t const *rgba;
+  uint32_t width, height, dest_width, dest_height;
+  texture_usage_t usage;
+  uint32_t const *taps_x;
+  float const *weights_x;
+  uint8_t *dest;
+} mips_job_t;
+
+static float srgb_to_linear[256];
+static uint8_t linear_to_srgb[LINEAR_TO_SRGB_SIZE];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void _init_tables(void)
+{
+  for (size_t i = 0; i < 256; i++)
+  {
+    float value = i / 255.f;
+    srgb_to_linear[i] = value <= .04045f ? value / 12.92f : powf((value + .055f) / 1.055f, 2.4f);
+  }
+
+  for (size_t i = 0; i < LINEAR_TO_SRGB_SIZE; i++)
+  {
+    float value = i / (float)(LINEAR_TO_SRGB_SIZE - 1);
+    value = value <= .0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - .055f;
+    linear_to_srgb[i] = (uint8_t)(value * 255.f + .5f);
+  }
+}
+
+uint32_t texture_mips_count(uint32_t width, uint32_t height)
+{
+  uint32_t size = width > height ? width : height, count = 1;
+  while (size > 1)
+  {
+    size >>= 1;
+    count++;
+  }
+  return count;
+}
+
+uint32_t texture_mips_extent(uint32_t size, uint32_t level)
+{
+  size >>= level;
+  return size > 0 ? size : 1;
+}
+
+// an even size averages pairs, an odd size 2n + 1 gives texel i the weights
+// (n - i, n, i + 1) / (2n + 1) over three texels, a size of one is copied
+static void _taps(uint32_t size, uint32_t i, uint32_t *taps, float *weights)
+{
+  if (size == 1)
+  {
+    taps[0] = taps[1] = taps[2] = 0;
+    weights[0] = 1.f, weights[1] = weights[2] = 0.f;
+  }
+  else if (size % 2 == 0)
+  {
+    taps[0] = i * 2, taps[1] = taps[2] = i * 2 + 1;
+    weights[0] = weights[1] = .5f, weights[2] = 0.f;
+  }
+  else
+  {
+    uint32_t half = size / 2;
+    taps[0] = i * 2, taps[1] = i * 2 + 1, taps[2] = i * 2 + 2;
+    weights[0] = (float)(half - i) / size;
+    weights[1] = (float)half / size;
+    weights[2] = (float)(i + 1) / size;
+  }
+}
+
+static void _decode_row(uint8_t const *rgba, uint32_t width, texture_usage_t usage, float *dest)
+{
+  for (size_t i = 0; i < (size_t)width * 4; i += 4)
+  {
+    for (size_t c = 0; c < 3; c++)
+    {
+      float value = rgba[i + c];
+      dest[i + c] = usage == TEXTURE_USAGE_COLOR    ? srgb_to_linear[rgba[i + c]]
+                    : usage == TEXTURE_USAGE_NORMAL ? value * (2.f / 255.f) - 1.f
+                                                    : value * (1.f / 255.f);
+    }
+    dest[i + 3] = rgba[i + 3] * (1.f / 255.f);
+  }
+}
+
+// one texel is one vector of its four channels
+static void _filter_row(float const *source, mips_job_t const *job, float weight, float *dest)
+{
+  for (uint32_t x = 0; x < job->dest_width; x++)
+  {
+    uint32_t const *taps = &job->taps_x[x * TAPS];
+    float const *weights = &job->weights_x[x * TAPS];
+#if defined(__SSE__)
+    __m128 sum = _mm_loadu_ps(&dest[x * 4]);
+    for (size_t t = 0; t < TAPS; t++)
+    {
+      __m128 texel = _mm_loadu_ps(&source[taps[t] * 4]);
+      sum = _mm_add_ps(sum, _mm_mul_ps(texel, _mm_set1_ps(weights[t] * weight)));
+    }
+    _mm_storeu_ps(&dest[x * 4], sum);
+#else
+    for (size_t t = 0; t < TAPS; t++)
+    {
+      for (size_t c = 0; c < 4; c++)
+      {
+        dest[x * 4 + c] += source[taps[t] * 4 + c] * weights[t] * weight;
+      }
+    }
+#endif
+  }
+}
+
+static uint8_t _unorm8(float value)
+{
+  value = value < 0.f ? 0.f : value > 1.f ? 1.f : value;
+  return (uint8_t)(value * 255.f + .5f);
+}
+
+static void _encode_row(float const *source, uint32_t width, texture_usage_t usage, uint8_t *dest)
+{
+  for (size_t i = 0; i < (size_t)width * 4; i += 4)
+  {
+    float const *texel = &source[i];
+    if (usage == TEXTURE_USAGE_COLOR)
+    {
+      for (size_t c = 0; c < 3; c++)
+      {
+        float value = texel[c] < 0.f ? 0.f : texel[c] > 1.f ? 1.f : texel[c];
+        dest[i + c] = linear_to_srgb[(size_t)(value * (LINEAR_TO_SRGB_SIZE - 1) + .5f)];
+      }
+    }
+    else if (usage == TEXTURE_USAGE_NORMAL)
+    {
+      float length = sqrtf(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+      float scale = length > 0.f ? 1.f / length : 0.f;
+      for (size_t c = 0; c < 3; c++)
+      {
+        dest[i + c] = _unorm8(texel[c] * scale * .5f + .5f);
+      }
+    }
+    else
+    {
+      for (size_t c = 0; c < 3; c++)
+      {
+        dest[i + c] = _unorm8(texel[c]);
+      }
+    }
+    dest[i + 3] = _unorm8(texel[3]);
+  }
+}
+
+static void _downsample_rows(void *data, size_t band)
+{
+  mips_job_t const *job = data;
+  float *source = malloc((size_t)job->width * 4 * sizeof(float));
+  float *sum = malloc((size_t)job->dest_width * 4 * sizeof(float));
+  assert(source != NULL && sum != NULL);
+
+  uint32_t first = band * ROWS_PER_TASK;
+  uint32_t last = first + ROWS_PER_TASK < job->dest_height ? first + ROWS_PER_TASK : job->dest_height;
+  for (uint32_t y = first; y < last; y++)
+  {
+    uint32_t taps[TAPS];
+    float weights[TAPS];
+    _taps(job->height, y, taps, weights);
+
+    for (size_t i = 0; i < (size_t)job->dest_width * 4; i++)
+    {
+      sum[i] = 0.f;
+    }
+
+    for (size_t t = 0; t < TAPS; t++)
+    {
+      if (weights[t] > 0.f)
+      {
+        _decode_row(&job->rgba[(size_t)taps[t] * job->width * 4], job->width, job->usage, source);
+        _filter_row(source, job, weights[t], sum);
+      }
+    }
+
+    _encode_row(sum, job->dest_width, job->usage, &job->dest[(size_t)y * job->dest_width * 4]);
+  }
+
+  free(sum);
+  free(source);
+}
+
+void texture_mips_downsample(uint8_t const *rgba, uint32_t width, uint32_t height, texture_usage_t usage, uint8_t *dest)
+{
+  pthread_once(&tables_once, _init_tables);
+
+  mips_job_t job = {
+      .rgba = rgba,
+      .width = width,
+      .height = height,
+      .dest_width = texture_mips_extent(width, 1),
+      .dest_height = texture_mips_extent(height, 1),
+      .usage = usage,
+      .dest = dest,
+  };
+
+  uint32_t *taps_x = malloc(job.dest_width * TAPS * sizeof(uint32_t));
+  float *weights_x = malloc(job.dest_width * TAPS * sizeof(float));
+  assert(taps_x != NULL && weights_x != NULL);
+  for (uint32_t x = 0; x < job.dest_width; x++)
+  {
+    _taps(width, x, &taps_x[x * TAPS], &weights_x[x * TAPS]);
+  }
+  job.taps_x = taps_x;
+  job.weights_x = weights_x;
+
+  thread_pool_for(thread_pool_shared(), (job.dest_height + ROWS_PER_TASK - 1) / ROWS_PER_TASK, _downsample_rows, &job);
+
+  free(weights_x);
+  free(taps_x);
+}
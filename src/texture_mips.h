@@ -0,0 +1,19 @@
+#if !defined(_TEXTURE_MIPS_H_)
+#define _TEXTURE_MIPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "texture_compress.h"
+
+// every level halves the previous one rounding down, the last one is 1x1
+uint32_t texture_mips_count(uint32_t width, uint32_t height);
+uint32_t texture_mips_extent(uint32_t size, uint32_t level);
+
+// rgba8 in, rgba8 of the next level out. color is averaged in linear light,
+// normals are renormalized and data is averaged as stored. odd sizes use
+// three taps so every source texel keeps its weight. rows are spread over
+// the shared pool
+void texture_mips_downsample(uint8_t const *rgba, uint32_t width, uint32_t height, texture_usage_t usage, uint8_t *dest);
+
+#endif // _TEXTURE_MIPS_H_
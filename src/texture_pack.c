@@ -0,0 +1,390 @@
+#include "texture_pack.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fs.h"
+#include "texture_mips.h"
+#include "thread_pool.h"
+#include "timer.h"
+
+// a whole number of blocks so that tiles start on block boundaries. a level
+// halves it, so a pack with atlas layers stops at the level where one texel of
+// gutter is left. bump PACK_VERSION when the layout changes
+#define GUTTER (4 * TEXTURE_BLOCK_SIZE)
+#define GUTTER_LEVELS 5
+#define PACK_VERSION 2
+
+_Static_assert(GUTTER >> (GUTTER_LEVELS - 1) == 1, "gutter levels");
+
+typedef struct pack_source
+{
+  texture_source_t const *source;
+  uint64_t hash;
+  bool has_hash;
+  int width, height;
+  int32_t layer;
+  uint32_t x, y, inner_width, inner_height, gutter;
+  unsigned char *pixels;
+} pack_source_t;
+
+static uint32_t _align(uint32_t size)
+{
+  return (size + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE;
+}
+
+static void _info_task(void *data, size_t index)
+{
+  pack_source_t *source = &((pack_source_t *)data)[index];
+  source->has_hash = texture_source_hash(source->source, &source->hash);
+  if (!source->has_hash || !texture_source_info(source->source, &source->width, &source->height))
+  {
+    source->width = source->height = 0;
+    source->layer = TEXTURE_PACK_LAYER_NONE;
+  }
+}
+
+static void _decode_task(void *data, size_t index)
+{
+  pack_source_t *source = &((pack_source_t *)data)[index];
+  if (source->layer == TEXTURE_PACK_LAYER_NONE)
+  {
+    return;
+  }
+
+  int width, height;
+  source->pixels = texture_source_load(source->source, &width, &height);
+  if (source->pixels != NULL && (width != source->width || height != source->height))
+  {
+    texture_source_free(source->pixels);
+    source->pixels = NULL;
+  }
+}
+
+// tallest first, the index breaks ties so the layout only depends on the sources
+static int _compare_sources(void const *a, void const *b)
+{
+  pack_source_t const *x = *(pack_source_t const **)a, *y = *(pack_source_t const **)b;
+  if (x->height != y->height)
+  {
+    return x->height > y->height ? -1 : 1;
+  }
+  if (x->width != y->width)
+  {
+    return x->width > y->width ? -1 : 1;
+  }
+  return (x > y) - (x < y);
+}
+
+// shelf packing of tiles the size of their source, the gutter inset so that two
+// halves of a layer fit next to each other. a source too large to share its
+// layer gets one of its own without gutter, a tiny one takes the gutter on top
+static uint32_t _layout(pack_source_t *sources, size_t sources_size, uint32_t width, uint32_t height)
+{
+  pack_source_t **order = malloc(sources_size * sizeof(pack_source_t *));
+  assert(order != NULL);
+  size_t order_size = 0;
+  for (size_t i = 0; i < sources_size; i++)
+  {
+    if (sources[i].layer != TEXTURE_PACK_LAYER_NONE)
+    {
+      order[order_size++] = &sources[i];
+    }
+  }
+  qsort(order, order_size, sizeof(pack_source_t *), _compare_sources);
+
+  uint32_t layers_size = 0, x = 0, y = 0, shelf_height = 0;
+  int32_t atlas = TEXTURE_PACK_LAYER_NONE;
+  for (size_t i = 0; i < order_size; i++)
+  {
+    pack_source_t *source = order[i];
+    uint32_t tile_width = _align(source->width), tile_height = _align(source->height);
+    tile_width += tile_width < 8 * GUTTER ? 2 * GUTTER : 0;
+    tile_height += tile_height < 8 * GUTTER ? 2 * GUTTER : 0;
+    if (tile_width > width || tile_height > height || (2 * tile_width > width && 2 * tile_height > height))
+    {
+      source->layer = layers_size++;
+      source->x = source->y = source->gutter = 0;
+      source->inner_width = source->width;
+      source->inner_height = source->height;
+      continue;
+    }
+
+    if (atlas == TEXTURE_PACK_LAYER_NONE || x + tile_width > width)
+    {
+      y += shelf_height;
+      x = shelf_height = 0;
+    }
+
+    if (atlas == TEXTURE_PACK_LAYER_NONE || y + tile_height > height)
+    {
+      atlas = layers_size++;
+      x = y = shelf_height = 0;
+    }
+
+    source->layer = atlas;
+    source->x = x + GUTTER;
+    source->y = y + GUTTER;
+    source->inner_width = tile_width - 2 * GUTTER;
+    source->inner_height = tile_height - 2 * GUTTER;
+    source->gutter = GUTTER;
+    x += tile_width;
+    shelf_height = tile_height > shelf_height ? tile_height : shelf_height;
+  }
+
+  free(order);
+  return layers_size;
+}
+
+static int _wrap(int value, int size)
+{
+  value %= size;
+  return value < 0 ? value + size : value;
+}
+
+// bilinear with wrapped coordinates, in texels of the source
+static void _sample(pack_source_t const *source, float u, float v, unsigned char *dest)
+{
+  float floor_u = floorf(u), floor_v = floorf(v);
+  float fraction_u = u - floor_u, fraction_v = v - floor_v;
+  int x0 = _wrap((int)floor_u, source->width), x1 = _wrap((int)floor_u + 1, source->width);
+  int y0 = _wrap((int)floor_v, source->height), y1 = _wrap((int)floor_v + 1, source->height);
+  unsigned char const *row0 = &source->pixels[(size_t)y0 * source->width * 4];
+  unsigned char const *row1 = &source->pixels[(size_t)y1 * source->width * 4];
+  for (int c = 0; c < 4; c++)
+  {
+    float top = row0[x0 * 4 + c] + (row0[x1 * 4 + c] - row0[x0 * 4 + c]) * fraction_u;
+    float bottom = row1[x0 * 4 + c] + (row1[x1 * 4 + c] - row1[x0 * 4 + c]) * fraction_u;
+    dest[c] = (unsigned char)(top + (bottom - top) * fraction_v + .5f);
+  }
+}
+
+// the source is resampled to the inner size of its tile, the gutter continues
+// it wrapped, which is what the shader's wrapped coordinates would have
+// sampled there. an inner size equal to the source copies it texel for texel
+static void _blit(pack_source_t const *source, uint32_t width, uint32_t height, unsigned char *page)
+{
+  int gutter = source->gutter;
+  float scale_u = (float)source->width / source->inner_width, scale_v = (float)source->height / source->inner_height;
+  for (int y = -gutter; y < (int)source->inner_height + gutter; y++)
+  {
+    int64_t page_y = (int64_t)source->y + y;
+    if (page_y < 0 || page_y >= height)
+    {
+      continue;
+    }
+
+    float v = (y + .5f) * scale_v - .5f;
+    for (int x = -gutter; x < (int)source->inner_width + gutter; x++)
+    {
+      int64_t page_x = (int64_t)source->x + x;
+      if (page_x >= 0 && page_x < width)
+      {
+        _sample(source, (x + .5f) * scale_u - .5f, v, &page[((size_t)page_y * width + page_x) * 4]);
+      }
+    }
+  }
+}
+
+// every layer is composed, filtered and compressed on its own so only one page
+// of pixels is alive at a time
+static unsigned char *_encode(
+    pack_source_t const *sources, size_t sources_size, texture_usage_t usage, texture_ktx_t *ktx)
+{
+  size_t blocks_size = 0, offsets[TEXTURE_KTX_LEVELS_MAX];
+  for (uint32_t i = 0; i < ktx->levels_size; i++)
+  {
+    offsets[i] = blocks_size;
+    ktx->levels[i].size = texture_compress_size(
+        ktx->format, texture_mips_extent(ktx->width, i), texture_mips_extent(ktx->height, i)) * ktx->layers_size;
+    blocks_size += ktx->levels[i].size;
+  }
+
+  unsigned char *blocks = malloc(blocks_size);
+  unsigned char *page = malloc((size_t)ktx->width * ktx->height * 4);
+  unsigned char *next = malloc((size_t)texture_mips_extent(ktx->width, 1) * texture_mips_extent(ktx->height, 1) * 4);
+  assert(blocks != NULL && page != NULL && next != NULL);
+
+  for (uint32_t layer = 0; layer < ktx->layers_size; layer++)
+  {
+    memset(page, 0, (size_t)ktx->width * ktx->height * 4);
+    for (size_t i = 0; i < sources_size; i++)
+    {
+      if (sources[i].layer == (int32_t)layer && sources[i].pixels != NULL)
+      {
+        _blit(&sources[i], ktx->width, ktx->height, page);
+      }
+    }
+
+    unsigned char *level = page, *spare = next;
+    for (uint32_t i = 0; i < ktx->levels_size; i++)
+    {
+      uint32_t level_width = texture_mips_extent(ktx->width, i), level_height = texture_mips_extent(ktx->height, i);
+      size_t layer_size = ktx->levels[i].size / ktx->layers_size;
+      texture_compress(ktx->format, level, level_width, level_height, &blocks[offsets[i] + layer * layer_size]);
+
+      if (i + 1 < ktx->levels_size)
+      {
+        texture_mips_downsample(level, level_width, level_height, usage, spare);
+        unsigned char *swap = level;
+        level = spare;
+        spare = swap;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < ktx->levels_size; i++)
+  {
+    ktx->levels[i].data = &blocks[offsets[i]];
+  }
+
+  free(next);
+  free(page);
+  return blocks;
+}
+
+static void _upload(texture_ktx_t const *ktx, texture_pack_t *pack)
+{
+  GLenum format = texture_compress_gl_format(ktx->format);
+  glGenTextures(1, &pack->texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, pack->texture);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, ktx->levels_size, format, ktx->width, ktx->height, ktx->layers_size);
+  for (uint32_t i = 0; i < ktx->levels_size; i++)
+  {
+    glCompressedTexSubImage3D(
+        GL_TEXTURE_2D_ARRAY, i, 0, 0, 0,
+        texture_mips_extent(ktx->width, i), texture_mips_extent(ktx->height, i), ktx->layers_size,
+        format, ktx->levels[i].size, ktx->levels[i].data);
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  pack->format = ktx->format;
+  pack->width = ktx->width;
+  pack->height = ktx->height;
+  pack->layers_size = ktx->layers_size;
+  pack->levels_size = ktx->levels_size;
+}
+
+bool texture_pack_build(
+    char const *cache_path,
+    texture_source_t const *texture_sources,
+    size_t sources_size,
+    texture_usage_t usage,
+    texture_pack_t *pack,
+    texture_pack_region_t *regions)
+{
+  memset(pack, 0, sizeof(texture_pack_t));
+  pack_source_t *sources = calloc(sources_size, sizeof(pack_source_t));
+  assert(sources_size == 0 || sources != NULL);
+  for (size_t i = 0; i < sources_size; i++)
+  {
+    sources[i].source = &texture_sources[i];
+  }
+
+  thread_pool_t *pool = thread_pool_shared();
+  thread_pool_for(pool, sources_size, _info_task, sources);
+
+  // the array takes the largest width and height of any source
+  uint32_t width = 0, height = 0;
+  uint64_t hash = fs_hash(&usage, sizeof(usage), PACK_VERSION);
+  bool complete = true;
+  for (size_t i = 0; i < sources_size; i++)
+  {
+    width = (uint32_t)sources[i].width > width ? (uint32_t)sources[i].width : width;
+    height = (uint32_t)sources[i].height > height ? (uint32_t)sources[i].height : height;
+    hash = fs_hash(&sources[i].hash, sizeof(sources[i].hash), hash);
+    complete = complete && sources[i].has_hash;
+  }
+
+  uint32_t layers_size = width > 0 ? _layout(sources, sources_size, width, height) : 0;
+  uint32_t levels_size = width > 0 ? texture_mips_count(width, height) : 0;
+  levels_size = levels_size < TEXTURE_KTX_LEVELS_MAX ? levels_size : TEXTURE_KTX_LEVELS_MAX;
+  for (size_t i = 0; i < sources_size; i++)
+  {
+    if (sources[i].layer != TEXTURE_PACK_LAYER_NONE && sources[i].gutter > 0 && levels_size > GUTTER_LEVELS)
+    {
+      levels_size = GUTTER_LEVELS;
+    }
+  }
+  texture_ktx_t ktx = {0};
+  unsigned char *blocks = NULL;
+
+  if (layers_size > 0 && !(texture_ktx_open(cache_path, hash, &ktx) && ktx.width == width &&
+                           ktx.height == height && ktx.layers_size == layers_size &&
+                           ktx.levels_size == levels_size))
+  {
+    double start = timer_now();
+    texture_ktx_close(&ktx);
+    thread_pool_for(pool, sources_size, _decode_task, sources);
+
+    ktx = (texture_ktx_t){.format = TEXTURE_FORMAT_BC1, .width = width, .height = height, .layers_size = layers_size};
+    ktx.levels_size = levels_size;
+
+    // the format that fits every source, bc1 < bc3 and bc1 < bc7 for the usages that pick them
+    for (size_t i = 0; i < sources_size; i++)
+    {
+      if (sources[i].pixels == NULL)
+      {
+        complete &= sources[i].layer == TEXTURE_PACK_LAYER_NONE;
+        continue;
+      }
+
+      texture_format_t format = texture_compress_select(usage, sources[i].pixels, (size_t)sources[i].width * sources[i].height);
+      ktx.format = format > ktx.format ? format : ktx.format;
+    }
+
+    blocks = _encode(sources, sources_size, usage, &ktx);
+    printf("Packed %s: %.1f ms\n", cache_path, timer_elapsed_ms(start));
+    if (complete && !texture_ktx_write(cache_path, hash, &ktx))
+    {
+      fprintf(stderr, "Cannot write texture cache %s\n", cache_path);
+    }
+  }
+
+  if (layers_size > 0)
+  {
+    _upload(&ktx, pack);
+  }
+
+  for (size_t i = 0; i < sources_size; i++)
+  {
+    pack_source_t const *source = &sources[i];
+    regions[i] = (texture_pack_region_t){.layer = TEXTURE_PACK_LAYER_NONE};
+    if (pack->texture != 0 && source->layer != TEXTURE_PACK_LAYER_NONE)
+    {
+      regions[i].layer = source->layer;
+      regions[i].rect[0] = (float)source->x / width;
+      regions[i].rect[1] = (float)source->y / height;
+      regions[i].rect[2] = (float)source->inner_width / width;
+      regions[i].rect[3] = (float)source->inner_height / height;
+    }
+    else
+    {
+      fprintf(stderr, "Cannot load texture %s\n", source->source->path);
+    }
+    texture_source_free(source->pixels);
+  }
+
+  texture_ktx_close(&ktx);
+  free(blocks);
+  free(sources);
+  return pack->texture != 0;
+}
+
+void texture_pack_deinit(texture_pack_t *pack)
+{
+  if (pack == NULL)
+  {
+    return;
+  }
+
+  glDeleteTextures(1, &pack->texture);
+  memset(pack, 0, sizeof(texture_pack_t));
+}
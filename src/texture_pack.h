@@ -0,0 +1,47 @@
+#if !defined(_TEXTURE_PACK_H_)
+#define _TEXTURE_PACK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/gl.h>
+#include <cglm/types.h>
+
+#include "texture_compress.h"
+#include "texture_ktx.h"
+#include "texture_source.h"
+
+#define TEXTURE_PACK_EXTENSION ".pack" TEXTURE_KTX_EXTENSION
+#define TEXTURE_PACK_LAYER_NONE -1
+
+// rect maps the [0, 1) uv range of a source into its layer as offset xy and
+// scale zw, a source that could not be loaded has no layer
+typedef struct texture_pack_region
+{
+  int32_t layer;
+  vec4 rect;
+} texture_pack_region_t;
+
+// one GL_TEXTURE_2D_ARRAY with a single block format for every layer
+typedef struct texture_pack
+{
+  GLuint texture;
+  texture_format_t format;
+  uint32_t width, height, layers_size, levels_size;
+} texture_pack_t;
+
+// sources too large to share a layer take one each, smaller ones are
+// resampled into atlas tiles of their own size with a wrapped gutter inset.
+// a pack with atlas layers only keeps the levels the gutter covers. the packed
+// levels are kept at cache_path while every source keeps its hash. GL thread only
+bool texture_pack_build(
+    char const *cache_path,
+    texture_source_t const *sources,
+    size_t sources_size,
+    texture_usage_t usage,
+    texture_pack_t *pack,
+    texture_pack_region_t *regions);
+void texture_pack_deinit(texture_pack_t *pack);
+
+#endif // _TEXTURE_PACK_H_
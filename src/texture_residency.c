@@ -0,0 +1,404 @@
+#include "texture_residency.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "texture_mips.h"
+#include "timer.h"
+
+#define SLOT_EMPTY 0u
+#define MIN_SLOTS 64
+
+typedef struct resident_texture
+{
+  GLuint texture;
+  texture_ktx_t ktx;
+  void *blocks;
+  uint32_t base_level, tail_level, wanted_level;
+  uint64_t last_used;
+  size_t resident_bytes;
+} resident_texture_t;
+
+// slots hold the index + 1 of a texture, open addressed on its GL name
+static struct
+{
+  resident_texture_t *textures;
+  size_t textures_size, textures_capacity;
+  uint32_t *slots;
+  size_t slots_capacity;
+  uint32_t *victims, *candidates;
+  size_t resident_bytes, budget;
+  size_t streamed_levels, evicted_levels;
+  uint64_t frame;
+} residency = {.budget = TEXTURE_RESIDENCY_BUDGET_DEFAULT};
+
+static size_t _home(GLuint texture)
+{
+  return (texture * 2654435761u) & (residency.slots_capacity - 1);
+}
+
+static size_t _find_slot(GLuint texture)
+{
+  if (residency.slots_capacity == 0)
+  {
+    return SIZE_MAX;
+  }
+
+  size_t mask = residency.slots_capacity - 1;
+  for (size_t i = _home(texture);; i = (i + 1) & mask)
+  {
+    uint32_t slot = residency.slots[i];
+    if (slot == SLOT_EMPTY)
+    {
+      return SIZE_MAX;
+    }
+
+    if (residency.textures[slot - 1].texture == texture)
+    {
+      return i;
+    }
+  }
+}
+
+static void _place(uint32_t index)
+{
+  size_t mask = residency.slots_capacity - 1;
+  size_t i = _home(residency.textures[index].texture);
+  while (residency.slots[i] != SLOT_EMPTY)
+  {
+    i = (i + 1) & mask;
+  }
+  residency.slots[i] = index + 1;
+}
+
+// backward shift keeps every probe chain intact without tombstones
+static void _erase_slot(size_t i)
+{
+  size_t mask = residency.slots_capacity - 1;
+  for (;;)
+  {
+    residency.slots[i] = SLOT_EMPTY;
+    size_t j = i;
+    for (;;)
+    {
+      j = (j + 1) & mask;
+      if (residency.slots[j] == SLOT_EMPTY)
+      {
+        return;
+      }
+
+      size_t home = _home(residency.textures[residency.slots[j] - 1].texture);
+      bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+      if (!stays)
+      {
+        break;
+      }
+    }
+
+    residency.slots[i] = residency.slots[j];
+    i = j;
+  }
+}
+
+static void _reserve(size_t size)
+{
+  if (size > residency.textures_capacity)
+  {
+    size_t capacity = residency.textures_capacity ? residency.textures_capacity << 1 : MIN_SLOTS;
+    residency.textures = realloc(residency.textures, capacity * sizeof(resident_texture_t));
+    residency.victims = realloc(residency.victims, capacity * sizeof(uint32_t));
+    residency.candidates = realloc(residency.candidates, capacity * sizeof(uint32_t));
+    assert(residency.textures != NULL && residency.victims != NULL && residency.candidates != NULL);
+    residency.textures_capacity = capacity;
+  }
+
+  if (size * 2 > residency.slots_capacity)
+  {
+    size_t capacity = residency.slots_capacity ? residency.slots_capacity << 1 : MIN_SLOTS;
+    free(residency.slots);
+    residency.slots = calloc(capacity, sizeof(uint32_t));
+    assert(residency.slots != NULL);
+    residency.slots_capacity = capacity;
+    for (uint32_t i = 0; i < residency.textures_size; i++)
+    {
+      _place(i);
+    }
+  }
+}
+
+static void _upload_level(resident_texture_t *resident, uint32_t level)
+{
+  texture_ktx_t const *ktx = &resident->ktx;
+  glCompressedTexImage2D(
+      GL_TEXTURE_2D, level, texture_compress_gl_format(ktx->format),
+      texture_mips_extent(ktx->width, level), texture_mips_extent(ktx->height, level), 0,
+      ktx->levels[level].size, ktx->levels[level].data);
+  resident->resident_bytes += ktx->levels[level].size;
+  residency.resident_bytes += ktx->levels[level].size;
+}
+
+static void _load_level(resident_texture_t *resident)
+{
+  uint32_t level = --resident->base_level;
+  glBindTexture(GL_TEXTURE_2D, resident->texture);
+  _upload_level(resident, level);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+  residency.streamed_levels++;
+}
+
+// a zero sized image gives the memory of the level back
+static void _drop_level(resident_texture_t *resident)
+{
+  uint32_t level = resident->base_level++;
+  size_t size = resident->ktx.levels[level].size;
+  glBindTexture(GL_TEXTURE_2D, resident->texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, resident->base_level);
+  glCompressedTexImage2D(GL_TEXTURE_2D, level, texture_compress_gl_format(resident->ktx.format), 0, 0, 0, 0, NULL);
+  resident->resident_bytes -= size;
+  residency.resident_bytes -= size;
+  residency.evicted_levels++;
+}
+
+static uint32_t _tail_level(texture_ktx_t const *ktx)
+{
+  uint32_t level = 0;
+  while (level + 1 < ktx->levels_size &&
+         (texture_mips_extent(ktx->width, level) > TEXTURE_RESIDENCY_TAIL_SIZE ||
+          texture_mips_extent(ktx->height, level) > TEXTURE_RESIDENCY_TAIL_SIZE))
+  {
+    level++;
+  }
+  return level;
+}
+
+void texture_residency_set_budget(size_t budget)
+{
+  residency.budget = budget;
+}
+
+// new textures ask for full detail until something touches them
+void texture_residency_add(GLuint texture, texture_ktx_t const *ktx, void *blocks)
+{
+  texture_residency_remove(texture);
+  _reserve(residency.textures_size + 1);
+
+  uint32_t index = residency.textures_size++;
+  resident_texture_t *resident = &residency.textures[index];
+  *resident = (resident_texture_t){
+      .texture = texture,
+      .ktx = *ktx,
+      .blocks = blocks,
+      .base_level = ktx->levels_size,
+      .tail_level = _tail_level(ktx),
+      .wanted_level = 0,
+      .last_used = residency.frame,
+  };
+  _place(index);
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ktx->levels_size - 1);
+  while (resident->base_level > resident->tail_level)
+  {
+    _upload_level(resident, --resident->base_level);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, resident->base_level);
+}
+
+void texture_residency_remove(GLuint texture)
+{
+  size_t slot = _find_slot(texture);
+  if (slot == SIZE_MAX)
+  {
+    return;
+  }
+
+  uint32_t index = residency.slots[slot] - 1;
+  resident_texture_t *resident = &residency.textures[index];
+  residency.resident_bytes -= resident->resident_bytes;
+  texture_ktx_close(&resident->ktx);
+  free(resident->blocks);
+  _erase_slot(slot);
+
+  uint32_t last = --residency.textures_size;
+  if (index != last)
+  {
+    residency.slots[_find_slot(residency.textures[last].texture)] = index + 1;
+    residency.textures[index] = residency.textures[last];
+  }
+}
+
+void texture_residency_touch(GLuint texture, float screen_size)
+{
+  size_t slot = _find_slot(texture);
+  if (slot == SIZE_MAX || !(screen_size > 0.f))
+  {
+    return;
+  }
+
+  resident_texture_t *resident = &residency.textures[residency.slots[slot] - 1];
+  uint32_t size = resident->ktx.width > resident->ktx.height ? resident->ktx.width : resident->ktx.height;
+  float level = size > screen_size ? floorf(log2f(size / screen_size)) : 0.f;
+  uint32_t wanted = level < resident->tail_level ? (uint32_t)level : resident->tail_level;
+
+  if (resident->last_used != residency.frame)
+  {
+    resident->last_used = residency.frame;
+    resident->wanted_level = wanted;
+  }
+  else if (wanted < resident->wanted_level)
+  {
+    resident->wanted_level = wanted;
+  }
+}
+
+// least recently used first, then the ones holding the most levels they no longer want
+static int _compare_victims(void const *a, void const *b)
+{
+  resident_texture_t const *x = &residency.textures[*(uint32_t const *)a];
+  resident_texture_t const *y = &residency.textures[*(uint32_t const *)b];
+  if (x->last_used != y->last_used)
+  {
+    return x->last_used < y->last_used ? -1 : 1;
+  }
+
+  int64_t x_excess = (int64_t)x->wanted_level - x->base_level, y_excess = (int64_t)y->wanted_level - y->base_level;
+  return (x_excess < y_excess) - (x_excess > y_excess);
+}
+
+// most recently used first, then the ones missing the most levels
+static int _compare_candidates(void const *a, void const *b)
+{
+  resident_texture_t const *x = &residency.textures[*(uint32_t const *)a];
+  resident_texture_t const *y = &residency.textures[*(uint32_t const *)b];
+  if (x->last_used != y->last_used)
+  {
+    return x->last_used > y->last_used ? -1 : 1;
+  }
+
+  uint32_t x_missing = x->base_level - x->wanted_level, y_missing = y->base_level - y->wanted_level;
+  return (x_missing < y_missing) - (x_missing > y_missing);
+}
+
+static bool _evictable(resident_texture_t const *resident, uint64_t before, resident_texture_t const *keep)
+{
+  return resident != keep && resident->base_level < resident->tail_level &&
+         (resident->last_used < before || resident->base_level < resident->wanted_level);
+}
+
+// only takes levels from textures used before `before`, or levels finer than
+// wanted, and takes none when those cannot bring the resident bytes to target
+static bool _evict(size_t target, uint64_t before, resident_texture_t const *keep, size_t victims_size)
+{
+  size_t available = 0;
+  for (size_t i = 0; i < victims_size && residency.resident_bytes - available > target; i++)
+  {
+    resident_texture_t const *resident = &residency.textures[residency.victims[i]];
+    for (uint32_t level = resident->base_level; resident != keep && level < resident->tail_level &&
+                                                (resident->last_used < before || level < resident->wanted_level);
+         level++)
+    {
+      available += resident->ktx.levels[level].size;
+    }
+  }
+
+  if (before != UINT64_MAX && residency.resident_bytes - available > target)
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < victims_size && residency.resident_bytes > target; i++)
+  {
+    resident_texture_t *resident = &residency.textures[residency.victims[i]];
+    while (residency.resident_bytes > target && _evictable(resident, before, keep))
+    {
+      _drop_level(resident);
+    }
+  }
+
+  return residency.resident_bytes <= target;
+}
+
+void texture_residency_update(double budget_ms)
+{
+  double start = timer_now();
+  size_t victims_size = 0, candidates_size = 0;
+  for (uint32_t i = 0; i < residency.textures_size; i++)
+  {
+    resident_texture_t const *resident = &residency.textures[i];
+    if (resident->base_level < resident->tail_level)
+    {
+      residency.victims[victims_size++] = i;
+    }
+    if (resident->wanted_level < resident->base_level)
+    {
+      residency.candidates[candidates_size++] = i;
+    }
+  }
+
+  qsort(residency.victims, victims_size, sizeof(uint32_t), _compare_victims);
+  qsort(residency.candidates, candidates_size, sizeof(uint32_t), _compare_candidates);
+
+  _evict(residency.budget, UINT64_MAX, NULL, victims_size);
+
+  // one level per texture and pass, so finer levels arrive over frames
+  size_t streamed = 0;
+  for (bool progress = true; progress;)
+  {
+    progress = false;
+    for (size_t i = 0; i < candidates_size && (streamed == 0 || timer_elapsed_ms(start) < budget_ms); i++)
+    {
+      resident_texture_t *resident = &residency.textures[residency.candidates[i]];
+      if (resident->wanted_level >= resident->base_level)
+      {
+        continue;
+      }
+
+      size_t size = resident->ktx.levels[resident->base_level - 1].size;
+      if (size > residency.budget ||
+          (residency.resident_bytes + size > residency.budget &&
+           !_evict(residency.budget - size, resident->last_used, resident, victims_size)))
+      {
+        continue;
+      }
+
+      _load_level(resident);
+      streamed++;
+      progress = true;
+    }
+
+    progress = progress && timer_elapsed_ms(start) < budget_ms;
+  }
+
+  residency.frame++;
+}
+
+void texture_residency_get_stats(texture_residency_stats_t *stats)
+{
+  *stats = (texture_residency_stats_t){
+      .textures = residency.textures_size,
+      .resident_bytes = residency.resident_bytes,
+      .budget = residency.budget,
+      .streamed_levels = residency.streamed_levels,
+      .evicted_levels = residency.evicted_levels,
+  };
+}
+
+void texture_residency_deinit(void)
+{
+  for (size_t i = 0; i < residency.textures_size; i++)
+  {
+    texture_ktx_close(&residency.textures[i].ktx);
+    free(residency.textures[i].blocks);
+  }
+
+  free(residency.textures);
+  free(residency.slots);
+  free(residency.victims);
+  free(residency.candidates);
+  size_t budget = residency.budget;
+  memset(&residency, 0, sizeof(residency));
+  residency.budget = budget;
+}
@@ -0,0 +1,40 @@
+#if !defined(_TEXTURE_RESIDENCY_H_)
+#define _TEXTURE_RESIDENCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/gl.h>
+
+#include "texture_ktx.h"
+
+#define TEXTURE_RESIDENCY_BUDGET_DEFAULT ((size_t)512 << 20)
+
+// levels no larger than this are uploaded with the texture and never evicted
+#define TEXTURE_RESIDENCY_TAIL_SIZE 64
+
+typedef struct texture_residency_stats
+{
+  size_t textures, resident_bytes, budget;
+  size_t streamed_levels, evicted_levels;
+} texture_residency_stats_t;
+
+// GL thread only. a texture keeps the mip levels [base, levels) resident, base
+// moves towards the level its largest on screen use asks for while the budget
+// allows it and away from it, least recently used first, when it is exceeded
+void texture_residency_set_budget(size_t budget);
+
+// takes ownership of ktx and of blocks, the memory ktx points into when not mapped
+void texture_residency_add(GLuint texture, texture_ktx_t const *ktx, void *blocks);
+void texture_residency_remove(GLuint texture);
+
+// screen_size is how many pixels the whole texture would span where it is drawn
+void texture_residency_touch(GLuint texture, float screen_size);
+
+// once per frame, after the frame that touched textures
+void texture_residency_update(double budget_ms);
+
+void texture_residency_get_stats(texture_residency_stats_t *stats);
+void texture_residency_deinit(void);
+
+#endif // _TEXTURE_RESIDENCY_H_
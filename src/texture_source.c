@@ -0,0 +1,113 @@
+#include "texture_source.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <stb_image.h>
+
+#include "fs.h"
+
+static bool _is_raw(texture_source_t const *source)
+{
+  return source->data != NULL && source->height > 0;
+}
+
+bool texture_source_hash(texture_source_t const *source, uint64_t *hash)
+{
+  if (source->data == NULL)
+  {
+    return fs_hash_file(source->path, hash);
+  }
+
+  *hash = fs_hash(source->data, source->size, source->size);
+  return true;
+}
+
+bool texture_source_info(texture_source_t const *source, int *width, int *height)
+{
+  int components;
+  if (_is_raw(source))
+  {
+    *width = source->width;
+    *height = source->height;
+    return true;
+  }
+
+  if (source->data != NULL)
+  {
+    return source->size <= INT_MAX && stbi_info_from_memory(source->data, source->size, width, height, &components);
+  }
+
+  return stbi_info(source->path, width, height, &components);
+}
+
+// stb_image allocates with malloc, so raw texels can share texture_source_free
+unsigned char *texture_source_load(texture_source_t const *source, int *width, int *height)
+{
+  int components;
+  if (_is_raw(source))
+  {
+    size_t texels_size = (size_t)source->width * source->height;
+    if (source->size < texels_size * 4)
+    {
+      return NULL;
+    }
+
+    unsigned char *pixels = malloc(texels_size * 4);
+    assert(pixels != NULL);
+    for (size_t i = 0; i < texels_size * 4; i += 4)
+    {
+      pixels[i] = source->data[i + 2];
+      pixels[i + 1] = source->data[i + 1];
+      pixels[i + 2] = source->data[i];
+      pixels[i + 3] = source->data[i + 3];
+    }
+
+    *width = source->width;
+    *height = source->height;
+    return pixels;
+  }
+
+  if (source->data != NULL)
+  {
+    return source->size <= INT_MAX
+               ? stbi_load_from_memory(source->data, source->size, width, height, &components, STBI_rgb_alpha)
+               : NULL;
+  }
+
+  return stbi_load(source->path, width, height, &components, STBI_rgb_alpha);
+}
+
+void texture_source_free(unsigned char *pixels)
+{
+  stbi_image_free(pixels);
+}
+
+void texture_source_copy(texture_source_t const *source, texture_source_t *copy)
+{
+  *copy = *source;
+  copy->path = strdup(source->path);
+  assert(copy->path != NULL);
+
+  if (source->data != NULL)
+  {
+    unsigned char *data = malloc(source->size);
+    assert(source->size == 0 || data != NULL);
+    memcpy(data, source->data, source->size);
+    copy->data = data;
+  }
+}
+
+void texture_source_deinit(texture_source_t *source)
+{
+  if (source == NULL)
+  {
+    return;
+  }
+
+  free((void *)source->path);
+  free((void *)source->data);
+  memset(source, 0, sizeof(texture_source_t));
+}
@@ -0,0 +1,31 @@
+#if !defined(_TEXTURE_SOURCE_H_)
+#define _TEXTURE_SOURCE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// where the pixels of a texture come from: the image file at path when data is
+// NULL, otherwise bytes in memory like an embedded assimp texture. those are an
+// encoded image when height is 0 and width x height bgra texels otherwise.
+// path names the texture either way and its cache sits next to it
+typedef struct texture_source
+{
+  char const *path;
+  unsigned char const *data;
+  size_t size;
+  uint32_t width, height;
+} texture_source_t;
+
+bool texture_source_hash(texture_source_t const *source, uint64_t *hash);
+bool texture_source_info(texture_source_t const *source, int *width, int *height);
+
+// tightly packed 8 bit rgba, free with texture_source_free
+unsigned char *texture_source_load(texture_source_t const *source, int *width, int *height);
+void texture_source_free(unsigned char *pixels);
+
+// deep copy that owns its path and data, release with texture_source_deinit
+void texture_source_copy(texture_source_t const *source, texture_source_t *copy);
+void texture_source_deinit(texture_source_t *source);
+
+#endif // _TEXTURE_SOURCE_H_
@@ -0,0 +1,219 @@
+#include "thread_pool.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#define INITIAL_TASKS_CAPACITY 64
+
+// helpers that start after every index is taken only drop their reference,
+// so the caller waits for finished indices instead of for its helpers
+typedef struct for_job
+{
+  thread_for_fn fn;
+  void *data;
+  size_t count;
+  atomic_size_t next, refs;
+  size_t finished;
+  pthread_mutex_t mutex;
+  pthread_cond_t done;
+} for_job_t;
+
+static thread_pool_t shared_pool;
+static pthread_once_t shared_pool_once = PTHREAD_ONCE_INIT;
+
+static void *_worker(void *arg)
+{
+  thread_pool_t *pool = arg;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->tasks_count == 0 && !pool->stopping)
+    {
+      pthread_cond_wait(&pool->has_work, &pool->mutex);
+    }
+
+    if (pool->tasks_count == 0)
+    {
+      pthread_mutex_unlock(&pool->mutex);
+      return NULL;
+    }
+
+    thread_task_t task = pool->tasks[pool->tasks_head];
+    pool->tasks_head = (pool->tasks_head + 1) % pool->tasks_capacity;
+    pool->tasks_count--;
+    pthread_mutex_unlock(&pool->mutex);
+
+    task.fn(task.data);
+  }
+}
+
+size_t thread_pool_cpu_count(void)
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t)count : 1;
+}
+
+void thread_pool_init(size_t threads_size, thread_pool_t *pool)
+{
+  memset(pool, 0, sizeof(thread_pool_t));
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->has_work, NULL);
+
+  pool->tasks = malloc(INITIAL_TASKS_CAPACITY * sizeof(thread_task_t));
+  assert(pool->tasks != NULL);
+  pool->tasks_capacity = INITIAL_TASKS_CAPACITY;
+
+  pool->threads = calloc(threads_size, sizeof(pthread_t));
+  assert(threads_size == 0 || pool->threads != NULL);
+  for (size_t i = 0; i < threads_size; i++)
+  {
+    if (pthread_create(&pool->threads[i], NULL, _worker, pool) != 0)
+    {
+      break;
+    }
+    pool->threads_size++;
+  }
+}
+
+void thread_pool_deinit(thread_pool_t *pool)
+{
+  if (pool == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->has_work);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (size_t i = 0; i < pool->threads_size; i++)
+  {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->has_work);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->threads);
+  free(pool->tasks);
+}
+
+static void _init_shared_pool(void)
+{
+  size_t cpus = thread_pool_cpu_count();
+  thread_pool_init(cpus > 1 ? cpus - 1 : 1, &shared_pool);
+}
+
+thread_pool_t *thread_pool_shared(void)
+{
+  pthread_once(&shared_pool_once, _init_shared_pool);
+  return &shared_pool;
+}
+
+void thread_pool_submit(thread_pool_t *pool, thread_task_fn fn, void *data)
+{
+  pthread_mutex_lock(&pool->mutex);
+
+  if (pool->tasks_count == pool->tasks_capacity)
+  {
+    size_t new_capacity = pool->tasks_capacity << 1;
+    thread_task_t *new_tasks = malloc(new_capacity * sizeof(thread_task_t));
+    assert(new_tasks != NULL);
+    for (size_t i = 0; i < pool->tasks_count; i++)
+    {
+      new_tasks[i] = pool->tasks[(pool->tasks_head + i) % pool->tasks_capacity];
+    }
+    free(pool->tasks);
+    pool->tasks = new_tasks;
+    pool->tasks_head = 0;
+    pool->tasks_capacity = new_capacity;
+  }
+
+  size_t tail = (pool->tasks_head + pool->tasks_count) % pool->tasks_capacity;
+  pool->tasks[tail] = (thread_task_t){.fn = fn, .data = data};
+  pool->tasks_count++;
+
+  pthread_cond_signal(&pool->has_work);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+static void _release_for_job(for_job_t *job)
+{
+  if (atomic_fetch_sub_explicit(&job->refs, 1, memory_order_acq_rel) == 1)
+  {
+    pthread_cond_destroy(&job->done);
+    pthread_mutex_destroy(&job->mutex);
+    free(job);
+  }
+}
+
+static void _run_for_job(for_job_t *job)
+{
+  size_t index, finished = 0;
+  while ((index = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < job->count)
+  {
+    job->fn(job->data, index);
+    finished++;
+  }
+
+  if (finished == 0)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&job->mutex);
+  job->finished += finished;
+  if (job->finished == job->count)
+  {
+    pthread_cond_broadcast(&job->done);
+  }
+  pthread_mutex_unlock(&job->mutex);
+}
+
+static void _for_task(void *data)
+{
+  for_job_t *job = data;
+  _run_for_job(job);
+  _release_for_job(job);
+}
+
+// the calling thread takes part in the loop, so this also makes progress
+// when every worker is busy with long running tasks, including when it is
+// called from inside a task of the same pool
+void thread_pool_for(thread_pool_t *pool, size_t count, thread_for_fn fn, void *data)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  for_job_t *job = malloc(sizeof(for_job_t));
+  assert(job != NULL);
+  *job = (for_job_t){.fn = fn, .data = data, .count = count};
+  atomic_init(&job->next, 0);
+  pthread_mutex_init(&job->mutex, NULL);
+  pthread_cond_init(&job->done, NULL);
+
+  size_t helpers = count - 1 < pool->threads_size ? count - 1 : pool->threads_size;
+  atomic_init(&job->refs, helpers + 1);
+  for (size_t i = 0; i < helpers; i++)
+  {
+    thread_pool_submit(pool, _for_task, job);
+  }
+
+  _run_for_job(job);
+
+  pthread_mutex_lock(&job->mutex);
+  while (job->finished < job->count)
+  {
+    pthread_cond_wait(&job->done, &job->mutex);
+  }
+  pthread_mutex_unlock(&job->mutex);
+
+  _release_for_job(job);
+}
@@ -0,0 +1,38 @@
+#if !defined(_THREAD_POOL_H_)
+#define _THREAD_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <pthread.h>
+
+typedef void (*thread_task_fn)(void *data);
+typedef void (*thread_for_fn)(void *data, size_t index);
+
+typedef struct thread_task
+{
+  thread_task_fn fn;
+  void *data;
+} thread_task_t;
+
+typedef struct thread_pool
+{
+  pthread_t *threads;
+  size_t threads_size;
+  pthread_mutex_t mutex;
+  pthread_cond_t has_work;
+  thread_task_t *tasks;
+  size_t tasks_head, tasks_count, tasks_capacity;
+  bool stopping;
+} thread_pool_t;
+
+size_t thread_pool_cpu_count(void);
+
+void thread_pool_init(size_t threads_size, thread_pool_t *pool);
+void thread_pool_deinit(thread_pool_t *pool);
+thread_pool_t *thread_pool_shared(void);
+
+void thread_pool_submit(thread_pool_t *pool, thread_task_fn fn, void *data);
+void thread_pool_for(thread_pool_t *pool, size_t count, thread_for_fn fn, void *data);
+
+#endif // _THREAD_POOL_H_
@@ -0,0 +1,10 @@
+#include "timer.h"
+
+#include <time.h>
+
+double timer_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
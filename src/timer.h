@@ -0,0 +1,7 @@
+#if !defined(_TIMER_H_)
+#define _TIMER_H_
+
+double timer_now(void);
+#define timer_elapsed_ms(start) ((timer_now() - (start)) * 1000.)
+
+#endif // _TIMER_H_
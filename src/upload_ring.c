@@ -0,0 +1,122 @@
+#include "upload_ring.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define WAIT_TIMEOUT_NS 1000000000ull
+
+static size_t _align_up(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool upload_ring_init(size_t frame_size, upload_ring_t *ring)
+{
+  memset(ring, 0, sizeof(upload_ring_t));
+
+  GLint uniform_alignment = 0, storage_alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+  ring->alignment = 16;
+  ring->alignment = uniform_alignment > (GLint)ring->alignment ? (size_t)uniform_alignment : ring->alignment;
+  ring->alignment = storage_alignment > (GLint)ring->alignment ? (size_t)storage_alignment : ring->alignment;
+  ring->frame_size = _align_up(frame_size, ring->alignment);
+
+  // coherent so that writes need no explicit flush before the draw that reads them
+  GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &ring->buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, ring->frame_size * UPLOAD_RING_FRAMES, NULL, flags);
+  ring->data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, ring->frame_size * UPLOAD_RING_FRAMES, flags);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  if (ring->data == NULL)
+  {
+    fputs("Cannot map upload ring\n", stderr);
+    glDeleteBuffers(1, &ring->buffer);
+    ring->buffer = 0;
+    return false;
+  }
+
+  return true;
+}
+
+void upload_ring_deinit(upload_ring_t *ring)
+{
+  for (size_t i = 0; i < UPLOAD_RING_FRAMES; i++)
+  {
+    if (ring->fences[i] != NULL)
+    {
+      glDeleteSync(ring->fences[i]);
+    }
+  }
+
+  if (ring->data != NULL)
+  {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &ring->buffer);
+  memset(ring, 0, sizeof(upload_ring_t));
+}
+
+void upload_ring_begin_frame(upload_ring_t *ring)
+{
+  GLsync fence = ring->fences[ring->frame];
+  if (fence != NULL)
+  {
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+      ring->stalls++;
+      do
+      {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS);
+      } while (status == GL_TIMEOUT_EXPIRED);
+    }
+
+    if (status == GL_WAIT_FAILED)
+    {
+      fputs("Upload ring fence wait failed\n", stderr);
+    }
+
+    glDeleteSync(fence);
+    ring->fences[ring->frame] = NULL;
+  }
+
+  ring->head = 0;
+}
+
+void upload_ring_end_frame(upload_ring_t *ring)
+{
+  ring->fences[ring->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  ring->frame = (ring->frame + 1) % UPLOAD_RING_FRAMES;
+}
+
+void *upload_ring_alloc(upload_ring_t *ring, size_t size, GLintptr *offset)
+{
+  size_t start = _align_up(ring->head, ring->alignment);
+  if (ring->data == NULL || start + size > ring->frame_size)
+  {
+    return NULL;
+  }
+
+  ring->head = start + size;
+  ring->high_water = ring->head > ring->high_water ? ring->head : ring->high_water;
+  *offset = (GLintptr)(ring->frame * ring->frame_size + start);
+  return &ring->data[*offset];
+}
+
+bool upload_ring_bind(upload_ring_t *ring, GLenum target, GLuint binding, void const *data, size_t size)
+{
+  GLintptr offset;
+  void *destination = upload_ring_alloc(ring, size, &offset);
+  if (destination == NULL)
+  {
+    return false;
+  }
+
+  memcpy(destination, data, size);
+  glBindBufferRange(target, binding, ring->buffer, offset, (GLsizeiptr)size);
+  return true;
+}
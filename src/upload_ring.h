@@ -0,0 +1,38 @@
+#if !defined(_UPLOAD_RING_H_)
+#define _UPLOAD_RING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <glad/gl.h>
+
+#define UPLOAD_RING_FRAMES 3
+#define UPLOAD_RING_FRAME_SIZE_DEFAULT ((size_t)1 << 20)
+
+// a persistently mapped buffer split in one region per frame in flight.
+// writes go linearly into the region of the current frame, which is fenced
+// at the end of the frame and only waited on when the ring comes back to it.
+// stalls counts the frames that had to wait for the gpu
+typedef struct upload_ring
+{
+  GLuint buffer;
+  unsigned char *data;
+  size_t frame_size, alignment;
+  size_t frame, head, high_water, stalls;
+  GLsync fences[UPLOAD_RING_FRAMES];
+} upload_ring_t;
+
+bool upload_ring_init(size_t frame_size, upload_ring_t *ring);
+void upload_ring_deinit(upload_ring_t *ring);
+
+void upload_ring_begin_frame(upload_ring_t *ring);
+void upload_ring_end_frame(upload_ring_t *ring);
+
+// offsets are aligned for binding as uniform or storage buffer ranges,
+// returns NULL when the region of the frame is full
+void *upload_ring_alloc(upload_ring_t *ring, size_t size, GLintptr *offset);
+
+// copies data into the ring and binds it to an indexed target
+bool upload_ring_bind(upload_ring_t *ring, GLenum target, GLuint binding, void const *data, size_t size);
+
+#endif // _UPLOAD_RING_H_
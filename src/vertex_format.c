@@ -0,0 +1,202 @@
+#include "vertex_format.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <cglm/cglm.h>
+
+#define SKIN_OFFSET sizeof(packed_vertex_t)
+
+#define BASE_ATTRIBUTES(uv_type, uv_normalized)                                                     \
+  {0, 3, GL_UNSIGNED_SHORT, GL_TRUE, GL_FALSE, offsetof(packed_vertex_t, position)},                \
+      {1, 2, GL_SHORT, GL_TRUE, GL_FALSE, offsetof(packed_vertex_t, normal)},                       \
+      {2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, GL_FALSE, offsetof(packed_vertex_t, tangent)},         \
+      {4, 2, uv_type, uv_normalized, GL_FALSE, offsetof(packed_vertex_t, tex_coords)}
+
+#define SKIN_ATTRIBUTES                                                                                  \
+  {5, MAX_BONE_INFLUENCE, GL_UNSIGNED_SHORT, GL_FALSE, GL_TRUE, SKIN_OFFSET + offsetof(packed_skin_t, bone_ids)}, \
+      {6, MAX_BONE_INFLUENCE, GL_UNSIGNED_BYTE, GL_TRUE, GL_FALSE, SKIN_OFFSET + offsetof(packed_skin_t, weights)}
+
+static vertex_layout_t const layouts[VERTEX_FORMATS_SIZE] = {
+    [0] = {
+        .attributes = {BASE_ATTRIBUTES(GL_HALF_FLOAT, GL_FALSE)},
+        .attributes_size = 4,
+        .stride = sizeof(packed_vertex_t),
+    },
+    [VERTEX_FORMAT_SKINNED] = {
+        .attributes = {BASE_ATTRIBUTES(GL_HALF_FLOAT, GL_FALSE), SKIN_ATTRIBUTES},
+        .attributes_size = 6,
+        .stride = sizeof(packed_vertex_t) + sizeof(packed_skin_t),
+    },
+    [VERTEX_FORMAT_UNORM_UV] = {
+        .attributes = {BASE_ATTRIBUTES(GL_UNSIGNED_SHORT, GL_TRUE)},
+        .attributes_size = 4,
+        .stride = sizeof(packed_vertex_t),
+    },
+    [VERTEX_FORMAT_SKINNED | VERTEX_FORMAT_UNORM_UV] = {
+        .attributes = {BASE_ATTRIBUTES(GL_UNSIGNED_SHORT, GL_TRUE), SKIN_ATTRIBUTES},
+        .attributes_size = 6,
+        .stride = sizeof(packed_vertex_t) + sizeof(packed_skin_t),
+    },
+};
+
+vertex_layout_t const *vertex_format_layout(uint32_t format)
+{
+  return &layouts[format % VERTEX_FORMATS_SIZE];
+}
+
+// skin data is only kept when some vertex is weighted, unorm uvs when they all fit [0, 1]
+uint32_t vertex_format_select(vertex_t const *vertices, size_t vertices_size)
+{
+  bool skinned = false, unorm = true;
+  for (size_t i = 0; i < vertices_size; i++)
+  {
+    vertex_t const *vertex = &vertices[i];
+    for (size_t j = 0; j < MAX_BONE_INFLUENCE; j++)
+    {
+      skinned = skinned || vertex->weights[j] > 0.f;
+    }
+
+    unorm = unorm && vertex->tex_coords[0] >= 0.f && vertex->tex_coords[0] <= 1.f &&
+            vertex->tex_coords[1] >= 0.f && vertex->tex_coords[1] <= 1.f;
+  }
+
+  return (skinned ? VERTEX_FORMAT_SKINNED : 0) | (unorm ? VERTEX_FORMAT_UNORM_UV : 0);
+}
+
+static uint16_t _unorm16(float value)
+{
+  return (uint16_t)(glm_clamp(value, 0.f, 1.f) * 65535.f + .5f);
+}
+
+static int16_t _snorm16(float value)
+{
+  return (int16_t)roundf(glm_clamp(value, -1.f, 1.f) * 32767.f);
+}
+
+static uint32_t _snorm10(float value)
+{
+  return (uint32_t)(int32_t)roundf(glm_clamp(value, -1.f, 1.f) * 511.f) & 0x3ffu;
+}
+
+// round to nearest even, overflow saturates to infinity and tiny values flush to zero
+static uint16_t _half(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint16_t sign = (bits >> 16) & 0x8000u;
+  int32_t exponent = (int32_t)((bits >> 23) & 0xffu) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffffu;
+
+  if (((bits >> 23) & 0xffu) == 0xffu)
+  {
+    return sign | 0x7c00u | (mantissa ? 0x200u : 0u);
+  }
+
+  if (exponent >= 31)
+  {
+    return sign | 0x7c00u;
+  }
+
+  if (exponent <= 0)
+  {
+    if (exponent < -10)
+    {
+      return sign;
+    }
+
+    mantissa |= 0x800000u;
+    uint32_t shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    half += rest > halfway || (rest == halfway && (half & 1u));
+    return sign | half;
+  }
+
+  uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fffu;
+  half += rest > 0x1000u || (rest == 0x1000u && (half & 1u));
+  return sign | half;
+}
+
+static void _oct_encode(float const *normal, int16_t *dest)
+{
+  float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+  if (length == 0.f)
+  {
+    dest[0] = dest[1] = 0;
+    return;
+  }
+
+  float x = normal[0] / length, y = normal[1] / length;
+  if (normal[2] < 0.f)
+  {
+    float folded_x = (1.f - fabsf(y)) * (x >= 0.f ? 1.f : -1.f);
+    float folded_y = (1.f - fabsf(x)) * (y >= 0.f ? 1.f : -1.f);
+    x = folded_x, y = folded_y;
+  }
+
+  dest[0] = _snorm16(x);
+  dest[1] = _snorm16(y);
+}
+
+// the bitangent is rebuilt in the shader as cross(normal, tangent) * w
+static uint32_t _pack_tangent(vertex_t const *vertex)
+{
+  vec3 tangent, bitangent;
+  glm_vec3_normalize_to((float *)vertex->tangent, tangent);
+  glm_vec3_cross((float *)vertex->normal, tangent, bitangent);
+  uint32_t handedness = glm_vec3_dot(bitangent, (float *)vertex->bitangent) < 0.f ? 0x3u : 0x1u;
+
+  return _snorm10(tangent[0]) | _snorm10(tangent[1]) << 10 | _snorm10(tangent[2]) << 20 | handedness << 30;
+}
+
+void vertex_format_pack(
+    void *dest,
+    uint32_t format,
+    vertex_t const *vertices,
+    size_t vertices_size,
+    vec3 offset,
+    vec3 scale)
+{
+  vertex_layout_t const *layout = vertex_format_layout(format);
+  vec3 inverse_scale;
+  for (size_t i = 0; i < 3; i++)
+  {
+    inverse_scale[i] = scale[i] > 0.f ? 1.f / scale[i] : 0.f;
+  }
+
+  for (size_t i = 0; i < vertices_size; i++)
+  {
+    vertex_t const *vertex = &vertices[i];
+    unsigned char *bytes = (unsigned char *)dest + i * layout->stride;
+
+    packed_vertex_t packed = {0};
+    for (size_t j = 0; j < 3; j++)
+    {
+      packed.position[j] = _unorm16((vertex->position[j] - offset[j]) * inverse_scale[j]);
+    }
+
+    _oct_encode(vertex->normal, packed.normal);
+    packed.tangent = _pack_tangent(vertex);
+
+    for (size_t j = 0; j < 2; j++)
+    {
+      packed.tex_coords[j] = format & VERTEX_FORMAT_UNORM_UV ? _unorm16(vertex->tex_coords[j]) : _half(vertex->tex_coords[j]);
+    }
+    memcpy(bytes, &packed, sizeof(packed));
+
+    if (format & VERTEX_FORMAT_SKINNED)
+    {
+      packed_skin_t skin;
+      for (size_t j = 0; j < MAX_BONE_INFLUENCE; j++)
+      {
+        skin.bone_ids[j] = vertex->bone_ids[j] < 0 ? 0 : (uint16_t)vertex->bone_ids[j];
+        skin.weights[j] = (uint8_t)(glm_clamp(vertex->weights[j], 0.f, 1.f) * 255.f + .5f);
+      }
+      memcpy(bytes + SKIN_OFFSET, &skin, sizeof(skin));
+    }
+  }
+}
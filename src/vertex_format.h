@@ -0,0 +1,64 @@
+#if !defined(_VERTEX_FORMAT_H_)
+#define _VERTEX_FORMAT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/gl.h>
+#include <cglm/types.h>
+
+#include "mesh.h"
+
+#define VERTEX_ATTRIBUTES_MAX 6
+
+// a format is a combination of these flags, the default is static with half float uvs
+#define VERTEX_FORMAT_SKINNED (1u << 0)
+#define VERTEX_FORMAT_UNORM_UV (1u << 1)
+#define VERTEX_FORMATS_SIZE 4
+
+typedef struct vertex_attribute
+{
+  GLuint location;
+  GLint size;
+  GLenum type;
+  GLboolean normalized, integer;
+  size_t offset;
+} vertex_attribute_t;
+
+typedef struct vertex_layout
+{
+  vertex_attribute_t attributes[VERTEX_ATTRIBUTES_MAX];
+  size_t attributes_size;
+  GLsizei stride;
+} vertex_layout_t;
+
+// what the gpu sees of a vertex_t: positions as unorm16 inside the mesh bounds,
+// octahedral snorm16 normal, tangent xyz and handedness as snorm 10_10_10_2
+typedef struct packed_vertex
+{
+  uint16_t position[4];
+  int16_t normal[2];
+  uint32_t tangent;
+  uint16_t tex_coords[2];
+} packed_vertex_t;
+
+typedef struct packed_skin
+{
+  uint16_t bone_ids[MAX_BONE_INFLUENCE];
+  uint8_t weights[MAX_BONE_INFLUENCE];
+} packed_skin_t;
+
+vertex_layout_t const *vertex_format_layout(uint32_t format);
+uint32_t vertex_format_select(vertex_t const *vertices, size_t vertices_size);
+
+// a packed position p stands for offset + p * scale
+void vertex_format_pack(
+    void *dest,
+    uint32_t format,
+    vertex_t const *vertices,
+    size_t vertices_size,
+    vec3 offset,
+    vec3 scale);
+
+#endif // _VERTEX_FORMAT_H_